@@ -0,0 +1,64 @@
+-- Convert "main"."Asic" into a table partitioned by ranges of "waferId".
+-- The svt db agent detects the partitioned table and creates the partition
+-- of each new wafer, and the next one, when the wafer is created. Each
+-- partition holds 100 wafers and is named "Asic_p<first waferId>". The
+-- agent takes the size of its new ranges from the partitions created here
+-- and logs an error if SVT_DB_AGENT_ASIC_PARTITION_WAFERS differs. Requires
+-- PostgreSQL 11 or newer.
+--
+-- The unique constraints of a partitioned table must contain the partition
+-- key: the primary key becomes ("id", "waferId") and the serial number is
+-- unique per wafer. "id" alone is then no longer a valid foreign key
+-- target, the foreign keys of "AsicProbing" and "Chip" on it are dropped.
+
+BEGIN;
+
+ALTER TABLE "main"."AsicProbing" DROP CONSTRAINT IF EXISTS "AsicProbing_asicId_fkey";
+ALTER TABLE "main"."Chip" DROP CONSTRAINT IF EXISTS "Chip_asicId_fkey";
+
+ALTER TABLE "main"."Asic" RENAME TO "AsicUnpartitioned";
+
+CREATE TABLE "main"."Asic" (
+  "id" INTEGER GENERATED BY DEFAULT AS IDENTITY,
+  "waferId" integer NOT NULL,
+  "serialNumber" varchar(50) NOT NULL,
+  "familyType" main."asicFamilyType" NOT NULL,
+  "waferMapPosition" varchar(50) NOT NULL,
+  "quality" main."asicQuality" NOT NULL,
+  PRIMARY KEY ("id", "waferId"),
+  UNIQUE ("serialNumber", "waferId")
+) PARTITION BY RANGE ("waferId");
+
+-- rows of wafers without partition, e.g. a CreateAsic on a wafer created
+-- before the migration, it stays empty in normal operation
+CREATE TABLE "main"."Asic_default" PARTITION OF "main"."Asic" DEFAULT;
+
+DO $$
+DECLARE
+  first integer;
+BEGIN
+  FOR first IN
+    SELECT DISTINCT floor("waferId" / 100.0)::integer * 100
+    FROM "main"."AsicUnpartitioned"
+  LOOP
+    EXECUTE format(
+      'CREATE TABLE "main".%I PARTITION OF "main"."Asic" FOR VALUES FROM (%s) TO (%s)',
+      'Asic_p' || first, first, first + 100);
+  END LOOP;
+END $$;
+
+INSERT INTO "main"."Asic" ("id", "waferId", "serialNumber", "familyType",
+                           "waferMapPosition", "quality")
+SELECT "id", "waferId", "serialNumber", "familyType", "waferMapPosition",
+       "quality"
+FROM "main"."AsicUnpartitioned";
+
+SELECT setval(pg_get_serial_sequence('"main"."Asic"', 'id'),
+              COALESCE(MAX("id"), 0) + 1, false)
+FROM "main"."Asic";
+
+ALTER TABLE "main"."Asic" ADD FOREIGN KEY ("waferId") REFERENCES "main"."Wafer" ("id");
+
+DROP TABLE "main"."AsicUnpartitioned";
+
+COMMIT;
@@ -0,0 +1,17 @@
+-- Transactions forwarded by the edge storages of the remote sites. A site
+-- inserts the row of a journaled transaction in the DB transaction that
+-- applies it, and skips the transactions it finds here when it forwards
+-- them again after a crash. "ids" maps the provisional ids of the rows
+-- created by the transaction to their ids, by table.
+
+BEGIN;
+
+CREATE TABLE IF NOT EXISTS "main"."EdgeForwarded" (
+  "site" varchar(255) NOT NULL,
+  "seq" bigint NOT NULL,
+  "ids" json NOT NULL,
+  "forwardedAt" timestamp NOT NULL DEFAULT now(),
+  PRIMARY KEY ("site", "seq")
+);
+
+COMMIT;
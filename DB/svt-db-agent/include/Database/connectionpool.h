@@ -0,0 +1,155 @@
+#ifndef __CONNECTION_POOL__
+#define __CONNECTION_POOL__
+
+#include "Database/statementcache.h"
+#include "SVTUtilities/SvtLogger.h"
+#include "SVTUtilities/SvtUtilities.h"
+
+#include <pqxx/pqxx>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//! One pqxx connection owned by the pool
+class DbConnection
+{
+ public:
+  DbConnection(const std::string &connString, size_t index,
+               size_t statementCacheSize);
+  ~DbConnection();
+
+  bool connect(std::string &message);
+  bool reconnect(std::string &message);
+  void close();
+
+  bool isOpen();
+  size_t getIndex() const { return mIndex; }
+  pqxx::connection &get() { return *mConnection; }
+
+  //! name of the cached prepared statement for query, empty if the
+  //! statement is not cacheable
+  const std::string &prepare(const std::string &query)
+  {
+    return mStatements.prepare(*mConnection, query);
+  }
+  const StatementCache &getStatementCache() const { return mStatements; }
+
+  //! open transaction of the connection, statements must be issued
+  //! through it while it is set
+  pqxx::work *getTransaction() { return mTransaction; }
+  void setTransaction(pqxx::work *transaction) { mTransaction = transaction; }
+
+ private:
+  friend class ConnectionPool;
+
+  std::string mConnString;
+  size_t mIndex;
+  pqxx::connection *mConnection;
+  StatementCache mStatements;
+  pqxx::work *mTransaction = nullptr;
+
+  //! time at which the connection was checked out
+  std::chrono::steady_clock::time_point mCheckoutTime;
+};
+
+struct ConnectionPoolStats
+{
+  size_t size = 0;
+  size_t inUse = 0;
+  size_t peakInUse = 0;
+  uint64_t checkouts = 0;
+  uint64_t waits = 0;
+  uint64_t timeouts = 0;
+  uint64_t totalWait_us = 0;
+  uint64_t maxWait_us = 0;
+  //! fraction of the pool connection-time spent checked out, [0, 1]
+  double utilization = 0.;
+};
+
+class ConnectionPool
+{
+ public:
+  ConnectionPool() = default;
+  ~ConnectionPool();
+
+  bool open(const std::string &connString, size_t size,
+            size_t statementCacheSize);
+  //! wait at most timeout for the checked out connections, the ones still
+  //! out are closed when they are released
+  void close(std::chrono::milliseconds timeout = kCloseTimeout);
+  bool isOpen();
+
+  //! block until a connection is available or timeout expires,
+  //! returns nullptr on timeout
+  DbConnection *acquire(std::chrono::milliseconds timeout);
+  //! idle connection or nullptr, never waits and is not counted in the
+  //! statistics
+  DbConnection *tryAcquire();
+  void release(DbConnection *connection);
+
+  size_t size();
+  ConnectionPoolStats getStats();
+  StatementCacheStats getStatementCacheStats();
+
+  static constexpr std::chrono::milliseconds kCloseTimeout{5000};
+
+ private:
+  SvtLogger &logger = SvtDbAgent::Singleton<SvtLogger>::instance();
+
+  std::vector<DbConnection *> mConnections;
+  std::vector<DbConnection *> mIdle;
+  //! checked out when the pool was closed
+  std::vector<DbConnection *> mClosing;
+  std::mutex mMutex;
+  std::condition_variable mAvailable;
+  bool mOpen = false;
+
+  //! statistics
+  std::chrono::steady_clock::time_point mOpenTime;
+  ConnectionPoolStats mStats;
+  uint64_t mBusy_us = 0;
+};
+
+struct DbReadReplica;
+
+//! RAII checkout handle, the connection is returned to the pool on
+//! destruction
+class PooledConnection
+{
+ public:
+  PooledConnection() = default;
+  PooledConnection(ConnectionPool &pool, std::chrono::milliseconds timeout);
+  //! borrow a connection already checked out by someone else, it is not
+  //! returned to the pool by this handle
+  explicit PooledConnection(DbConnection *connection)
+      : mConnection(connection)
+  {
+  }
+  ~PooledConnection() { release(); }
+
+  PooledConnection(const PooledConnection &) = delete;
+  PooledConnection &operator=(const PooledConnection &) = delete;
+  PooledConnection(PooledConnection &&other) noexcept;
+  PooledConnection &operator=(PooledConnection &&other) noexcept;
+
+  explicit operator bool() const { return mConnection != nullptr; }
+  DbConnection *operator->() { return mConnection; }
+  DbConnection &operator*() { return *mConnection; }
+
+  void release();
+
+  //! read replica owning the connection, nullptr for the primary
+  DbReadReplica *getReplica() const { return mReplica; }
+  void setReplica(DbReadReplica *replica) { mReplica = replica; }
+
+ private:
+  ConnectionPool *mPool = nullptr;
+  DbConnection *mConnection = nullptr;
+  DbReadReplica *mReplica = nullptr;
+};
+
+#endif
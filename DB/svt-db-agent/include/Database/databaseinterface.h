@@ -1,15 +1,49 @@
 #ifndef __DATABASE_INTERFACE__
 #define __DATABASE_INTERFACE__
 
+#include "Database/connectionpool.h"
+#include "Database/dbdeadline.h"
+#include "Database/dbfaults.h"
+#include "Database/dbhealth.h"
+#include "Database/dbresult.h"
+#include "Database/dbtransaction.h"
+#include "Database/querystats.h"
+#include "Database/slowquerylog.h"
+#include "Database/sqlparams.h"
 #include "SVTUtilities/SvtLogger.h"
 #include "SVTUtilities/SvtUtilities.h"
 
 #include <pqxx/pqxx>
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <vector>
 
-using row_t = std::vector<nlohmann::basic_json<>>;
-using rows_t = std::vector<row_t>;
+//! called for each batch of a streamed query, return false to stop early
+using DbStreamCallback = std::function<bool(const DbResult &)>;
+
+//! where a statement runs, reads that tolerate replication lag may be
+//! served by a read replica
+enum class DbRoute
+{
+  Primary,
+  Replica
+};
+
+//! read-only endpoint with its own pool of connections
+struct DbReadReplica
+{
+  std::string host;
+  std::string port;
+  ConnectionPool pool;
+  //! after a connection failure reads skip the replica until this time,
+  //! steady_clock ticks
+  std::atomic<std::chrono::steady_clock::rep> downUntil{0};
+};
 
 class DatabaseInterface
 {
@@ -18,15 +52,62 @@ class DatabaseInterface
 
   std::string mUser, mPassword, mConnString, mHost, mPort;
 
-  pqxx::connection *mDBConnection;
-  pqxx::nontransaction *mDBWork;
+  //! pool of connections, each query checks out its own connection
+  ConnectionPool mPool;
+  size_t mPoolSize;
+  size_t mStatementCacheSize;
+  std::chrono::milliseconds mCheckoutTimeout;
+  //! streamed queries fetch binary instead of text results
+  bool mBinaryResults = false;
+
+  //! read replicas, used round robin
+  std::vector<std::unique_ptr<DbReadReplica>> mReplicas;
+  std::atomic<size_t> mNextReplica{0};
+  //! serializes reopening the pool of a replica
+  std::mutex mReplicaMutex;
+  //! reads stay on the primary for this long after a write of the thread
+  std::chrono::milliseconds mReadYourWrites{0};
+  static constexpr std::chrono::seconds kReplicaRetry{30};
+  //! replica connection or an empty handle if the read has to go to the
+  //! primary
+  PooledConnection checkoutReplica();
+
+  friend class DbTransaction;
 
-  bool reconnect();
   bool close();
+  //! check the handle and reconnect its connection if it was lost, a
+  //! connection lost inside a transaction is not reconnected
+  bool checkConnection(PooledConnection &connection, std::string &message);
+  //! a failure of a replica connection skips the replica for kReplicaRetry,
+  //! the health monitor only sees the failures of the primary
+  void recordFailure(PooledConnection &connection, const std::string &message);
+  void markReplicaDown(DbReadReplica &replica, const std::string &message);
+  //! health monitor of the connection, nullptr for a replica
+  DbHealthMonitor *healthOf(const PooledConnection &connection)
+  {
+    return connection.getReplica() ? nullptr : &mHealth;
+  }
 
   SvtLogger &logger = SvtDbAgent::Singleton<SvtLogger>::instance();
-  bool mUnavailable;
-  std::recursive_mutex mMutex;
+  //! keepalive, reconnect and circuit breaker of the pool of the primary
+  DbHealthMonitor mHealth;
+
+  //! latency of every statement run through this interface
+  QueryStats mQueryStats;
+  SlowQueryLog mSlowLog;
+  //! cancels the statements of requests past their deadline
+  DbCancelWatchdog mCancelWatchdog;
+  //! latency and failures injected for testing, off by default
+  DbFaultInjector mFaults;
+  //! pool wait, bounded by the deadline of the request
+  std::chrono::milliseconds getCheckoutTimeout() const
+  {
+    return std::min(mCheckoutTimeout, DbDeadline::remaining());
+  }
+
+  std::string getConnectionString() const;
+  std::string getConnectionString(const std::string &host,
+                                  const std::string &port) const;
 
  public:
   DatabaseInterface();
@@ -34,27 +115,117 @@ class DatabaseInterface
 
   bool Init(const std::string &user, const std::string &password,
             const std::string &connString, const std::string &host,
-            const std::string &port);
+            const std::string &port, size_t poolSize = 1);
   bool connect();
 
   bool isConnected();
   bool isConnected(std::string &message);
 
-  void setUnavailable(bool unavailable) { mUnavailable = unavailable; };
-  bool isUnavailable() { return mUnavailable; };
-
+  //! trip the circuit breaker until the health monitor sees the DB answer
+  //! again, or reset it
+  void setUnavailable(bool unavailable)
+  {
+    unavailable ? mHealth.trip("set unavailable") : mHealth.reset();
+  };
+  bool isUnavailable() { return mHealth.isTripped(); };
+  DbHealthMonitor &getHealthMonitor() { return mHealth; }
+
+  //! checkout a connection from the pool, check the returned handle
+  //! before use: it is empty if no connection was available in time.
+  //! Inside a DbTransaction the connection of the transaction is returned.
+  //! Replica reads fall back to the primary when no replica is usable
+  PooledConnection checkout(DbRoute route = DbRoute::Primary);
+
+  //! read-only endpoint with the credentials and database of the primary,
+  //! call before connect()
+  void addReadReplica(const std::string &host, const std::string &port);
+  size_t getReadReplicaCount() const { return mReplicas.size(); }
+  //! replica reads of a thread go to the primary for window after its last
+  //! write, 0 disables it
+  void setReadYourWrites(std::chrono::milliseconds window)
+  {
+    mReadYourWrites = window;
+  }
+  //! start the read-your-writes window of the calling thread
+  void noteWrite();
+  void setCheckoutTimeout(std::chrono::milliseconds timeout)
+  {
+    mCheckoutTimeout = timeout;
+  }
+  ConnectionPoolStats getPoolStats() { return mPool.getStats(); }
+  //! connections of the primary pool, 1 before Init()
+  size_t getPoolSize() const { return mPoolSize; }
+  //! capacity of the prepared statement cache of each connection, takes
+  //! effect on the next connect()
+  void setStatementCacheSize(size_t size) { mStatementCacheSize = size; }
+  StatementCacheStats getStatementCacheStats()
+  {
+    return mPool.getStatementCacheStats();
+  }
+  void logPoolStats();
+
+  QueryStats &getQueryStats() { return mQueryStats; }
+
+  //! inject latency, errors and connection drops into every statement,
+  //! see DbFaultInjector::configure, an empty spec disables it
+  bool setFaults(const std::string &spec, std::string &message)
+  {
+    return mFaults.configure(spec, message);
+  }
+  DbFaultInjector &getFaultInjector() { return mFaults; }
+  void logQueryStats();
+
+  //! statements slower than threshold are written with their parameters
+  //! to the slow query log, 0 disables it
+  void setSlowQueryThreshold(std::chrono::microseconds threshold)
+  {
+    mSlowLog.setThreshold(threshold);
+  }
+  void setSlowQueryLogFile(const std::string &fileName)
+  {
+    mSlowLog.setFileName(fileName);
+  }
+  //! capture the plan of slow statements on a separate connection, at
+  //! most once per interval, call after Init()
+  void setSlowQueryExplain(bool enable, std::chrono::seconds interval);
+
+  void executeQuery(PooledConnection &connection, const std::string &query,
+                    const sql_params_t &params, bool &status,
+                    std::string &message, DbResult &result);
+  void executeQuery(PooledConnection &connection, const std::string &query,
+                    bool &status, std::string &message, DbResult &result);
   void executeQuery(const std::string &query, bool &status,
-                    std::string &message, rows_t &rows);
-  void executeQuery(const std::string &query, bool &status, rows_t &rows);
-  void executeQuery(const std::string &query, rows_t &rows);
-
-  void clearQueryResult(rows_t &result);
-
+                    std::string &message, DbResult &result);
+
+  //! fetch the batches of executeStream in binary format, numbers, dates
+  //! and timestamps are then decoded without parsing their text
+  void setBinaryResults(bool binary) { mBinaryResults = binary; }
+  bool getBinaryResults() const { return mBinaryResults; }
+
+  //! run query through a server side cursor and hand the rows to callback
+  //! in batches of at most batchSize rows, memory use is bounded by the
+  //! batch size and not by the size of the result
+  void executeStream(PooledConnection &connection, const std::string &query,
+                     const sql_params_t &params, size_t batchSize,
+                     const DbStreamCallback &callback, bool &status,
+                     std::string &message);
+  void executeQuery(const std::string &query, bool &status, DbResult &result);
+  void executeQuery(const std::string &query, DbResult &result);
+
+  bool executeUpdate(PooledConnection &connection, const std::string &update,
+                     const sql_params_t &params, std::string &message);
+  bool executeUpdate(PooledConnection &connection, const std::string &update,
+                     std::string &message);
   bool executeUpdate(const std::string &update, std::string &message);
   bool executeUpdate(const std::string &update);
 
-  bool commitUpdate(bool commit = true);
-  std::recursive_mutex *getMutex() { return &mMutex; };
+  //! bulk load rows into table with a single COPY ... FROM STDIN, table and
+  //! columns are used verbatim and must already be quoted, all rows are
+  //! written in one transaction
+  bool executeCopy(PooledConnection &connection, const std::string &table,
+                   const std::string &columns,
+                   const std::vector<sql_copy_row_t> &rows,
+                   std::string &message);
 };
 
 #endif
@@ -0,0 +1,89 @@
+#ifndef __DB_DEADLINE__
+#define __DB_DEADLINE__
+
+#include <pqxx/pqxx>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+//! thrown when a statement fails because its request ran past the deadline
+class DbTimeoutError : public std::runtime_error
+{
+ public:
+  using std::runtime_error::runtime_error;
+};
+
+//! Deadline of the request handled by the calling thread. While it is set
+//! every statement runs with SET LOCAL statement_timeout of the remaining
+//! time and is cancelled by the DbCancelWatchdog if it is still running
+//! after the deadline
+class DbDeadline
+{
+ public:
+  using clock = std::chrono::steady_clock;
+
+  //! set the deadline of the calling thread to now + timeout, 0 leaves the
+  //! request without deadline. The previous deadline is restored on exit
+  class Scope
+  {
+   public:
+    explicit Scope(std::chrono::milliseconds timeout);
+    ~Scope();
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+   private:
+    std::optional<clock::time_point> mPrevious;
+  };
+
+  static bool isSet();
+  static bool isExpired();
+  static clock::time_point get();
+  //! time left, at least 1 ms while the deadline has not passed
+  static std::chrono::milliseconds remaining();
+};
+
+//! Cancels statements still running after their deadline, through the
+//! cancel request of libpq on a separate socket. A single thread serves
+//! all the connections, it is started on the first watch
+class DbCancelWatchdog
+{
+ public:
+  DbCancelWatchdog() = default;
+  ~DbCancelWatchdog() { stop(); }
+
+  void stop();
+
+  //! cancel the running statement of connection once deadline + grace has
+  //! passed, release the returned ticket when the statement returns
+  uint64_t watch(pqxx::connection &connection,
+                 DbDeadline::clock::time_point deadline);
+  void release(uint64_t ticket);
+
+  //! statement_timeout normally ends the statement first
+  static constexpr std::chrono::milliseconds kGrace{250};
+
+ private:
+  struct Watch
+  {
+    pqxx::connection *connection;
+    DbDeadline::clock::time_point deadline;
+  };
+
+  void run();
+
+  std::thread mThread;
+  std::mutex mMutex;
+  std::condition_variable mWake;
+  bool mStop = false;
+  uint64_t mNextTicket = 1;
+  std::map<uint64_t, Watch> mWatched;
+};
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef __DB_FAULTS__
+#define __DB_FAULTS__
+
+#include <nlohmann/json.hpp>
+#include <pqxx/pqxx>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <string>
+
+//! latency distribution in ms
+struct DbLatency
+{
+  enum class Kind
+  {
+    None,
+    Fixed,
+    Uniform,
+    Exponential,
+    LogNormal
+  };
+
+  Kind kind = Kind::None;
+  double a = 0.;
+  double b = 0.;
+
+  //! fixed:MS, uniform:MIN:MAX, exp:MEAN or lognormal:MEDIAN:SIGMA
+  static bool parse(const std::string &spec, DbLatency &latency);
+  double sample(std::mt19937_64 &rng) const;
+};
+
+//! Fault injection for testing the agent against a slow or flapping DB.
+//! The faults are executed by the server in the transaction of the
+//! statement, so that statement_timeout, cancellation, retries and the
+//! circuit breaker see them as real ones: latency is a pg_sleep, an error
+//! is a RAISE and a dropped connection is the backend terminating itself.
+//! Disabled unless configured, the cost is then one flag check.
+class DbFaultInjector
+{
+ public:
+  //! comma separated key=value list, empty disables the injection
+  //!   latency=<DbLatency>  delay before every statement
+  //!   spike=P:MS           extra delay with probability P
+  //!   error=P              the statement fails with an SQL error
+  //!   drop=P               the connection is lost before the statement
+  //!   commit=<DbLatency>   delay before every commit
+  //!   match=TEXT           only statements containing TEXT
+  //!   seed=N               random seed, fixed runs are reproducible
+  bool configure(const std::string &spec, std::string &message);
+  bool isEnabled() const { return mEnabled; }
+
+  //! run the faults drawn for query on dbWork, throws as the DB would
+  void beforeStatement(pqxx::transaction_base &dbWork,
+                       const std::string &query);
+  void beforeCommit(pqxx::transaction_base &dbWork);
+
+  //! number of injected faults
+  nlohmann::ordered_json toJson() const;
+
+ private:
+  static void sleep(pqxx::transaction_base &dbWork, double ms);
+
+  std::atomic<bool> mEnabled{false};
+
+  std::mutex mMutex;
+  std::mt19937_64 mRng;
+  DbLatency mLatency;
+  DbLatency mCommitLatency;
+  double mSpikeProbability = 0.;
+  double mSpikeMs = 0.;
+  double mErrorProbability = 0.;
+  double mDropProbability = 0.;
+  std::string mMatch;
+
+  std::atomic<uint64_t> mDelays{0};
+  std::atomic<uint64_t> mSpikes{0};
+  std::atomic<uint64_t> mErrors{0};
+  std::atomic<uint64_t> mDrops{0};
+  std::atomic<uint64_t> mCommitDelays{0};
+};
+
+#endif
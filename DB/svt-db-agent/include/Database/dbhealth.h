@@ -0,0 +1,76 @@
+#ifndef __DB_HEALTH__
+#define __DB_HEALTH__
+
+#include "Database/connectionpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+//! thrown when a request is rejected because the database is unavailable
+class DbUnavailableError : public std::runtime_error
+{
+ public:
+  using std::runtime_error::runtime_error;
+};
+
+//! Background health check of the pool connections and circuit breaker.
+//! Idle connections are pinged every keepalive period and reconnected if
+//! they were lost. After failureThreshold consecutive connection failures
+//! the breaker trips: requests fail fast while the monitor reconnects with
+//! exponential backoff, and the breaker is reset once the DB answers again.
+class DbHealthMonitor
+{
+ public:
+  explicit DbHealthMonitor(ConnectionPool &pool) : mPool(pool) {}
+  ~DbHealthMonitor() { stop(); }
+
+  void start();
+  void stop();
+
+  void setKeepalive(std::chrono::seconds period) { mKeepalive = period; }
+  void setFailureThreshold(unsigned threshold)
+  {
+    mFailureThreshold = std::max(threshold, 1U);
+  }
+  void setMaxBackoff(std::chrono::seconds backoff) { mMaxBackoff = backoff; }
+
+  //! circuit breaker
+  bool isTripped() const { return mTripped; }
+  std::string getReason();
+  void trip(const std::string &reason);
+  void reset();
+
+  void recordSuccess() { mFailures = 0; }
+  //! connection level failure, query errors are not counted
+  void recordFailure(const std::string &reason);
+
+ private:
+  void run();
+  //! ping the idle connections and reconnect the lost ones, returns false
+  //! if a connection could not be recovered
+  bool checkIdle(bool reconnectAll);
+
+  SvtLogger &logger = SvtDbAgent::Singleton<SvtLogger>::instance();
+  ConnectionPool &mPool;
+
+  std::thread mThread;
+  std::mutex mMutex;
+  std::condition_variable mWake;
+  bool mStop = false;
+
+  std::chrono::seconds mKeepalive{30};
+  std::chrono::seconds mMaxBackoff{60};
+  unsigned mFailureThreshold = 3;
+
+  std::atomic<bool> mTripped{false};
+  std::atomic<unsigned> mFailures{0};
+  std::string mReason;
+};
+
+#endif
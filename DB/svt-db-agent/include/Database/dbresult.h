@@ -0,0 +1,116 @@
+#ifndef __DB_RESULT__
+#define __DB_RESULT__
+
+#include <nlohmann/json.hpp>
+#include <pqxx/pqxx>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//! calendar date of a date column, or the date part of a timestamp
+struct DbDate
+{
+  int year = 0;
+  int month = 0;
+  int day = 0;
+};
+
+//! timestamp column, the date and the time of day
+struct DbTimestamp
+{
+  DbDate date;
+  int hour = 0;
+  int minute = 0;
+  int second = 0;
+  int microsecond = 0;
+};
+
+//! decoding of cells in the postgres binary format, independent of a result
+namespace DbBinary
+{
+//! postgres type oids, see pg_type.dat
+enum PgType : uint32_t
+{
+  kBool = 16,
+  kInt8 = 20,
+  kInt2 = 21,
+  kInt4 = 23,
+  kFloat4 = 700,
+  kFloat8 = 701,
+  kDate = 1082,
+  kTimestamp = 1114,
+  kTimestamptz = 1184,
+};
+
+//! days since 1970-01-01 to a calendar date, proleptic gregorian
+DbDate civilFromDays(long long days);
+//! microseconds since 2000-01-01 00:00:00
+DbTimestamp timestampFromMicroseconds(long long us);
+//! binary cell of type formatted like the postgres text output, cells of
+//! other types are returned as they are
+std::string toText(uint32_t type, std::string_view bytes);
+} // namespace DbBinary
+
+//! Read-only typed view of a query result. The pqxx::result is kept alive
+//! and cells are decoded on access, by row and column index, without an
+//! intermediate copy.
+//! A binary result (fetched from a BINARY cursor) holds the postgres wire
+//! format, bool, int2/4/8, float4/8, date and timestamp cells are decoded
+//! from it without parsing text. Cells of other types are the same bytes
+//! as in text format.
+class DbResult
+{
+ public:
+  DbResult() = default;
+  explicit DbResult(pqxx::result result, bool binary = false);
+
+  size_t size() const { return mResult.size(); }
+  bool empty() const { return mResult.empty(); }
+  size_t columns() const { return mColumnTypes.size(); }
+  const char *columnName(size_t col) const { return mResult.column_name(col); }
+  //! number of rows touched by INSERT/UPDATE/DELETE
+  size_t affectedRows() const { return mResult.affected_rows(); }
+  //! size of the text, or of the binary values, of all cells
+  size_t bytes() const;
+  bool isBinary() const { return mBinary; }
+
+  bool isNull(size_t row, size_t col) const
+  {
+    return mResult[row][col].is_null();
+  }
+  //! raw cell, in a binary result only meaningful for text-like columns
+  std::string_view getStringView(size_t row, size_t col) const
+  {
+    return mResult[row][col].view();
+  }
+  //! cell as text, binary cells are formatted like the postgres text output
+  std::string getString(size_t row, size_t col) const;
+  int getInt(size_t row, size_t col) const;
+  long long getInt64(size_t row, size_t col) const;
+  double getDouble(size_t row, size_t col) const;
+  bool getBool(size_t row, size_t col) const;
+  DbDate getDate(size_t row, size_t col) const;
+  DbTimestamp getTimestamp(size_t row, size_t col) const;
+
+  //! json value of a cell according to its column type, used when the
+  //! reply is serialized
+  nlohmann::ordered_json toJson(size_t row, size_t col) const;
+  //! true if toJson returns a bool or a number for the column, other
+  //! columns are returned as strings
+  bool hasNativeJson(size_t col) const;
+
+  void clear();
+
+ private:
+  //! decoded binary cell of an integer or float column
+  long long decodeInt(size_t row, size_t col) const;
+  double decodeFloat(size_t row, size_t col) const;
+
+  pqxx::result mResult;
+  std::vector<uint32_t> mColumnTypes;
+  bool mBinary = false;
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef __DB_TRANSACTION__
+#define __DB_TRANSACTION__
+
+#include "Database/connectionpool.h"
+
+#include <pqxx/pqxx>
+
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+class DatabaseInterface;
+
+//! thrown when the DB rolled a transaction back on a deadlock or a
+//! serialization failure, running it again may succeed
+class DbRetryableError : public std::runtime_error
+{
+ public:
+  using std::runtime_error::runtime_error;
+};
+
+//! prefix of the messages of statements failing for a DbRetryableError
+inline constexpr char kDbRetryableMessage[] = "Transaction rollback: ";
+
+//! RAII unit of work, every statement issued by the creating thread through
+//! the DatabaseInterface joins the transaction until it is committed or
+//! destroyed. A transaction destroyed before commit() is rolled back.
+//! Transactions opened while another one is active on the same thread are
+//! nested into it: their commit() is a no-op and a nested rollback makes
+//! the outer commit() fail.
+class DbTransaction
+{
+ public:
+  explicit DbTransaction(DatabaseInterface &db);
+  ~DbTransaction();
+
+  DbTransaction(const DbTransaction &) = delete;
+  DbTransaction &operator=(const DbTransaction &) = delete;
+
+  void commit();
+  void rollback();
+
+  bool isNested() const { return mOuter != nullptr; }
+
+  //! run callback after the commit of the outermost transaction, or after
+  //! a failed commit whose outcome is unknown. Dropped on rollback
+  void onCommit(std::function<void()> callback);
+
+  //! innermost transaction of the calling thread, nullptr if none
+  static DbTransaction *current();
+
+ private:
+  friend class DatabaseInterface;
+
+  void finish();
+  void runCommitCallbacks();
+
+  DatabaseInterface *mDb;
+  DbTransaction *mOuter;
+  PooledConnection mConnection;
+  std::unique_ptr<pqxx::work> mWork;
+  bool mDone = false;
+  bool mRollbackOnly = false;
+  std::vector<std::function<void()>> mCommitCallbacks;
+};
+
+#endif
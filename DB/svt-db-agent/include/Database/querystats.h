@@ -0,0 +1,63 @@
+#ifndef __QUERY_STATS__
+#define __QUERY_STATS__
+
+#include <nlohmann/json.hpp>
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+//! Latency histogram with fixed microsecond buckets, together with the
+//! number of rows and bytes returned
+struct LatencyHistogram
+{
+  //! upper bounds of the buckets in us, the last bucket is unbounded
+  static constexpr std::array<uint64_t, 13> kBounds_us = {
+      100,   250,    500,    1000,   2500,   5000,   10000,
+      25000, 50000, 100000, 250000, 500000, 1000000};
+
+  std::array<uint64_t, kBounds_us.size() + 1> buckets{};
+  uint64_t count = 0;
+  uint64_t errors = 0;
+  uint64_t total_us = 0;
+  uint64_t max_us = 0;
+  uint64_t rows = 0;
+  uint64_t bytes = 0;
+
+  void record(uint64_t us, size_t nRows, size_t nBytes, bool ok);
+  //! upper bound of the bucket holding the p-th percentile, p in [0, 1]
+  uint64_t percentile(double p) const;
+  nlohmann::ordered_json toJson() const;
+};
+
+//! Per-statement-shape and per-table latency statistics of the DB calls.
+//! The statement shape is the normalized SQL text, values are always bound
+//! as $n parameters so that it does not depend on them.
+class QueryStats
+{
+ public:
+  //! number of distinct statement shapes kept, the rest is accumulated
+  //! under kOtherShape
+  static constexpr size_t kMaxShapes = 512;
+  static constexpr const char *kOtherShape = "<other>";
+
+  void record(const std::string &query, uint64_t us, size_t rows,
+              size_t bytes, bool ok);
+  void reset();
+
+  nlohmann::ordered_json toJson();
+  //! one line per table and per statement shape, slowest first
+  std::string toString();
+
+  //! table the statement reads from or writes to, empty if not found
+  static std::string tableOf(const std::string &query);
+
+ private:
+  std::mutex mMutex;
+  std::map<std::string, LatencyHistogram> mShapes;
+  std::map<std::string, LatencyHistogram> mTables;
+};
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef __SLOW_QUERY_LOG__
+#define __SLOW_QUERY_LOG__
+
+#include "Database/sqlparams.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+namespace pqxx {
+class connection;
+}
+
+//! Log of the statements slower than a threshold, written to a dedicated
+//! file. Optionally the plan of a slow statement is captured with
+//! EXPLAIN (ANALYZE, BUFFERS) on a separate connection by a background
+//! thread, at most once per explain interval.
+class SlowQueryLog
+{
+ public:
+  SlowQueryLog() = default;
+  ~SlowQueryLog();
+
+  //! 0 disables the log
+  void setThreshold(std::chrono::microseconds threshold)
+  {
+    mThreshold_us = threshold.count();
+  }
+  std::chrono::microseconds getThreshold() const
+  {
+    return std::chrono::microseconds(mThreshold_us);
+  }
+  void setFileName(const std::string &fileName);
+  //! enable plan capture, connString is used for the explain connection
+  void setExplain(bool enable, const std::string &connString,
+                  std::chrono::seconds interval);
+
+  bool isSlow(uint64_t us) const
+  {
+    return mThreshold_us && (us >= mThreshold_us);
+  }
+  void record(const std::string &query, const sql_params_t &params,
+              uint64_t us, size_t rows, bool ok);
+
+  //! correlation id of the request handled by the calling thread, it is
+  //! reported with every slow statement of the request
+  static void setCorrelationId(const std::string &correlationId);
+  static const std::string &getCorrelationId();
+
+  static std::string formatParams(const sql_params_t &params);
+
+ private:
+  struct ExplainJob
+  {
+    std::string header;
+    std::string query;
+    sql_params_t params;
+  };
+
+  void write(const std::string &entry);
+  void explainLoop();
+  std::string explain(const ExplainJob &job);
+  void stopExplain();
+
+  uint64_t mThreshold_us = 0;
+
+  std::mutex mFileMutex;
+  std::string mFileName;
+  std::ofstream mFile;
+
+  //! explain worker, a single pending job, new ones are dropped while
+  //! it is busy or within the rate limit interval
+  std::mutex mExplainMutex;
+  std::condition_variable mExplainCv;
+  std::thread mExplainThread;
+  std::optional<ExplainJob> mExplainJob;
+  std::string mConnString;
+  //! only used by the explain worker
+  std::unique_ptr<pqxx::connection> mConnection;
+  std::chrono::seconds mExplainInterval{60};
+  std::chrono::steady_clock::time_point mLastExplain;
+  bool mExplain = false;
+  bool mStop = false;
+};
+
+#endif
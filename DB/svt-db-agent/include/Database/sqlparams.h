@@ -0,0 +1,18 @@
+#ifndef __SQL_PARAMS__
+#define __SQL_PARAMS__
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <variant>
+#include <vector>
+
+//! typed value bound to a $n statement placeholder
+using sql_param_t =
+    std::variant<std::nullptr_t, bool, int, long long, double, std::string>;
+using sql_params_t = std::vector<sql_param_t>;
+
+//! text encoded row for COPY, std::nullopt is written as NULL
+using sql_copy_row_t = std::vector<std::optional<std::string>>;
+
+#endif
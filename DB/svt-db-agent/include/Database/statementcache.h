@@ -0,0 +1,63 @@
+#ifndef __STATEMENT_CACHE__
+#define __STATEMENT_CACHE__
+
+#include <pqxx/pqxx>
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+struct StatementCacheStats
+{
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+  size_t size = 0;
+  size_t capacity = 0;
+};
+
+//! Per-connection cache of named prepared statements, keyed by the
+//! normalized statement text. Least recently used statements are
+//! deallocated once the cache is full.
+class StatementCache
+{
+ public:
+  explicit StatementCache(size_t capacity = 128) : mCapacity(capacity) {}
+
+  //! return the name of the prepared statement for query, preparing it
+  //! on the connection if needed. Returns an empty string for statements
+  //! that are not worth caching (DDL, transaction control, ...).
+  const std::string &prepare(pqxx::connection &connection,
+                             const std::string &query);
+
+  //! forget all entries, e.g. after the session was lost
+  void clear();
+
+  void setCapacity(size_t capacity) { mCapacity = capacity; }
+  void addStats(StatementCacheStats &stats) const;
+
+  static std::string normalize(const std::string &query);
+  static bool isCacheable(const std::string &query);
+
+ private:
+  struct Entry
+  {
+    std::string name;
+    std::list<std::string>::iterator lruPos;
+  };
+
+  size_t mCapacity;
+  uint64_t mNextId = 0;
+  std::unordered_map<std::string, Entry> mStatements;
+  //! most recently used in front
+  std::list<std::string> mLru;
+
+  std::atomic<uint64_t> mHits{0};
+  std::atomic<uint64_t> mMisses{0};
+  std::atomic<uint64_t> mEvictions{0};
+  std::atomic<size_t> mSize{0};
+};
+
+#endif
@@ -8,6 +8,8 @@
  * @brief Database interface for SVT test
  */
 
+#include <nlohmann/json.hpp>
+
 #include <cstddef>
 #include <string>
 #include <vector>
@@ -35,6 +37,19 @@ namespace SvtDbInterface
   bool checkIdExist(const std::string &tableName, int id);
 
   size_t getAllVersions(std::vector<dbVersion> &versions);
+  //! insert a Version row, a baseVersion < 0 is stored as NULL. The id of
+  //! the new version is returned in version.id and the version graph is
+  //! updated
+  bool createVersion(dbVersion &version);
+
+  //! versioned configuration tables and the column they are keyed on:
+  //! AsicConfiguration, WpConfiguration and ProbeCardConfiguration
+  const std::string &getConfigurationKey(const std::string &tableName);
+  //! store the configuration rows of versionId in one statement, rows equal
+  //! to what the base version resolves to are skipped. Returns the number
+  //! of stored rows
+  size_t saveConfigurationDiff(const std::string &tableName, int versionId,
+                               const std::vector<nlohmann::json> &rows);
 }  // namespace SvtDbInterface
 
 #endif
@@ -0,0 +1,55 @@
+#ifndef SVT_DB_PARTITIONS_H
+#define SVT_DB_PARTITIONS_H
+
+/*!
+ * @file SvtDbPartitions.h
+ * @date Oct-2026
+ * @brief Range partitions of a partitioned table, created on demand
+ */
+
+#include <mutex>
+#include <set>
+#include <string>
+
+//! Partitions of a table declared PARTITION BY RANGE (keyColumn), each one
+//! holds rangeSize consecutive keys and is named <table>_p<first key>.
+//! The size of the ranges of the partitions already in the DB takes
+//! precedence over rangeSize. Nothing is done if the table is not
+//! partitioned in the DB, see DB/sql/SVT_DB_Asic_Partitioning.sql
+class SvtDbRangePartitions
+{
+ public:
+  SvtDbRangePartitions(std::string tableName, std::string keyColumn,
+                       long long rangeSize);
+
+  const std::string &getKeyColumn() const { return mKeyColumn; }
+  void setRangeSize(long long rangeSize);
+
+  //! checked once in the DB
+  bool isPartitioned();
+  //! create the partition of key and the following one if they do not
+  //! exist yet. The partition of key is created in the transaction of the
+  //! caller so that the rows of key can be written right after, the next
+  //! one once that transaction is committed
+  void ensurePartition(long long key);
+
+ private:
+  std::string getPartitionName(long long first) const;
+  //! take the range size from the existing partitions, caller holds
+  //! mMutex
+  void checkRangeSize();
+  //! caller holds mMutex
+  void createPartition(long long first);
+
+  const std::string mTableName;
+  const std::string mKeyColumn;
+  long long mRangeSize;
+
+  std::mutex mMutex;
+  bool mChecked = false;
+  bool mPartitioned = false;
+  //! first key of the partitions known to exist, committed in the DB
+  std::set<long long> mKnown;
+};
+
+#endif  //! SVT_DB_PARTITIONS_H
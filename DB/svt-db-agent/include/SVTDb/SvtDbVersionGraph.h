@@ -0,0 +1,47 @@
+#ifndef SVT_DB_VERSION_GRAPH_H
+#define SVT_DB_VERSION_GRAPH_H
+
+/*!
+ * @file SvtDbVersionGraph.h
+ * @date Oct-2026
+ * @brief In-memory copy of the Version table
+ */
+
+#include "SVTDb/SvtDbInterface.h"
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <vector>
+
+//! base version of every version, loaded once from the Version table so
+//! that resolving a version chain needs no query. A version that is not
+//! known triggers a reload, at most once per kReloadInterval, versions
+//! created by the agent are added with add()
+class SvtDbVersionGraph
+{
+ public:
+  //! versionId followed by its base versions, nearest first
+  std::vector<int> getChain(int versionId);
+  //! base version of versionId, -1 if it has none
+  int getBaseVersion(int versionId);
+
+  void add(const SvtDbInterface::dbVersion &version);
+  //! drop the cache, it is reloaded on the next lookup
+  void invalidate();
+
+ private:
+  //! caller holds mMutex
+  void load();
+
+  //! unknown ids within this time of the last load fail without a reload
+  static constexpr std::chrono::seconds kReloadInterval{1};
+
+  std::mutex mMutex;
+  bool mLoaded = false;
+  std::chrono::steady_clock::time_point mLoadTime;
+  //! version id -> base version id, -1 for a root version
+  std::map<int, int> mBase;
+};
+
+#endif  //! SVT_DB_VERSION_GRAPH_H
@@ -4,7 +4,10 @@
 #include "Database/databaseinterface.h"
 #include "nlohmann/json.hpp"
 
-extern std::atomic<int> queryTime;
+#include <functional>
+#include <optional>
+
+extern std::atomic<long long> queryTime;
 extern std::atomic<int> queryCount;
 extern std::atomic<int> queryTrialCount;
 
@@ -13,60 +16,255 @@ Function signatures
 **************************************************************/
 // wrapper code for interfacing with mapi
 std::string formatStr(const std::string &str);
-void doGenericQuery(std::string queryString, rows_t &rows);
+//! prefix the DB schema, str must already be quoted
+std::string addSchema(const std::string &str);
+//! version token of a row, the id of the transaction that last wrote it
+extern const char *const rowVersionColumn;
+std::string stringJoin(const std::vector<std::string> &strings,
+                       const std::string &delimiter);
+//! prefix prepended to each string
+std::string stringJoinPrefix(const std::vector<std::string> &strings,
+                             const std::string &prefix,
+                             const std::string &delimiter);
+void doGenericQuery(const std::string &queryString, DbResult &result);
+void doGenericQuery(const std::string &queryString, const sql_params_t &params,
+                    DbResult &result, DbRoute route = DbRoute::Primary);
+void doGenericStream(const std::string &queryString,
+                     const sql_params_t &params, size_t batchSize,
+                     const DbStreamCallback &callback,
+                     DbRoute route = DbRoute::Primary);
 void raiseError(std::string errorMessage);
-void finishQuery(rows_t rows);
+void finishQuery(DbResult &result);
+
+//! json scalar to a statement parameter, false for null, arrays and objects
+bool toSqlParam(const nlohmann::basic_json<> &value, sql_param_t &param);
+
+//! values are never pasted into the SQL text, each one is bound to a $n
+//! placeholder so that statements with different values share one plan
+class ParameterBinder
+{
+ public:
+  const sql_params_t &getParams() const { return mParams; }
+
+ protected:
+  //! append a value and return its placeholder
+  std::string bind(sql_param_t value)
+  {
+    mParams.push_back(std::move(value));
+    return "$" + std::to_string(mParams.size());
+  }
+  //! bind a json value, returns false for unsupported types
+  bool bind(const nlohmann::basic_json<> &value, std::string &placeholder);
+
+  sql_params_t mParams;
+};
 
-class SimpleQuery
+//! WHERE expression tree: leaves compare a column with bound values, inner
+//! nodes AND, OR or negate their children. Columns are "column" of the main
+//! table or "alias.column" of a joined table
+class SqlCondition
 {
  public:
+  enum class Op
+  {
+    Eq,
+    Ne,
+    Lt,
+    Le,
+    Gt,
+    Ge,
+    Between,
+    Any,
+    IsNull,
+    IsNotNull,
+    And,
+    Or,
+    Not
+  };
+
+  //! Eq, Ne, Lt, Le, Gt or Ge
+  static SqlCondition compare(std::string column, Op op, sql_param_t value);
+  static SqlCondition between(std::string column, sql_param_t low,
+                              sql_param_t high);
+  //! column = ANY($n), the values are bound as a single array
+  static SqlCondition any(std::string column, std::vector<long long> values);
+  static SqlCondition any(std::string column,
+                          std::vector<std::string> values);
+  static SqlCondition isNull(std::string column, bool null = true);
+  static SqlCondition allOf(std::vector<SqlCondition> children);
+  static SqlCondition anyOf(std::vector<SqlCondition> children);
+  static SqlCondition negate(SqlCondition child);
+
+  //! condition of a request filter: a scalar is an equality, null is IS
+  //! NULL, an array is an ANY and an object holds operators, e.g.
+  //! {"ge": 10, "lt": 20}, {"between": [10, 20]}, {"in": [1, 2]},
+  //! {"ne": "x"}, {"null": false}. Returns false for malformed filters
+  static bool fromJson(const std::string &column,
+                       const nlohmann::basic_json<> &value,
+                       SqlCondition &condition);
+
+  //! value of a column of the row being evaluated, nullptr for NULL
+  using ColumnLookup =
+      std::function<const nlohmann::basic_json<> *(const std::string &)>;
+  //! evaluate the condition on a row held outside the DB with the SQL
+  //! three-valued logic, true only if the row would be selected
+  bool matches(const ColumnLookup &lookup) const;
+
+ private:
+  friend class SimpleQuery;
+
+  //! std::nullopt is the SQL unknown
+  std::optional<bool> evaluate(const ColumnLookup &lookup) const;
+
+  Op mOp = Op::And;
+  std::string mColumn;
+  sql_params_t mValues;
+  std::vector<SqlCondition> mChildren;
+};
+
+class SimpleQuery : public ParameterBinder
+{
+ public:
+  enum class JoinType
+  {
+    Inner,
+    Left
+  };
+
   void setTableName(std::string tableName)
   {
     mTableName = formatStr(tableName);
   }
+  //! join tableName as alias on leftColumn = rightColumn, columns are
+  //! "column" of the main table or "alias.column". Add the joins before the
+  //! columns and the conditions: with joins the columns of the main table
+  //! are qualified by its name
+  void addJoin(std::string tableName, std::string alias,
+               std::string leftColumn, std::string rightColumn,
+               JoinType type = JoinType::Inner);
   void addColumn(std::string columnName)
   {
-    mColumnNames.push_back(formatStr(columnName));
+    mColumnKeys.push_back(columnName);
+    mColumnNames.push_back(formatColumn(columnName));
+  }
+  //! column returned under another name, e.g. "wafer.serialNumber"
+  void addColumn(std::string columnName, std::string alias)
+  {
+    mColumnKeys.push_back(alias);
+    mColumnNames.push_back(formatColumn(columnName) + " AS " +
+                           formatStr(alias));
+  }
+  //! version token of the row as "version", see rowVersionColumn
+  void addRowVersion()
+  {
+    mColumnKeys.push_back("version");
+    mColumnNames.push_back(formatColumn(rowVersionColumn) +
+                           "::text AS \"version\"");
   }
   void addWhereClause(std::string whereClause)
   {
     mWhereClauses.push_back(whereClause);
   }
-  void doQuery(rows_t &rows);
+  //! AND a condition tree to the where clauses, its values are bound now
+  void addWhere(const SqlCondition &condition)
+  {
+    mWhereClauses.push_back(render(condition));
+  }
+  void doQuery(DbResult &result);
+  //! same as doQuery but the rows are delivered in batches
+  void doStream(size_t batchSize, const DbStreamCallback &callback);
+  //! same as doQuery but the server builds the rows into a json array of
+  //! objects keyed by column name, returned as a single row: the array
+  //! text, the number of rows and, with setTotalCount, the total count.
+  //! Columns flagged in asText are sent as json strings
+  void doJsonQuery(const std::vector<bool> &asText, DbResult &result);
+
+  //! json_build_object takes at most 100 arguments
+  static constexpr size_t kMaxJsonColumns = 50;
 
   // overload addWhereEquals for different types
   void addWhereEquals(std::string columnName,
                       const nlohmann::basic_json<> &value);
   void addWhereEquals(std::string columnName, std::string value)
   {
-    mWhereClauses.push_back(formatStr(columnName) + " = '" + value + "'");
+    mWhereClauses.push_back(formatColumn(columnName) + " = " +
+                            bind(std::move(value)));
   }
   void addWhereEquals(std::string columnName, int value)
   {
-    mWhereClauses.push_back(formatStr(columnName) + " = " +
-                            std::to_string(value));
+    mWhereClauses.push_back(formatColumn(columnName) + " = " + bind(value));
   }
   void addWhereEquals(std::string columnName, float value)
   {
-    mWhereClauses.push_back(formatStr(columnName) + " = " +
-                            std::to_string(value));
+    mWhereClauses.push_back(formatColumn(columnName) + " = " +
+                            bind(static_cast<double>(value)));
   }
   void addWhereIn(std::string columnName, std::vector<int> values);
+  //! columnName = ANY(ARRAY(SELECT alias.selectColumn FROM tableName AS
+  //! alias WHERE condition)), the subquery runs once and its keys prune
+  //! the partitions of the table at execution
+  void addWhereInSelect(std::string columnName, std::string tableName,
+                        std::string alias, std::string selectColumn,
+                        const SqlCondition &condition);
 
+  //! ORDER BY id, after the columns of addOrderBy
   void setOrderById(const bool order) { mOrderById = order; }
+  void addOrderBy(std::string columnName, bool descending = false);
+  //! reads that tolerate replication lag may run on a read replica
+  void setRoute(DbRoute route) { mRoute = route; }
+
+  //! paging, LIMIT and OFFSET are applied after the keyset
+  void setLimit(size_t limit)
+  {
+    mLimit = bind(static_cast<long long>(limit));
+  }
+  void setOffset(size_t offset)
+  {
+    mOffset = bind(static_cast<long long>(offset));
+  }
+  //! keyset paging, only rows with columnName > value are returned
+  void setKeysetAfter(std::string columnName, long long value)
+  {
+    mKeysetColumn = columnName;
+    mKeysetValue = bind(value);
+  }
+  //! append as last column "totalCount" the number of rows matching the
+  //! where clauses, ignoring keyset, limit and offset
+  void setTotalCount(const bool total) { mTotalCount = total; }
 
  protected:
+  //! with rowNumber the rows are numbered in their order as "rowNumber"
+  std::string getQueryString(bool rowNumber = false) const;
+  std::string getJsonQueryString(const std::vector<bool> &asText) const;
+  //! quoted column, qualified by the main table when there are joins
+  std::string formatColumn(const std::string &columnName) const;
+  std::string render(const SqlCondition &condition);
+
   std::string mTableName;
+  std::vector<std::string> mJoins;
+  std::vector<std::string> mColumnKeys;
   std::vector<std::string> mColumnNames;
   std::vector<std::string> mWhereClauses;
+  //! order by column inside the query, and by output name around it
+  std::vector<std::pair<std::string, std::string>> mOrderBy;
   bool mOrderById = false;
+
+  std::string mLimit;
+  std::string mOffset;
+  std::string mKeysetColumn;
+  std::string mKeysetValue;
+  bool mTotalCount = false;
+  DbRoute mRoute = DbRoute::Primary;
 };
 
-bool doGenericUpdate(std::string insertString);
-void commitUpdate();
-void rollbackUpdate();
+bool doGenericUpdate(const std::string &insertString);
+bool doGenericUpdate(const std::string &insertString,
+                     const sql_params_t &params);
+//! update returning rows, it is never retried
+bool doGenericUpdate(const std::string &insertString,
+                     const sql_params_t &params, DbResult &result);
 
-class SimpleInsert
+class SimpleInsert : public ParameterBinder
 {
  public:
   void setTableName(std::string tableName)
@@ -74,6 +272,12 @@ class SimpleInsert
     mTableName = formatStr(tableName);
   }
   bool doInsert();
+  //! insert and return the columns added with addReturning of the new row
+  bool doInsert(DbResult &result);
+  void addReturning(std::string columnName)
+  {
+    mReturning.push_back(formatStr(columnName));
+  }
 
   // overload addColumnAndValue for different types
   // modify each as needed
@@ -82,27 +286,54 @@ class SimpleInsert
   void addColumnAndValue(std::string columnName, std::string value)
   {
     mColumnNames.push_back(formatStr(columnName));
-    // strings have to have '' around the value
-    mValues.push_back("'" + value + "'");
+    mValues.push_back(bind(std::move(value)));
   }
   void addColumnAndValue(std::string columnName, int value)
   {
     mColumnNames.push_back(formatStr(columnName));
-    mValues.push_back(std::to_string(value));
+    mValues.push_back(bind(value));
   }
   void addColumnAndValue(std::string columnName, float value)
   {
     mColumnNames.push_back(formatStr(columnName));
-    mValues.push_back(std::to_string(value));
+    mValues.push_back(bind(static_cast<double>(value)));
   }
 
  protected:
   std::string mTableName;
   std::vector<std::string> mColumnNames;
   std::vector<std::string> mValues;
+  std::vector<std::string> mReturning;
+
+  std::string getInsertString() const;
+};
+
+//! bulk insert of many rows streamed through COPY in one round trip,
+//! values of each row are given in the order of the columns
+class BulkInsert
+{
+ public:
+  void setTableName(std::string tableName)
+  {
+    mTableName = formatStr(tableName);
+  }
+  void addColumn(std::string columnName)
+  {
+    mColumnNames.push_back(formatStr(columnName));
+  }
+  void reserve(size_t rows) { mRows.reserve(rows); }
+  void addRow(const std::vector<nlohmann::basic_json<>> &values);
+  size_t size() const { return mRows.size(); }
+
+  bool doInsert();
+
+ protected:
+  std::string mTableName;
+  std::vector<std::string> mColumnNames;
+  std::vector<sql_copy_row_t> mRows;
 };
 
-class SimpleUpdate
+class SimpleUpdate : public ParameterBinder
 {
  public:
   void setTableName(std::string tableName)
@@ -110,6 +341,20 @@ class SimpleUpdate
     mTableName = formatStr(tableName);
   }
   bool doUpdate();
+  //! update in one statement returning a single row: the columns added
+  //! with addReturning and the "version" of the updated row, all NULL if
+  //! no row was updated, then "found", true if the WHERE clauses match a
+  //! row whatever its version. Without columns the row is only read
+  void doUpdate(DbResult &result);
+  void addReturning(std::string columnName)
+  {
+    mReturning.push_back(formatStr(columnName));
+  }
+  //! update only the row version read by the client, see rowVersionColumn
+  void setRowVersion(std::string version)
+  {
+    mRowVersion = bind(std::move(version));
+  }
 
   // overload addColumnAndValue for different types
   // modify each as needed
@@ -117,19 +362,18 @@ class SimpleUpdate
                          const nlohmann::basic_json<> &value);
   void addColumnAndValue(std::string columnName, std::string value)
   {
-    // strings have to have '' around the value
-    mColumnNamesAndValues.push_back(formatStr(columnName) + " = '" + value +
-                                    "'");
+    mColumnNamesAndValues.push_back(formatStr(columnName) + " = " +
+                                    bind(std::move(value)));
   }
   void addColumnAndValue(std::string columnName, int value)
   {
     mColumnNamesAndValues.push_back(formatStr(columnName) + " = " +
-                                    std::to_string(value));
+                                    bind(value));
   }
   void addColumnAndValue(std::string columnName, float value)
   {
     mColumnNamesAndValues.push_back(formatStr(columnName) + " = " +
-                                    std::to_string(value));
+                                    bind(static_cast<double>(value)));
   }
 
   // overload addWhereEquals for different types
@@ -137,58 +381,48 @@ class SimpleUpdate
                       const nlohmann::basic_json<> &value);
   void addWhereEquals(std::string columnName, std::string value)
   {
-    mWhereClauses.push_back(formatStr(columnName) + " = '" + value + "'");
+    mWhereClauses.push_back(formatStr(columnName) + " = " +
+                            bind(std::move(value)));
   }
   void addWhereEquals(std::string columnName, int value)
   {
-    mWhereClauses.push_back(formatStr(columnName) + " = " +
-                            std::to_string(value));
+    mWhereClauses.push_back(formatStr(columnName) + " = " + bind(value));
   }
   void addWhereEquals(std::string columnName, float value)
   {
     mWhereClauses.push_back(formatStr(columnName) + " = " +
-                            std::to_string(value));
+                            bind(static_cast<double>(value)));
   }
 
  protected:
   std::string mTableName;
   std::vector<std::string> mColumnNamesAndValues;
   std::vector<std::string> mWhereClauses;
+  std::vector<std::string> mReturning;
+  std::string mRowVersion;
 };
 
 // functions related to versioning
+//! resolved from the cached version graph, see SvtDbVersionGraph
 int getBaseVersion(int versionId);
 int getMostRecentVersionId();
 
+//! a versioned table holds for each version only the rows that differ from
+//! its base version, a row of a version is the row of the nearest version
+//! of its chain (version, base, base of base, ...) with the same primary key
 class VersionedQuery : public SimpleQuery
 {
  public:
   void addPrimaryKey(std::string primaryKey)
   {
-    mPrimaryKeys.push_back(primaryKey);
+    mPrimaryKeys.push_back(formatStr(primaryKey));
   }
   void setVersionId(int versionId) { mVersionId = versionId; }
-  void doQuery(rows_t &rows);
+  void doQuery(DbResult &result);
 
  protected:
   std::vector<std::string> mPrimaryKeys;
   int mVersionId;
-
-  std::string getPkString()
-  {
-    std::string pkString = "";
-
-    for (auto it = mPrimaryKeys.begin(); it != mPrimaryKeys.end(); ++it)
-    {
-      pkString += "T1." + *it + " = T2." + *it;
-      if (it != mPrimaryKeys.end() - 1)
-      {
-        pkString += " AND ";
-      }
-    }
-
-    return pkString;
-  }
 };
 
 class VersionedInsert : public SimpleInsert
@@ -197,33 +431,73 @@ class VersionedInsert : public SimpleInsert
   void setVersionId(int versionId)
   {
     mVersionId = versionId;
-    SimpleInsert::addColumnAndValue("VERSION_ID", versionId);
+    addColumnAndValue("versionId", versionId);
   }
+  void addPrimaryKey(std::string primaryKey)
+  {
+    mPrimaryKeys.push_back(formatStr(primaryKey));
+  }
+  //! insert the row unless the base version already resolves to the same
+  //! values, a skipped row is not an error
   bool doInsert();
 
-  // addColumnAndValue also needs to add WHERE clauses to the query
-  // if I was better at C++, I'd know how to collapse these into a single
-  // function
+  //! the row is sent as a single json value typed by the table
+  void addColumnAndValue(std::string columnName,
+                         const nlohmann::basic_json<> &value)
+  {
+    if (!mRow.contains(columnName))
+    {
+      mColumnNames.push_back(formatStr(columnName));
+    }
+    mRow[columnName] = value;
+  }
   void addColumnAndValue(std::string columnName, std::string value)
   {
-    // strings have to have '' around the value
-    SimpleInsert::addColumnAndValue(formatStr(columnName), value);
-    mQuery.addWhereEquals(formatStr(columnName), value);
+    addColumnAndValue(columnName, nlohmann::basic_json<>(std::move(value)));
   }
   void addColumnAndValue(std::string columnName, int value)
   {
-    SimpleInsert::addColumnAndValue(formatStr(columnName), value);
-    mQuery.addWhereEquals(formatStr(columnName), value);
+    addColumnAndValue(columnName, nlohmann::basic_json<>(value));
   }
   void addColumnAndValue(std::string columnName, float value)
   {
-    SimpleInsert::addColumnAndValue(formatStr(columnName), value);
-    mQuery.addWhereEquals(formatStr(columnName), value);
+    addColumnAndValue(columnName, nlohmann::basic_json<>(value));
+  }
+
+ protected:
+  int mVersionId;
+  std::vector<std::string> mPrimaryKeys;
+  nlohmann::basic_json<> mRow = nlohmann::basic_json<>::object();
+};
+
+//! whole diff of one version in one statement: the rows are sent as a
+//! single json array typed by the table, rows the base version already
+//! resolves to are skipped
+class VersionedBulkInsert : public ParameterBinder
+{
+ public:
+  void setTableName(std::string tableName)
+  {
+    mTableName = formatStr(tableName);
   }
+  void setVersionId(int versionId) { mVersionId = versionId; }
+  void addPrimaryKey(std::string primaryKey)
+  {
+    mPrimaryKeys.push_back(formatStr(primaryKey));
+  }
+  //! json object column -> value, a column missing in a row is NULL
+  void addRow(const nlohmann::basic_json<> &row);
+  size_t size() const { return mRows.size(); }
+
+  //! returns the number of inserted rows
+  size_t doInsert();
 
  protected:
+  std::string mTableName;
   int mVersionId;
-  SimpleQuery mQuery;
+  std::vector<std::string> mPrimaryKeys;
+  std::vector<std::string> mColumnNames;
+  nlohmann::basic_json<> mRows = nlohmann::basic_json<>::array();
 };
 
 #endif
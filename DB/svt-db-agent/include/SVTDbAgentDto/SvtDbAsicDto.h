@@ -8,6 +8,7 @@
  * @brief Svt Db asic DTO
  * */
 
+#include "SVTDb/SvtDbPartitions.h"
 #include "SvtDbBaseDto.h"
 
 namespace SvtDbAgent
@@ -21,11 +22,14 @@ namespace SvtDbAgent
     SvtDbAsicDto();
     ~SvtDbAsicDto() = default;
 
-    void getAllEntries(const SvtDbAgentMessage &msg,
-                       SvtDbAgentReplyMsg &replyMsg) final;
-    void getAllEntriesReplyMsg(const std::vector<SvtDbEntry> &entries,
-                               SvtDbAgentReplyMsg &msgReply,
-                               int totalCount = -1) final;
+    //! page size of GetAllAsics requests without a pager
+    static constexpr size_t kMaxAsics = 5000;
+
+    //! waferId ranges of the table when it is partitioned
+    SvtDbRangePartitions &getPartitions() { return mPartitions; }
+
+   private:
+    SvtDbRangePartitions mPartitions;
   };
 };  // namespace SvtDbAgent
 #endif  //! SVT_DB_WAFER_TYPE_DTO_H
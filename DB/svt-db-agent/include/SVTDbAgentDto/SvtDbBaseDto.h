@@ -8,16 +8,25 @@
  * @brief Base DTO class
  */
 
+#include "Database/databaseinterface.h"
+
 #include <nlohmann/json.hpp>
 
+#include <limits>
 #include <map>
+#include <mutex>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
+class DbResult;
+class SimpleQuery;
+
 namespace SvtDbAgent
 {
   class SvtDbAgentMessage;
   class SvtDbAgentReplyMsg;
+  class SvtDbStorage;
 
   struct SvtDbEntry
   {
@@ -25,36 +34,121 @@ namespace SvtDbAgent
     SvtDbEntry() = default;
   };
 
+  //! server side paging, afterId >= 0 selects keyset paging on id
+  struct SvtDbPager
+  {
+    bool enabled = false;
+    size_t limit = std::numeric_limits<size_t>::max();
+    size_t offset = 0;
+    long long afterId = -1;
+  };
+
   struct SvtDbFilters
   {
     std::vector<int> ids;
     SvtDbEntry mFilters;
+    SvtDbPager pager;
+    //! columns and descending flags, id is always the last order
+    std::vector<std::pair<std::string, bool>> orderBy;
+  };
+
+  //! to-one relation, the related table is joined on fromColumn = toColumn
+  struct SvtDbRelation
+  {
+    std::string tableName;
+    std::string fromColumn;
+    std::string toColumn;
+  };
+
+  //! columns and relations of the table of a DTO
+  struct SvtDbTableInfo
+  {
+    std::string name;
+    std::vector<std::string> colNames;
+    std::map<std::string, SvtDbRelation> relations;
+  };
+
+  //! outcome of an update of a row
+  enum class SvtDbUpdateStatus
+  {
+    Updated,
+    //! no row with the id
+    NotFound,
+    //! the row was written since the client read its version
+    Conflict
+  };
+
+  //! replied with the NotFound status
+  class SvtDbNotFoundError : public std::runtime_error
+  {
+   public:
+    using std::runtime_error::runtime_error;
+  };
+
+  //! replied with the Conflict status
+  class SvtDbConflictError : public std::runtime_error
+  {
+   public:
+    using std::runtime_error::runtime_error;
   };
 
   class SvtDbBaseDto
   {
    public:
-    SvtDbBaseDto() = default;
+    SvtDbBaseDto();
     virtual ~SvtDbBaseDto() { clear(); }
 
-    virtual bool getAllEntriesFromDB(std::vector<SvtDbEntry> &entries,
-                                     const SvtDbFilters &filters);
+    //! the reads go to a replica unless route is DbRoute::Primary
+    virtual bool getAllEntriesFromDB(DbResult &result,
+                                     const SvtDbFilters &filters,
+                                     DbRoute route = DbRoute::Replica);
+    bool getAllEntriesFromDB(std::vector<SvtDbEntry> &entries,
+                             const SvtDbFilters &filters,
+                             DbRoute route = DbRoute::Replica);
     virtual bool getEntryWithId(SvtDbEntry &entry, int id);
 
     virtual bool createEntryInDB(const SvtDbEntry &entry);
-
-    virtual bool updateEntryInDB(const int id, const SvtDbEntry &entry);
-
+    //! insert entry and fill created with the inserted row
+    bool createEntryInDB(const SvtDbEntry &entry, SvtDbEntry &created);
+    //! insert all entries with a single COPY, every entry must provide
+    //! the same columns
+    bool createEntriesInDB(const std::vector<SvtDbEntry> &entries);
+
+    //! update the row and read it back with its "version" in a single
+    //! statement, only the row with the given version if not empty
+    SvtDbUpdateStatus updateEntryInDB(const int id, const SvtDbEntry &entry,
+                                      const std::string &version,
+                                      SvtDbEntry &updated);
+
+    //! identical requests running at the same time share one read, see
+    //! SvtDbSingleFlight
     virtual void getAllEntries(const SvtDbAgentMessage &msg,
                                SvtDbAgentReplyMsg &replyMsg);
 
-    virtual void getAllEntriesReplyMsg(const std::vector<SvtDbEntry> &entries,
-                                       SvtDbAgentReplyMsg &msgReply,
-                                       int totalCount = -1);
+    //! serialize rows [first, first + count) of a result of buildQuery
+    virtual void getAllEntriesReplyMsg(
+        const DbResult &result, SvtDbAgentReplyMsg &msgReply, size_t first = 0,
+        size_t count = std::numeric_limits<size_t>::max(), int totalCount = -1);
+
+    //! stream the filtered page from the DB and serialize it as a json
+    //! array into items, returns the total number of filtered rows
+    size_t streamAllEntries(const SvtDbFilters &filters, std::string &items);
+    //! let the server build the json array of the filtered page into
+    //! items, returns false if the table cannot be queried as json
+    bool jsonAllEntries(const SvtDbFilters &filters, std::string &items,
+                        size_t &totalCount);
+    //! number of rows matching the filters, the pager is ignored
+    size_t countAllEntries(const SvtDbFilters &filters);
+    void getAllEntriesRawReplyMsg(std::string &&items,
+                                  SvtDbAgentReplyMsg &msgReply,
+                                  int totalCount = -1);
 
     virtual void parseData(const nlohmann::json &entry_j, SvtDbEntry &entry);
     virtual void parseFilter(const nlohmann::json &msgData,
                              SvtDbFilters &filters);
+    //! "pager": {"limit", "offset", "afterId", "orderBy"}, all optional,
+    //! orderBy is a column or a list of {"column", "desc"}
+    void parsePager(const nlohmann::json &msgData, SvtDbFilters &filters);
 
     virtual void createEntry(const SvtDbAgentMessage &msg,
                              SvtDbAgentReplyMsg &replyMsg);
@@ -65,19 +159,90 @@ namespace SvtDbAgent
     virtual void createEntryReplyMsg(const SvtDbEntry &entry,
                                      SvtDbAgentReplyMsg &msgReply);
 
-    void clear() { std::vector<std::string>().swap(mColNames); }
-
-    const std::vector<std::string> &getColNames() { return mColNames; }
-
-    void addColName(const std::string &name) { mColNames.push_back(name); }
-
-    void setTableName(const std::string &tName) { mTableName = tName; }
-    const std::string &getTableName() { return mTableName; }
+    void clear() { std::vector<std::string>().swap(mTable.colNames); }
+
+    const std::vector<std::string> &getColNames() { return mTable.colNames; }
+
+    void addColName(const std::string &name)
+    {
+      mTable.colNames.push_back(name);
+    }
+
+    void setTableName(const std::string &tName);
+
+    //! filters and orders may use "name.column" of a related table, the
+    //! table is joined in the same statement. fromColumn may itself be
+    //! "relation.column" of another relation
+    void addRelation(const std::string &name, const std::string &tableName,
+                     const std::string &fromColumn,
+                     const std::string &toColumn = "id")
+    {
+      mTable.relations[name] = {tableName, fromColumn, toColumn};
+    }
+    //! column the table is partitioned on. Filters on a relation joined on
+    //! it also select the keys of the matching related rows, so that the
+    //! partitions without them are skipped
+    void setPartitionKey(const std::string &column) { mPartitionKey = column; }
+    const std::string &getTableName() { return mTable.name; }
+    const SvtDbTableInfo &getTableInfo() const { return mTable; }
+
+    //! GetAll requests without transaction are served from the memory
+    //! cache, loaded from the primary at the first read after a committed
+    //! write or once the ttl of the cache is over. Filters and orders on
+    //! relations are not served from the cache
+    void setCached(bool cached) { mCached = cached; }
+    bool getCached() const { return mCached; }
+
+    //! GetAll requests are streamed in batches of this size, 0 loads the
+    //! whole result at once
+    void setStreamBatchSize(size_t size) { mStreamBatchSize = size; }
+    size_t getStreamBatchSize() const { return mStreamBatchSize; }
+
+    static constexpr size_t kStreamBatchSize = 1000;
+
+    //! GetAll requests are answered with the json built by the server,
+    //! spliced into the reply without being decoded
+    void setServerJson(bool enable) { mServerJson = enable; }
+    bool getServerJson() const { return mServerJson; }
+
+    //! page size of GetAll requests without a pager, 0 returns all rows
+    void setDefaultPageSize(size_t size) { mDefaultPageSize = size; }
+    size_t getDefaultPageSize() const { return mDefaultPageSize; }
+
+   protected:
+    //! the rows read by buildQuery hold the table columns then the
+    //! "version" of the row, and the total count when paged
+    size_t getReadColumns() const { return mTable.colNames.size() + 1; }
+    nlohmann::ordered_json rowToJson(const DbResult &result, size_t row);
+    //! read the filtered page and build the reply
+    void readAllEntries(const SvtDbFilters &filters,
+                        SvtDbAgentReplyMsg &replyMsg);
+    //! same key for the requests selecting the same page of the table
+    std::string readKey(const SvtDbFilters &filters) const;
+    bool buildQuery(SimpleQuery &query, const SvtDbFilters &filters);
+    //! column of the table or "relation.column", collects the relations
+    //! it needs in joins
+    bool checkColumn(const std::string &column,
+                     std::vector<std::string> &joins) const;
+    //! find the columns that are sent as json strings
+    bool loadJsonColumns();
+    //! cache holding the table, nullptr if the read goes to the DB
+    SvtDbStorage *getCache(const SvtDbFilters &filters);
+    //! the rows of the table changed, the cache is dropped once the
+    //! transaction of the calling thread is committed
+    void invalidateCache();
 
    private:
-    std::vector<std::string> mColNames;
-
-    std::string mTableName;
+    SvtDbTableInfo mTable;
+    std::string mPartitionKey;
+    bool mCached = false;
+    size_t mStreamBatchSize = 0;
+    size_t mDefaultPageSize = 0;
+
+    bool mServerJson;
+    std::mutex mJsonMutex;
+    bool mJsonColumnsLoaded = false;
+    std::vector<bool> mJsonAsText;
   };
 };  // namespace SvtDbAgent
 #endif  //! SVT_DB_BASE_DTO_H
@@ -0,0 +1,149 @@
+#ifndef SVT_DB_EDGE_STORAGE_H
+#define SVT_DB_EDGE_STORAGE_H
+
+/*!
+ * @file SvtDbEdgeStorage.h
+ * @date Oct-2026
+ * @brief Store-and-forward storage of the remote sites
+ */
+
+#include "SVTDbAgentDto/SvtDbMemoryStorage.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace SvtDbAgent
+{
+  //! storage of a site far from the DB, no request waits on the WAN.
+  //! The requests are served by a replica of the tables held in memory,
+  //! the writes of a transaction are applied to the replica and journaled
+  //! to a local file before the reply. The journal is forwarded to the DB
+  //! in the background, in order, one DB transaction per journaled one.
+  //! Rows created locally get negative provisional ids, replaced by the ids
+  //! of the DB when forwarded. A transaction rejected by the DB, or updating
+  //! a column changed in the DB since it was read, is a conflict: it is
+  //! skipped and appended to the .conflicts file next to the journal.
+  //! Each forwarded transaction is recorded by site and sequence number in
+  //! the EdgeForwarded table of the DB, in the same DB transaction, so that
+  //! a transaction forwarded again after a crash is skipped.
+  //! The replica is loaded again from the DB periodically and saved to the
+  //! .snapshot file, read back with the journal when the DB is unreachable
+  //! at start
+  class SvtDbEdgeStorage : public SvtDbStorage
+  {
+   public:
+    ~SvtDbEdgeStorage() override;
+
+    std::string getName() const override { return "edge"; }
+
+    //! name of the site in the EdgeForwarded table, unique per journal
+    void setSite(const std::string &site) { mSite = site; }
+
+    //! schema of the replica and journal file, the replica is restored from
+    //! the snapshot and the journal
+    bool open(const std::string &schemaFile, const std::string &journalFile,
+              std::string &message);
+    //! load the tables from the DB and start forwarding, the replica is
+    //! loaded again every refreshPeriod
+    void start(const std::vector<std::string> &tables,
+               std::chrono::milliseconds forwardPeriod,
+               std::chrono::seconds refreshPeriod);
+    void stop();
+
+    //! forward the pending transactions, false if the DB is unreachable
+    bool forward();
+    //! load the tables from the DB, the pending transactions are applied
+    //! again on top of them
+    bool refresh();
+
+    std::unique_ptr<Transaction> begin() override;
+
+    bool select(const SvtDbTableInfo &table, const SvtDbFilters &filters,
+                std::vector<SvtDbEntry> &entries,
+                size_t &totalCount) override;
+    size_t selectJson(const SvtDbTableInfo &table,
+                      const SvtDbFilters &filters,
+                      std::string &items) override;
+
+    bool insert(const SvtDbTableInfo &table, const SvtDbEntry &entry,
+                SvtDbEntry &created) override;
+    bool insertAll(const SvtDbTableInfo &table,
+                   const std::vector<SvtDbEntry> &entries) override;
+    bool update(const SvtDbTableInfo &table, int id,
+                const SvtDbEntry &entry) override;
+    bool exists(const SvtDbTableInfo &table, int id) override;
+
+    bool getEnumTypes(
+        std::map<std::string, std::vector<std::string>> &enums) override;
+
+    nlohmann::ordered_json getStats() override;
+
+   private:
+    class EdgeTransaction;
+
+    //! id of the DB of a forwarded row, id itself if not forwarded
+    long long resolveId(const std::string &tableName, long long id,
+                        const nlohmann::json &ids, bool forwarding);
+    //! replace the provisional ids of the columns of a row, false if a row
+    //! is not forwarded yet
+    bool resolveRow(const std::string &tableName, nlohmann::json &row,
+                    const nlohmann::json &ids, bool forwarding);
+    //! filters with the provisional ids of forwarded rows replaced
+    SvtDbFilters resolveFilters(const SvtDbTableInfo &table,
+                                const SvtDbFilters &filters);
+    //! append a transaction to the journal and flush it to disk
+    void journal(std::vector<nlohmann::json> &&writes);
+    //! apply a journaled transaction to the replica
+    void apply(const nlohmann::json &transaction);
+    //! false with the reason of the conflict
+    bool forwardTransaction(const nlohmann::json &transaction,
+                            std::string &conflict);
+    void recordConflict(const nlohmann::json &transaction,
+                        const std::string &reason);
+    void savePosition();
+    void setLastError(const std::string &error);
+    void run();
+
+    SvtDbMemoryStorage mReplica;
+
+    //! held by the transactions, then mJournalMutex, no request reads or
+    //! writes the replica while it is loaded
+    std::recursive_mutex mMutex;
+    std::vector<nlohmann::json> mWrites;
+    size_t mDepth = 0;
+
+    std::mutex mJournalMutex;
+    std::string mJournalFile;
+    std::string mSite;
+    int mJournalFd = -1;
+    std::deque<nlohmann::json> mPending;
+    long long mSeq = 0;
+    long long mForwardedSeq = 0;
+    std::string mLastError;
+    //! ids of the DB of the forwarded rows by table and provisional id,
+    //! kept for the life of the site
+    nlohmann::json mIds = nlohmann::json::object();
+
+    //! one forwarder at a time
+    std::mutex mForwardMutex;
+    std::vector<std::string> mTables;
+    std::chrono::milliseconds mForwardPeriod{1000};
+    std::chrono::seconds mRefreshPeriod{300};
+
+    std::thread mThread;
+    std::mutex mRunMutex;
+    std::condition_variable mWake;
+    bool mRunning = false;
+    bool mWoken = false;
+
+    std::atomic<long long> mForwarded{0};
+    std::atomic<long long> mConflicts{0};
+  };
+};  // namespace SvtDbAgent
+#endif  //! SVT_DB_EDGE_STORAGE_H
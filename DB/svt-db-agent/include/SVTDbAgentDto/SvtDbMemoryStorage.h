@@ -0,0 +1,144 @@
+#ifndef SVT_DB_MEMORY_STORAGE_H
+#define SVT_DB_MEMORY_STORAGE_H
+
+/*!
+ * @file SvtDbMemoryStorage.h
+ * @date Oct-2026
+ * @brief In-memory storage of the DTO tables
+ */
+
+#include "SVTDbAgentDto/SvtDbStorage.h"
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace SvtDbAgent
+{
+  //! tables held in memory, for benchmarks of the request pipeline without
+  //! a DB and as cache of the GetAll reads. The tables created from a schema
+  //! file check the NOT NULL, UNIQUE, enum and foreign key constraints and
+  //! assign the identity ids, tables loaded as cache accept any row.
+  //! Filters follow the SQL semantics of SqlCondition, text is ordered by
+  //! byte and enums by name. Transactions are serialized
+  class SvtDbMemoryStorage : public SvtDbStorage
+  {
+   public:
+    std::string getName() const override { return "memory"; }
+
+    //! tables and enum types of the CREATE TYPE ... AS ENUM, CREATE TABLE
+    //! and ALTER TABLE ... ADD FOREIGN KEY statements of a schema file
+    bool loadSchema(const std::string &fileName, std::string &message);
+
+    //! replace the rows of a table
+    void load(const std::string &tableName, std::vector<SvtDbEntry> &&rows);
+    //! replace the rows read after getGeneration returned generation, false
+    //! if the table was invalidated since, the rows may miss that write
+    bool load(const std::string &tableName, std::vector<SvtDbEntry> &&rows,
+              unsigned long long generation);
+    unsigned long long getGeneration(const std::string &tableName);
+    //! rows loaded less than the ttl ago
+    bool isLoaded(const std::string &tableName);
+    void invalidate(const std::string &tableName);
+    //! age after which the loaded rows expire, 0 never expires
+    void setTtl(std::chrono::seconds ttl) { mTtl = ttl; }
+
+    //! identities of the new rows count down from -1, so that they never
+    //! collide with the ids assigned by the DB
+    void setProvisionalIds(bool enable) { mProvisionalIds = enable; }
+    //! columns of a table referring to the id of another table
+    std::map<std::string, std::string> getReferences(
+        const std::string &tableName);
+
+    std::unique_ptr<Transaction> begin() override;
+
+    bool select(const SvtDbTableInfo &table, const SvtDbFilters &filters,
+                std::vector<SvtDbEntry> &entries,
+                size_t &totalCount) override;
+    size_t selectJson(const SvtDbTableInfo &table,
+                      const SvtDbFilters &filters,
+                      std::string &items) override;
+
+    bool insert(const SvtDbTableInfo &table, const SvtDbEntry &entry,
+                SvtDbEntry &created) override;
+    bool insertAll(const SvtDbTableInfo &table,
+                   const std::vector<SvtDbEntry> &entries) override;
+    bool update(const SvtDbTableInfo &table, int id,
+                const SvtDbEntry &entry) override;
+    bool exists(const SvtDbTableInfo &table, int id) override;
+
+    bool getEnumTypes(
+        std::map<std::string, std::vector<std::string>> &enums) override;
+
+   private:
+    class MemoryTransaction;
+
+    struct Column
+    {
+      std::string name;
+      std::string type;
+      std::string enumType;
+      //! table whose id the column refers to
+      std::string references;
+      bool identity = false;
+      bool notNull = false;
+      bool unique = false;
+      bool defaultNow = false;
+    };
+
+    struct Table
+    {
+      std::vector<Column> columns;
+      std::vector<SvtDbEntry> rows;
+      std::unordered_map<long long, size_t> ids;
+      //! serialized values of the unique columns
+      std::map<std::string, std::set<std::string>> uniques;
+      long long nextId = 1;
+      long long nextProvisionalId = -1;
+      bool loaded = false;
+      std::chrono::steady_clock::time_point loadTime;
+      //! count of the invalidations
+      unsigned long long generation = 0;
+    };
+
+    //! write to undo on rollback, previous is empty for an insert
+    struct Undo
+    {
+      std::string tableName;
+      size_t row;
+      std::optional<SvtDbEntry> previous;
+    };
+
+    Table &getTable(const std::string &tableName);
+    //! value of "column" or "relation.column" of row, nullptr for NULL
+    const nlohmann::basic_json<> *lookup(const SvtDbTableInfo &table,
+                                         const SvtDbEntry &row,
+                                         const std::string &column);
+    //! rows of the filtered page in order, throws on wrong filters
+    std::vector<const SvtDbEntry *> query(const SvtDbTableInfo &table,
+                                          const SvtDbFilters &filters,
+                                          size_t &totalCount);
+    //! complete a new row with its defaults and check the constraints
+    bool checkRow(Table &table, SvtDbEntry &row, std::string &message);
+    bool checkValue(const Column &column, nlohmann::basic_json<> &value,
+                    std::string &message);
+    void append(const std::string &tableName, Table &table, SvtDbEntry &&row);
+    void removeLast(Table &table);
+    void setUniques(Table &table, const SvtDbEntry &row, bool add);
+    void rollback(size_t mark);
+
+    std::recursive_mutex mMutex;
+    std::map<std::string, Table> mTables;
+    std::map<std::string, std::vector<std::string>> mEnums;
+    std::vector<Undo> mUndo;
+    size_t mDepth = 0;
+    bool mProvisionalIds = false;
+    std::chrono::seconds mTtl{60};
+  };
+};  // namespace SvtDbAgent
+#endif  //! SVT_DB_MEMORY_STORAGE_H
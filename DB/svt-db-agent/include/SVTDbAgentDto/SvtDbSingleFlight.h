@@ -0,0 +1,58 @@
+#ifndef SVT_DB_SINGLE_FLIGHT_H
+#define SVT_DB_SINGLE_FLIGHT_H
+
+/*!
+ * @file SvtDbSingleFlight.h
+ * @date Oct-2026
+ * @brief Coalescing of identical concurrent reads
+ */
+
+#include <nlohmann/json.hpp>
+
+#include <atomic>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace SvtDbAgent
+{
+  //! identical reads running at the same time are executed once. The first
+  //! caller of a key runs the read, the callers arriving while it runs wait
+  //! for it and share its reply bytes, or its exception. Nothing is kept
+  //! once the read is over. A read started before the last committed write
+  //! is not joined, the callers still see the writes acknowledged to them
+  class SvtDbSingleFlight
+  {
+   public:
+    using Reply = std::shared_ptr<const std::string>;
+
+    SvtDbSingleFlight();
+
+    //! run read, or wait for the read of key in flight. A waiter gives up
+    //! with DbTimeoutError at the deadline of its own request
+    Reply run(const std::string &key,
+              const std::function<std::string()> &read);
+
+    //! a write was committed, the reads in flight are not joined anymore
+    void noteWrite() { ++mGeneration; }
+
+    void setEnabled(bool enable) { mEnabled = enable; }
+    bool isEnabled() const { return mEnabled; }
+
+    nlohmann::ordered_json getStats();
+    void resetStats();
+
+   private:
+    std::mutex mMutex;
+    std::map<std::string, std::shared_future<Reply>> mFlights;
+    std::atomic<unsigned long long> mGeneration{0};
+    std::atomic<bool> mEnabled{true};
+
+    std::atomic<long long> mExecuted{0};
+    std::atomic<long long> mCoalesced{0};
+  };
+};  // namespace SvtDbAgent
+#endif  //! SVT_DB_SINGLE_FLIGHT_H
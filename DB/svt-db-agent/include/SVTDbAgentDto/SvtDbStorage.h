@@ -0,0 +1,100 @@
+#ifndef SVT_DB_STORAGE_H
+#define SVT_DB_STORAGE_H
+
+/*!
+ * @file SvtDbStorage.h
+ * @date Oct-2026
+ * @brief Storage backend of the DTOs
+ */
+
+#include "SVTDbAgentDto/SvtDbBaseDto.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class DbTransaction;
+
+namespace SvtDbAgent
+{
+  //! rows of the DTO tables. Postgres is the built-in path of the DTOs, a
+  //! storage installed with install() replaces it for the CRUD of every DTO
+  //! and for the enum types, the raw SQL paths (versions, configurations,
+  //! partitions) stay Postgres only
+  class SvtDbStorage
+  {
+   public:
+    //! writes done while it is alive are undone unless committed
+    class Transaction
+    {
+     public:
+      virtual ~Transaction() = default;
+      virtual void commit() = 0;
+    };
+
+    virtual ~SvtDbStorage() = default;
+
+    virtual std::string getName() const = 0;
+
+    virtual std::unique_ptr<Transaction> begin() = 0;
+
+    //! rows of the filtered page in the columns of the table and their
+    //! "version", totalCount is the number of rows matching the filters
+    //! without the pager
+    virtual bool select(const SvtDbTableInfo &table,
+                        const SvtDbFilters &filters,
+                        std::vector<SvtDbEntry> &entries,
+                        size_t &totalCount) = 0;
+    //! the filtered page as a json array, returns the total count
+    virtual size_t selectJson(const SvtDbTableInfo &table,
+                              const SvtDbFilters &filters,
+                              std::string &items) = 0;
+
+    //! insert entry and fill created with the inserted row
+    virtual bool insert(const SvtDbTableInfo &table, const SvtDbEntry &entry,
+                        SvtDbEntry &created) = 0;
+    //! all entries or none
+    virtual bool insertAll(const SvtDbTableInfo &table,
+                           const std::vector<SvtDbEntry> &entries) = 0;
+    //! null values are left unchanged
+    virtual bool update(const SvtDbTableInfo &table, int id,
+                        const SvtDbEntry &entry) = 0;
+    virtual bool exists(const SvtDbTableInfo &table, int id) = 0;
+
+    //! enum type names and their values
+    virtual bool getEnumTypes(
+        std::map<std::string, std::vector<std::string>> &enums) = 0;
+
+    //! counters reported with the DB statistics, null if none
+    virtual nlohmann::ordered_json getStats() { return nullptr; }
+
+    //! version token of a row without the one of the DB, a hash of its
+    //! values
+    static std::string rowVersion(const SvtDbEntry &row);
+
+    //! storage replacing Postgres, nullptr if none
+    static SvtDbStorage *get();
+    static void install(std::unique_ptr<SvtDbStorage> storage);
+  };
+
+  //! unit of work of a request: a DbTransaction on Postgres, a transaction
+  //! of the installed storage otherwise
+  class SvtDbStorageTransaction
+  {
+   public:
+    SvtDbStorageTransaction();
+    ~SvtDbStorageTransaction();
+
+    SvtDbStorageTransaction(const SvtDbStorageTransaction &) = delete;
+    SvtDbStorageTransaction &operator=(const SvtDbStorageTransaction &) =
+        delete;
+
+    void commit();
+
+   private:
+    std::unique_ptr<DbTransaction> mDbTransaction;
+    std::unique_ptr<SvtDbStorage::Transaction> mTransaction;
+  };
+};  // namespace SvtDbAgent
+#endif  //! SVT_DB_STORAGE_H
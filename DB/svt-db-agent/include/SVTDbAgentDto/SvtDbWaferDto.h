@@ -26,6 +26,11 @@ namespace SvtDbAgent
 
     void createEntry(const SvtDbAgent::SvtDbAgentMessage &msg,
                      SvtDbAgent::SvtDbAgentReplyMsg &replyMsg) final;
+
+    //! expand the wafer map into the asic entries of wafer
+    void expandAsics(const SvtDbAgent::SvtDbEntry &wafer,
+                     const nlohmann::json &waferMap_j,
+                     std::vector<SvtDbAgent::SvtDbEntry> &asics);
   };
 
   class SvtDbWaferLocationDto : public SvtDbBaseDto
@@ -13,16 +13,23 @@ namespace SvtDbAgent
     Success = 0,
     // message data has invalid format
     BadRequest,
-    // // requested entity does not exist
-    // NotFound,
     // is not able to process the request, some unexpected error
     UnexpectedError,
+    // the database is down, the request was rejected without trying it
+    ServiceUnavailable,
+    // the request ran past its deadline, its statements were cancelled
+    Timeout,
+    // requested entity does not exist
+    EntityNotFound,
+    // the entity was changed since the version sent by the client
+    Conflict,
     // Num of message status
     NumStatus
   };
 
   const std::array<std::string_view, SvtDbAgentMsgStatus::NumStatus> msgStatus = {
-      {"Success", "BadRequest", /*"NotFound",*/ "UnexpectedError"}};
+      {"Success", "BadRequest", "UnexpectedError", "ServiceUnavailable",
+       "Timeout", "NotFound", "Conflict"}};
 
   class SvtDbAgentMessage
   {
@@ -36,6 +43,9 @@ namespace SvtDbAgent
     }
     virtual void setPayload(const nlohmann::json &json) { payload = json; }
 
+    //! wire format of the payload
+    virtual std::string serializePayload() const { return payload.dump(); }
+
    protected:
     nlohmann::json headers = {};
     nlohmann::json payload = {};
@@ -46,7 +56,23 @@ namespace SvtDbAgent
    public:
     void setType(const std::string &_type) { type = _type; }
     void setStatus(const std::string_view &_status) { status = _status; }
-    void setData(const nlohmann::ordered_json &val) { data = val; }
+    void setData(const nlohmann::ordered_json &val)
+    {
+      data = val;
+      rawData.clear();
+    }
+    //! already serialized json for the data field, it is spliced into the
+    //! payload as is, without being parsed again
+    void setRawData(std::string &&val)
+    {
+      rawData = std::move(val);
+      data = nullptr;
+    }
+    //! wire format of the data field
+    std::string serializeData() const
+    {
+      return rawData.empty() ? data.dump() : rawData;
+    }
     void setError(const int _code, const std::string &_msg)
     {
       error_code = _code;
@@ -57,17 +83,40 @@ namespace SvtDbAgent
     {
       payload["type"] = type;
       payload["status"] = status;
-      payload["data"] = data;
+      if (rawData.empty())
+      {
+        payload["data"] = data;
+      }
+      else
+      {
+        payload.erase("data");
+      }
       payload["error"]["code"] = error_code;
       payload["error"]["message"] = error_msg;
     }
 
+    std::string serializePayload() const override
+    {
+      if (rawData.empty())
+      {
+        return payload.dump();
+      }
+      //! payload holds at least type and status, so it is never "{}"
+      const std::string fields = payload.dump();
+      std::string serialized;
+      serialized.reserve(fields.size() + rawData.size() + 8);
+      serialized.append("{\"data\":").append(rawData).append(",");
+      serialized.append(fields, 1, std::string::npos);
+      return serialized;
+    }
+
    private:
     //! reply message data field
     std::string type;
     std::string_view status =
         SvtDbAgent::msgStatus[SvtDbAgent::SvtDbAgentMsgStatus::Success];
     nlohmann::ordered_json data;
+    std::string rawData;
     int error_code = 0;
     std::string error_msg = "";
   };
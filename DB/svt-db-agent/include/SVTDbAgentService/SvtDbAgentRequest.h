@@ -33,6 +33,8 @@ namespace SvtDbAgent
     //! Probe Cards
     GetAllProbeCards,
     CreateProbeCard,
+    //! Agent
+    GetDbStats,
     NotFound,
   };
 
@@ -62,12 +64,17 @@ namespace SvtDbAgent
       //! Probe Cards
       {GetAllProbeCards, "GetAllProbeCards"},
       {GetAllProbeCards, "CreateProbeCard"},
+      //! Agent
+      {GetDbStats, "GetDbStats"},
       //! Others
       {NotFound, "NotFound"},
   };
 
   RequestType getRequestType(std::string_view type_req);
 
+  //! requests modifying the DB, each one runs in a single transaction
+  bool isWriteRequest(RequestType type_req);
+
 };  // namespace SvtDbAgent
 
 #endif  //! SVT_DB_AGENT_REQUEST_H
@@ -12,14 +12,22 @@
 #include "SVTUtilities/SvtUtilities.h"
 #include "SvtDbAgentMessage.h"
 #include "SvtDbAgentProducer.h"
+#include "SvtDbAgentRequest.h"
 
 #include <cmath>
 #include <librdkafka/rdkafkacpp.h>
 #include <nlohmann/json.hpp>
 
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string_view>
+#include <thread>
+#include <vector>
 
 namespace SvtDbInterface {
 struct dbWaferRecords;
@@ -59,11 +67,46 @@ public:
 
   std::string &getBrokerName() { return m_brokerName; }
 
+  //! deadline of the requests, 0 disables it. The svt_timeoutMs header of
+  //! a request may only shorten it
+  void setRequestTimeout(std::chrono::milliseconds timeout) {
+    m_requestTimeout = timeout;
+  }
+  //! per request type deadlines from a "Type=ms,Type=ms" list, returns
+  //! false on a malformed or negative entry or an unknown type
+  bool setRequestTimeouts(const std::string &timeouts);
+
+  //! requests are handled concurrently by this many threads, sized to the
+  //! DB connection pool, 0 handles them on the consumer thread. Call
+  //! before configureService()
+  void setWorkerCount(size_t workers) { m_workerCount = workers; }
+
 private:
+  //! request read by the consumer, waiting for a worker
+  struct PendingRequest {
+    SvtDbAgent::SvtDbAgentReplyMsg msg;
+    SvtDbAgent::SvtDbAgentMsgStatus status;
+  };
+
+  void startWorkers();
+  void stopWorkers();
+  void runWorker();
+  //! hand the request to a worker, blocks while all of them are busy and
+  //! the queue is full
+  void dispatch(SvtDbAgent::SvtDbAgentReplyMsg &&msg,
+                SvtDbAgent::SvtDbAgentMsgStatus status);
+
   SvtLogger &logger = SvtDbAgent::Singleton<SvtLogger>::instance();
 
   void parseMsg(const SvtDbAgent::SvtDbAgentMessage &msg,
                 const SvtDbAgent::SvtDbAgentMsgStatus &status);
+  //! pool and per statement latency statistics of the DB
+  void getDbStats(const SvtDbAgent::SvtDbAgentMessage &msg,
+                  SvtDbAgent::SvtDbAgentReplyMsg &replyMsg);
+  //! header deadline of the request, or the default of its type
+  std::chrono::milliseconds
+  getRequestTimeout(const SvtDbAgent::SvtDbAgentMessage &msg,
+                    SvtDbAgent::RequestType reqType) const;
 
   std::shared_ptr<SvtDbAgentConsumer> m_Consumer;
   std::shared_ptr<SvtDbAgentProducer> m_Producer;
@@ -74,6 +117,20 @@ private:
   std::string m_debug;
 
   bool log_messages = false;
+
+  std::chrono::milliseconds m_requestTimeout{0};
+  std::map<SvtDbAgent::RequestType, std::chrono::milliseconds>
+      m_requestTimeouts;
+
+  size_t m_workerCount = 0;
+  std::vector<std::thread> m_workers;
+  std::deque<PendingRequest> m_requests;
+  std::mutex m_requestMutex;
+  //! a request was queued, or the workers are stopping
+  std::condition_variable m_requestQueued;
+  //! a worker took a request off the queue
+  std::condition_variable m_requestTaken;
+  bool m_stopWorkers = false;
 };
 
 #endif // !SVTDB_AGENT_H
@@ -11,6 +11,7 @@
 #include <nlohmann/json.hpp>
 
 #include <cstdlib>
+#include <limits>
 #include <string>
 
 namespace SvtDbAgent {
@@ -25,6 +26,143 @@ static std::string kafka_server = (getenv("SVT_KAFKA_SERVER") != nullptr)
                                       : "localhost";
 static std::string kafka_port =
     (getenv("SVT_KAFKA_PORT") != nullptr) ? getenv("SVT_KAFKA_PORT") : "9092";
+static std::string db_pool_size = (getenv("SVT_DB_AGENT_POOL_SIZE") != nullptr)
+                                     ? getenv("SVT_DB_AGENT_POOL_SIZE")
+                                     : "4";
+static std::string db_stmt_cache_size =
+    (getenv("SVT_DB_AGENT_STMT_CACHE_SIZE") != nullptr)
+        ? getenv("SVT_DB_AGENT_STMT_CACHE_SIZE")
+        : "128";
+//! period in seconds of the DB pool and latency statistics in the log
+static std::string db_stats_period =
+    (getenv("SVT_DB_AGENT_STATS_PERIOD") != nullptr)
+        ? getenv("SVT_DB_AGENT_STATS_PERIOD")
+        : "300";
+//! statements slower than this are written to the slow query log, 0
+//! disables it
+static std::string db_slow_query_ms =
+    (getenv("SVT_DB_AGENT_SLOW_QUERY_MS") != nullptr)
+        ? getenv("SVT_DB_AGENT_SLOW_QUERY_MS")
+        : "500";
+static std::string db_slow_query_log_file =
+    (getenv("SVT_DB_AGENT_SLOW_QUERY_LOG_FILE") != nullptr)
+        ? getenv("SVT_DB_AGENT_SLOW_QUERY_LOG_FILE")
+        : "./Svt_db_agent-slow.log";
+//! capture EXPLAIN (ANALYZE, BUFFERS) of slow statements, at most once per
+//! interval in seconds
+static std::string db_slow_query_explain =
+    (getenv("SVT_DB_AGENT_SLOW_QUERY_EXPLAIN") != nullptr)
+        ? getenv("SVT_DB_AGENT_SLOW_QUERY_EXPLAIN")
+        : "0";
+static std::string db_slow_query_explain_interval =
+    (getenv("SVT_DB_AGENT_SLOW_QUERY_EXPLAIN_INTERVAL") != nullptr)
+        ? getenv("SVT_DB_AGENT_SLOW_QUERY_EXPLAIN_INTERVAL")
+        : "60";
+//! health check period of the idle DB connections in seconds, and number of
+//! consecutive connection failures tripping the circuit breaker
+static std::string db_keepalive =
+    (getenv("SVT_DB_AGENT_KEEPALIVE") != nullptr)
+        ? getenv("SVT_DB_AGENT_KEEPALIVE")
+        : "30";
+static std::string db_breaker_failures =
+    (getenv("SVT_DB_AGENT_BREAKER_FAILURES") != nullptr)
+        ? getenv("SVT_DB_AGENT_BREAKER_FAILURES")
+        : "3";
+//! fetch streamed results in binary format (1) instead of text (0)
+static std::string db_binary_results =
+    (getenv("SVT_DB_AGENT_BINARY_RESULTS") != nullptr)
+        ? getenv("SVT_DB_AGENT_BINARY_RESULTS")
+        : "0";
+//! GetAll replies are built as json by the server (1) or by the agent (0)
+static std::string db_server_json =
+    (getenv("SVT_DB_AGENT_SERVER_JSON") != nullptr)
+        ? getenv("SVT_DB_AGENT_SERVER_JSON")
+        : "0";
+//! identical GetAll reads running at the same time are executed once (1)
+static std::string db_coalesce_reads =
+    (getenv("SVT_DB_AGENT_COALESCE_READS") != nullptr)
+        ? getenv("SVT_DB_AGENT_COALESCE_READS")
+        : "1";
+//! primary endpoint, and comma separated host:port list of read replicas
+//! serving the GetAll reads
+static std::string db_host = (getenv("SVT_DB_AGENT_DB_HOST") != nullptr)
+                                 ? getenv("SVT_DB_AGENT_DB_HOST")
+                                 : "dbod-svt-sw-pgdb.cern.ch";
+static std::string db_port = (getenv("SVT_DB_AGENT_DB_PORT") != nullptr)
+                                 ? getenv("SVT_DB_AGENT_DB_PORT")
+                                 : "6600";
+static std::string db_read_replicas =
+    (getenv("SVT_DB_AGENT_READ_REPLICAS") != nullptr)
+        ? getenv("SVT_DB_AGENT_READ_REPLICAS")
+        : "";
+//! reads go to the primary for this long after a write of the agent
+static std::string db_read_your_writes_ms =
+    (getenv("SVT_DB_AGENT_READ_YOUR_WRITES_MS") != nullptr)
+        ? getenv("SVT_DB_AGENT_READ_YOUR_WRITES_MS")
+        : "1000";
+//! deadline of the requests in ms, 0 disables it, and comma separated
+//! Type=ms list overriding it per request type. A svt_timeoutMs header
+//! of the request takes precedence over both
+static std::string db_request_timeout_ms =
+    (getenv("SVT_DB_AGENT_REQUEST_TIMEOUT_MS") != nullptr)
+        ? getenv("SVT_DB_AGENT_REQUEST_TIMEOUT_MS")
+        : "0";
+static std::string db_request_timeouts =
+    (getenv("SVT_DB_AGENT_REQUEST_TIMEOUTS") != nullptr)
+        ? getenv("SVT_DB_AGENT_REQUEST_TIMEOUTS")
+        : "";
+//! fault injection for testing, e.g. "latency=lognormal:5:1,error=0.01",
+//! see DbFaultInjector::configure, empty disables it
+static std::string db_faults = (getenv("SVT_DB_AGENT_FAULTS") != nullptr)
+                                   ? getenv("SVT_DB_AGENT_FAULTS")
+                                   : "";
+//! number of wafers per partition of a partitioned Asic table
+static std::string db_asic_partition_wafers =
+    (getenv("SVT_DB_AGENT_ASIC_PARTITION_WAFERS") != nullptr)
+        ? getenv("SVT_DB_AGENT_ASIC_PARTITION_WAFERS")
+        : "100";
+//! storage of the DTOs, "postgres", "memory" or "edge". The memory and edge
+//! storages are created from the tables and enum types of db_storage_schema
+static std::string db_storage = (getenv("SVT_DB_AGENT_STORAGE") != nullptr)
+                                    ? getenv("SVT_DB_AGENT_STORAGE")
+                                    : "postgres";
+static std::string db_storage_schema =
+    (getenv("SVT_DB_AGENT_STORAGE_SCHEMA") != nullptr)
+        ? getenv("SVT_DB_AGENT_STORAGE_SCHEMA")
+        : "../sql/SVT_DB_Tables_SourceOfTruth.sql";
+//! comma separated tables whose GetAll reads are served from memory, and
+//! age in seconds after which a cached table is loaded again
+static std::string db_cache_tables =
+    (getenv("SVT_DB_AGENT_CACHE_TABLES") != nullptr)
+        ? getenv("SVT_DB_AGENT_CACHE_TABLES")
+        : "";
+static std::string db_cache_ttl = (getenv("SVT_DB_AGENT_CACHE_TTL") != nullptr)
+                                      ? getenv("SVT_DB_AGENT_CACHE_TTL")
+                                      : "60";
+//! journal of the edge storage, tables of its replica, period in ms of the
+//! forward of the journal and in seconds of the reload of the replica
+static std::string db_edge_journal =
+    (getenv("SVT_DB_AGENT_EDGE_JOURNAL") != nullptr)
+        ? getenv("SVT_DB_AGENT_EDGE_JOURNAL")
+        : "SvtDbAgent.journal";
+static std::string db_edge_tables =
+    (getenv("SVT_DB_AGENT_EDGE_TABLES") != nullptr)
+        ? getenv("SVT_DB_AGENT_EDGE_TABLES")
+        : "WaferType,Wafer,WaferLocation,Asic,ProbeCard,WaferProbeMachine,"
+          "WaferProbeProject";
+static std::string db_edge_forward_ms =
+    (getenv("SVT_DB_AGENT_EDGE_FORWARD_MS") != nullptr)
+        ? getenv("SVT_DB_AGENT_EDGE_FORWARD_MS")
+        : "1000";
+static std::string db_edge_refresh_s =
+    (getenv("SVT_DB_AGENT_EDGE_REFRESH_S") != nullptr)
+        ? getenv("SVT_DB_AGENT_EDGE_REFRESH_S")
+        : "300";
+//! name of the site in the EdgeForwarded table of the DB, the host name
+//! when empty
+static std::string db_edge_site = (getenv("SVT_DB_AGENT_EDGE_SITE") != nullptr)
+                                      ? getenv("SVT_DB_AGENT_EDGE_SITE")
+                                      : "";
 
 template <class T>
 inline void get_v(const nlohmann::json &j, const char *key, T &val) {
@@ -39,6 +177,12 @@ template <typename T> inline void clearVector(std::vector<T> &vec) {
   std::vector<T>().swap(vec);
 }
 
+//! value of the numeric setting name, defaultValue with an error in the log
+//! when value is not an integer in [0, max]
+long long getNumericSetting(
+    const char *name, const std::string &value, long long defaultValue,
+    long long max = std::numeric_limits<long long>::max());
+
 template <typename T> class Singleton {
 public:
   // Public method to get the singleton instance
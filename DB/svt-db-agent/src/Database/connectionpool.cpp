@@ -0,0 +1,274 @@
+#include "Database/connectionpool.h"
+
+#include <algorithm>
+#include <string>
+
+using std::string;
+using std::chrono::steady_clock;
+
+//========================================================================+
+DbConnection::DbConnection(const string &connString, size_t index,
+                           size_t statementCacheSize)
+    : mConnString(connString), mIndex(index), mConnection(nullptr),
+      mStatements(statementCacheSize) {}
+
+DbConnection::~DbConnection() { close(); }
+
+//========================================================================+
+bool DbConnection::connect(string &message) {
+  //! prepared statements live in the server session
+  mStatements.clear();
+  try {
+    mConnection = new pqxx::connection(mConnString);
+  } catch (std::exception const &e) {
+    message = string("Error: ") + e.what();
+    close();
+    return false;
+  }
+  return isOpen();
+}
+
+//========================================================================+
+bool DbConnection::reconnect(string &message) {
+  close();
+  return connect(message);
+}
+
+//========================================================================+
+void DbConnection::close() {
+  if (mConnection) {
+    try {
+      mConnection->close();
+    } catch (std::exception const &e) {
+      SvtDbAgent::Singleton<SvtLogger>::instance().logError(
+          std::string("DbConnection::close: ") + e.what());
+    }
+  }
+  delete mConnection;
+  mConnection = nullptr;
+  mStatements.clear();
+}
+
+//========================================================================+
+bool DbConnection::isOpen() {
+  return (mConnection != nullptr) && mConnection->is_open();
+}
+
+//========================================================================+
+ConnectionPool::~ConnectionPool() { close(); }
+
+//========================================================================+
+bool ConnectionPool::open(const string &connString, size_t size,
+                          size_t statementCacheSize) {
+  close();
+
+  std::lock_guard<std::mutex> lock(mMutex);
+  size = std::max<size_t>(size, 1);
+  for (size_t i = 0; i < size; ++i) {
+    DbConnection *connection =
+        new DbConnection(connString, i, statementCacheSize);
+    string message;
+    if (!connection->connect(message)) {
+      logger.logError("ConnectionPool::open: connection " + std::to_string(i) +
+                      " failed. " + message);
+      delete connection;
+      for (auto *conn : mConnections) {
+        delete conn;
+      }
+      mConnections.clear();
+      return false;
+    }
+    mConnections.push_back(connection);
+  }
+  mIdle = mConnections;
+  mOpen = true;
+  mOpenTime = steady_clock::now();
+  mStats = ConnectionPoolStats();
+  mStats.size = size;
+  mBusy_us = 0;
+
+  logger.logInfo("ConnectionPool::open: " + std::to_string(size) +
+                 " connections opened");
+  return true;
+}
+
+//========================================================================+
+void ConnectionPool::close(std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock(mMutex);
+  if (!mOpen) {
+    return;
+  }
+  mOpen = false;
+  //! wait for checked out connections to come back
+  if (!mAvailable.wait_for(lock, timeout, [this] {
+        return mIdle.size() == mConnections.size();
+      })) {
+    logger.logWarning("ConnectionPool::close: " +
+                      std::to_string(mConnections.size() - mIdle.size()) +
+                      " connections still checked out after " +
+                      std::to_string(timeout.count()) + " ms");
+  }
+  for (auto *conn : mConnections) {
+    if (std::find(mIdle.begin(), mIdle.end(), conn) == mIdle.end()) {
+      mClosing.push_back(conn);
+    } else {
+      delete conn;
+    }
+  }
+  mConnections.clear();
+  mIdle.clear();
+  mAvailable.notify_all();
+}
+
+//========================================================================+
+bool ConnectionPool::isOpen() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mOpen;
+}
+
+//========================================================================+
+DbConnection *ConnectionPool::acquire(std::chrono::milliseconds timeout) {
+  const auto t1 = steady_clock::now();
+  std::unique_lock<std::mutex> lock(mMutex);
+
+  bool waited = false;
+  if (mOpen && mIdle.empty()) {
+    waited = true;
+    mAvailable.wait_for(lock, timeout,
+                        [this] { return !mOpen || !mIdle.empty(); });
+  }
+
+  const auto t2 = steady_clock::now();
+  const uint64_t wait_us =
+      std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
+  if (waited) {
+    ++mStats.waits;
+    mStats.totalWait_us += wait_us;
+    mStats.maxWait_us = std::max(mStats.maxWait_us, wait_us);
+  }
+
+  if (!mOpen || mIdle.empty()) {
+    ++mStats.timeouts;
+    return nullptr;
+  }
+
+  DbConnection *connection = mIdle.back();
+  mIdle.pop_back();
+  connection->mCheckoutTime = t2;
+
+  ++mStats.checkouts;
+  mStats.inUse = mConnections.size() - mIdle.size();
+  mStats.peakInUse = std::max(mStats.peakInUse, mStats.inUse);
+
+  return connection;
+}
+
+//========================================================================+
+DbConnection *ConnectionPool::tryAcquire() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (!mOpen || mIdle.empty()) {
+    return nullptr;
+  }
+  DbConnection *connection = mIdle.back();
+  mIdle.pop_back();
+  connection->mCheckoutTime = steady_clock::now();
+  mStats.inUse = mConnections.size() - mIdle.size();
+  return connection;
+}
+
+//========================================================================+
+void ConnectionPool::release(DbConnection *connection) {
+  if (!connection) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto closing = std::find(mClosing.begin(), mClosing.end(), connection);
+    if (closing != mClosing.end()) {
+      mClosing.erase(closing);
+      delete connection;
+      return;
+    }
+    mBusy_us += std::chrono::duration_cast<std::chrono::microseconds>(
+                    steady_clock::now() - connection->mCheckoutTime)
+                    .count();
+    mIdle.push_back(connection);
+    mStats.inUse = mConnections.size() - mIdle.size();
+  }
+  mAvailable.notify_all();
+}
+
+//========================================================================+
+size_t ConnectionPool::size() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mConnections.size();
+}
+
+//========================================================================+
+ConnectionPoolStats ConnectionPool::getStats() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  ConnectionPoolStats stats = mStats;
+
+  //! account for connections still checked out
+  const auto now = steady_clock::now();
+  uint64_t busy_us = mBusy_us;
+  for (auto *conn : mConnections) {
+    if (std::find(mIdle.begin(), mIdle.end(), conn) == mIdle.end()) {
+      busy_us += std::chrono::duration_cast<std::chrono::microseconds>(
+                     now - conn->mCheckoutTime)
+                     .count();
+    }
+  }
+  const double elapsed_us =
+      std::chrono::duration_cast<std::chrono::microseconds>(now - mOpenTime)
+          .count();
+  if (mOpen && elapsed_us > 0 && !mConnections.empty()) {
+    stats.utilization = busy_us / (elapsed_us * mConnections.size());
+  }
+  return stats;
+}
+
+//========================================================================+
+StatementCacheStats ConnectionPool::getStatementCacheStats() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  StatementCacheStats stats;
+  for (auto *conn : mConnections) {
+    conn->getStatementCache().addStats(stats);
+  }
+  return stats;
+}
+
+//========================================================================+
+PooledConnection::PooledConnection(ConnectionPool &pool,
+                                   std::chrono::milliseconds timeout)
+    : mPool(&pool), mConnection(pool.acquire(timeout)) {}
+
+PooledConnection::PooledConnection(PooledConnection &&other) noexcept
+    : mPool(other.mPool), mConnection(other.mConnection),
+      mReplica(other.mReplica) {
+  other.mPool = nullptr;
+  other.mConnection = nullptr;
+  other.mReplica = nullptr;
+}
+
+PooledConnection &PooledConnection::operator=(PooledConnection &&other) noexcept {
+  if (this != &other) {
+    release();
+    mPool = other.mPool;
+    mConnection = other.mConnection;
+    mReplica = other.mReplica;
+    other.mPool = nullptr;
+    other.mConnection = nullptr;
+    other.mReplica = nullptr;
+  }
+  return *this;
+}
+
+//========================================================================+
+void PooledConnection::release() {
+  if (mPool && mConnection) {
+    mPool->release(mConnection);
+  }
+  mConnection = nullptr;
+  mReplica = nullptr;
+}
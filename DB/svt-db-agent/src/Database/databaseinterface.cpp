@@ -1,28 +1,34 @@
 #include "Database/databaseinterface.h"
 #include "SVTUtilities/SvtLogger.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
+#include <iomanip>
 #include <iostream>
+#include <memory>
+#include <sstream>
+#include <strings.h>
+#include <type_traits>
 
 using std::string;
 using std::vector;
 using SvtDbAgent::Singleton;
 
 //========================================================================+
-DatabaseInterface::DatabaseInterface() { mUnavailable = false; }
+DatabaseInterface::DatabaseInterface()
+    : mPoolSize(1), mStatementCacheSize(128),
+      mCheckoutTimeout(std::chrono::seconds(30)), mHealth(mPool) {}
 
 bool DatabaseInterface::Init(const string &user, const string &password,
                              const string &connString, const string &host,
-                             const string &port) {
+                             const string &port, size_t poolSize) {
   mUser = user;
   mPassword = password;
   mConnString = connString;
   mHost = host;
   mPort = port;
-
-  mDBConnection = nullptr;
-  mDBWork = nullptr;
+  mPoolSize = (poolSize > 0) ? poolSize : 1;
 
   // {
   //   throw runtime_error(
@@ -34,243 +40,594 @@ bool DatabaseInterface::Init(const string &user, const string &password,
 DatabaseInterface::~DatabaseInterface() { this->close(); }
 
 bool DatabaseInterface::close() {
-  if (mDBWork) {
-    delete mDBWork;
-    mDBWork = nullptr;
+  mHealth.stop();
+  for (auto &replica : mReplicas) {
+    replica->pool.close();
   }
-  if (mDBConnection) {
-    try {
-      mDBConnection->close();
-      std::cout << "Disconnected from the database" << std::endl;
-    } catch (pqxx::sql_error const &e) {
-      logger.logError(std::string("SQL error: ") + e.what());
-      logger.logError(std::string("Query was: ") + e.query());
-    }
+  if (mPool.isOpen()) {
+    mPool.close();
+    std::cout << "Disconnected from the database" << std::endl;
   }
-
-  delete mDBConnection;
-  mDBConnection = nullptr;
-
   return true;
 }
 
-bool DatabaseInterface::connect() {
-  try {
-    std::string connstring = "host=" + this->mHost + " port=" + this->mPort +
-                             " dbname=" + this->mConnString +
-                             " user=" + this->mUser +
-                             " password=" + this->mPassword;
+std::string DatabaseInterface::getConnectionString() const {
+  return getConnectionString(this->mHost, this->mPort);
+}
 
-    mDBConnection = new pqxx::connection(connstring);
-    mDBWork = new pqxx::nontransaction(*mDBConnection);
-  } catch (pqxx::sql_error const &e) {
-    logger.logError(std::string("SQL error: ") + e.what());
-    logger.logError(std::string("Query was: ") + e.query());
+std::string DatabaseInterface::getConnectionString(const string &host,
+                                                   const string &port) const {
+  return "host=" + host + " port=" + port + " dbname=" + this->mConnString +
+         " user=" + this->mUser + " password=" + this->mPassword;
+}
 
-    close();
+//========================================================================+
+void DatabaseInterface::addReadReplica(const string &host,
+                                       const string &port) {
+  auto replica = std::make_unique<DbReadReplica>();
+  replica->host = host;
+  replica->port = port;
+  mReplicas.push_back(std::move(replica));
+}
 
-    return false;
-  } catch (std::exception const &e) {
-    Singleton<SvtLogger>::instance().logError(std::string("Error: ") +
-                                              e.what());
+//========================================================================+
+void DatabaseInterface::setSlowQueryExplain(bool enable,
+                                            std::chrono::seconds interval) {
+  mSlowLog.setExplain(enable, getConnectionString(), interval);
+}
 
-    close();
+//========================================================================+
+bool DatabaseInterface::connect() {
+  const std::string connstring = getConnectionString();
 
+  if (!mPool.open(connstring, mPoolSize, mStatementCacheSize)) {
+    logger.logError("DatabaseInterface::connect: cannot open connection pool");
     return false;
   }
+  mHealth.reset();
+  mHealth.start();
+
+  //! a replica that cannot be opened is retried on a later read
+  for (auto &replica : mReplicas) {
+    if (!replica->pool.open(
+            getConnectionString(replica->host, replica->port), mPoolSize,
+            mStatementCacheSize)) {
+      logger.logWarning("DatabaseInterface::connect: cannot open read "
+                        "replica " +
+                        replica->host + ":" + replica->port);
+    }
+  }
 
   return isConnected();
 }
 
-bool DatabaseInterface::reconnect() {
-  std::string errMessage;
-  logger.logWarning("DatabaseInterface::reconnect: trying to reconnect");
+bool DatabaseInterface::isConnected() {
+  string message;
+  return isConnected(message);
+}
 
-  // if (!DatabaseInterface::instance)
-  // {
-  //   logger.logError("DatabaseInterface::reconnect: myInstance = nullptr");
-  //   return false;
-  // }
+bool DatabaseInterface::isConnected(string &message) {
+  message = "";
 
-  if (!this->mDBConnection) {
-    logger.logError("DatabaseInterface::reconnect: mDBConnection = nullptr");
+  if (!mPool.isOpen()) {
+    message = "database connection not available";
     return false;
   }
 
-  if (mDBConnection->is_open()) {
-    logger.logWarning(
-        "DatabaseInterface::reconnect: trying to terminate connection");
-    this->close();
+  return true;
+}
+
+//========================================================================+
+namespace {
+//! time of the last write of the thread, for read-your-writes
+thread_local std::chrono::steady_clock::time_point tLastWrite;
+} // namespace
+
+//========================================================================+
+void DatabaseInterface::noteWrite() {
+  tLastWrite = std::chrono::steady_clock::now();
+}
+
+//========================================================================+
+PooledConnection DatabaseInterface::checkout(DbRoute route) {
+  //! join the transaction of the calling thread
+  DbTransaction *transaction = DbTransaction::current();
+  while (transaction && transaction->isNested()) {
+    transaction = transaction->mOuter;
   }
-  try {
-    logger.logWarning(
-        "DatabaseInterface::reconnect: trying to create connection");
-    this->connect();
-  } catch (pqxx::sql_error const &e) {
-    logger.logError(std::string("SQL error: ") + e.what());
-    logger.logError(std::string("Query was: ") + e.query());
-    close();
-    return false;
+  if (transaction && (transaction->mDb == this)) {
+    return PooledConnection(&*transaction->mConnection);
+  }
+  if (route == DbRoute::Replica) {
+    PooledConnection replica = checkoutReplica();
+    if (replica) {
+      return replica;
+    }
+  }
+  return PooledConnection(mPool, getCheckoutTimeout());
+}
+
+//========================================================================+
+PooledConnection DatabaseInterface::checkoutReplica() {
+  if (mReplicas.empty()) {
+    return PooledConnection();
+  }
+  const auto now = std::chrono::steady_clock::now();
+  if ((mReadYourWrites.count() > 0) && (now - tLastWrite < mReadYourWrites)) {
+    return PooledConnection();
   }
 
-  logger.logWarning("DatabaseInterface::reconnect: connect done");
-  return (mDBConnection != nullptr && mDBWork != nullptr);
+  const size_t nReplicas = mReplicas.size();
+  const size_t first = mNextReplica.fetch_add(1) % nReplicas;
+  for (size_t i = 0; i < nReplicas; ++i) {
+    DbReadReplica &replica = *mReplicas[(first + i) % nReplicas];
+    if (now.time_since_epoch().count() < replica.downUntil.load()) {
+      continue;
+    }
+    std::string message = "cannot open the pool";
+    if (!replica.pool.isOpen()) {
+      std::lock_guard<std::mutex> lock(mReplicaMutex);
+      if (!replica.pool.isOpen()) {
+        replica.pool.open(getConnectionString(replica.host, replica.port),
+                          mPoolSize, mStatementCacheSize);
+      }
+    }
+    if (replica.pool.isOpen()) {
+      PooledConnection connection(replica.pool, getCheckoutTimeout());
+      if (connection &&
+          (connection->isOpen() || connection->reconnect(message))) {
+        connection.setReplica(&replica);
+        return connection;
+      }
+    }
+    markReplicaDown(replica, message);
+  }
+  return PooledConnection();
 }
 
-bool DatabaseInterface::isConnected() {
-  string message;
-  return isConnected(message);
+//========================================================================+
+void DatabaseInterface::markReplicaDown(DbReadReplica &replica,
+                                        const string &message) {
+  logger.logWarning("DatabaseInterface: read replica " + replica.host + ":" +
+                    replica.port +
+                    " unavailable, reading from the primary. " + message);
+  replica.downUntil = (std::chrono::steady_clock::now() + kReplicaRetry)
+                          .time_since_epoch()
+                          .count();
 }
 
-bool DatabaseInterface::isConnected(string &message) {
-  message = "";
+//========================================================================+
+void DatabaseInterface::recordFailure(PooledConnection &connection,
+                                      const string &message) {
+  if (DbReadReplica *replica = connection.getReplica()) {
+    markReplicaDown(*replica, message);
+  } else {
+    mHealth.recordFailure(message);
+  }
+}
 
-  // if (!DatabaseInterface::instance)
-  // {
-  //   message = "database instance is null";
-  //   return false;
-  // }
+//========================================================================+
+void DatabaseInterface::logPoolStats() {
+  const ConnectionPoolStats stats = mPool.getStats();
+  std::ostringstream ss;
+  ss << "DB pool: size " << stats.size << ", in use " << stats.inUse
+     << ", peak " << stats.peakInUse << ", checkouts " << stats.checkouts
+     << ", waits " << stats.waits << ", timeouts " << stats.timeouts
+     << ", avg wait "
+     << (stats.waits ? stats.totalWait_us / stats.waits : 0) << " us"
+     << ", max wait " << stats.maxWait_us << " us"
+     << ", utilization " << std::fixed << std::setprecision(1)
+     << 100. * stats.utilization << "%";
+  logger.logInfo(ss.str(), SvtLogger::Mode::STANDARD);
+
+  const StatementCacheStats cache = mPool.getStatementCacheStats();
+  ss.str("");
+  ss << "DB statement cache: size " << cache.size << "/" << cache.capacity
+     << ", hits " << cache.hits << ", misses " << cache.misses
+     << ", evictions " << cache.evictions;
+  logger.logInfo(ss.str(), SvtLogger::Mode::STANDARD);
+
+  for (auto &replica : mReplicas) {
+    const ConnectionPoolStats replicaStats = replica->pool.getStats();
+    ss.str("");
+    ss << "DB replica " << replica->host << ":" << replica->port
+       << " pool: size " << replicaStats.size << ", in use "
+       << replicaStats.inUse << ", checkouts " << replicaStats.checkouts
+       << ", timeouts " << replicaStats.timeouts;
+    logger.logInfo(ss.str(), SvtLogger::Mode::STANDARD);
+  }
+}
 
-  if (!mDBConnection) {
-    message = "database connection not available";
+//========================================================================+
+void DatabaseInterface::logQueryStats() {
+  logger.logInfo(mQueryStats.toString(), SvtLogger::Mode::STANDARD);
+}
+
+//========================================================================+
+namespace {
+pqxx::params toPqxxParams(const sql_params_t &params) {
+  pqxx::params pqParams;
+  pqParams.reserve(params.size());
+  for (const auto &param : params) {
+    std::visit(
+        [&pqParams](const auto &value) {
+          using T = std::decay_t<decltype(value)>;
+          if constexpr (std::is_same_v<T, std::nullptr_t>) {
+            pqParams.append();
+          } else {
+            pqParams.append(value);
+          }
+        },
+        param);
+  }
+  return pqParams;
+}
+
+//! records the latency of one statement when it goes out of scope
+struct QueryTimer {
+  //! health is nullptr for the statements of a replica
+  QueryTimer(QueryStats &stats, SlowQueryLog &slowLog, DbHealthMonitor *health,
+             const std::string &query, const sql_params_t &params)
+      : mStats(stats), mSlowLog(slowLog), mHealth(health), mQuery(query),
+        mParams(params), mStart(std::chrono::steady_clock::now()) {}
+  ~QueryTimer() {
+    const auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - mStart)
+                        .count();
+    if (ok && mHealth) {
+      mHealth->recordSuccess();
+    }
+    mStats.record(mQuery, us, rows, bytes, ok);
+    if (mSlowLog.isSlow(us)) {
+      mSlowLog.record(mQuery, mParams, us, rows, ok);
+    }
+  }
+
+  QueryStats &mStats;
+  SlowQueryLog &mSlowLog;
+  DbHealthMonitor *mHealth;
+  const std::string &mQuery;
+  const sql_params_t &mParams;
+  std::chrono::steady_clock::time_point mStart;
+  size_t rows = 0;
+  size_t bytes = 0;
+  bool ok = false;
+};
+
+//! plain SELECT, any other statement may write
+bool isReadStatement(const std::string &query) {
+  const size_t start = query.find_first_not_of(" \t\n(");
+  return (start != std::string::npos) &&
+         (strncasecmp(query.c_str() + start, "SELECT", 6) == 0);
+}
+
+//! bound the statements of dbWork by the deadline of the request, SET
+//! LOCAL lasts until the end of the transaction
+void applyDeadline(pqxx::transaction_base &dbWork) {
+  if (DbDeadline::isSet()) {
+    dbWork.exec("SET LOCAL statement_timeout = " +
+                std::to_string(DbDeadline::remaining().count()));
+  }
+}
+
+//! cancel the statement of connection if it outlives the deadline
+struct DeadlineWatch {
+  DeadlineWatch(DbCancelWatchdog &watchdog, pqxx::connection &connection)
+      : mWatchdog(watchdog),
+        mTicket(DbDeadline::isSet()
+                    ? watchdog.watch(connection, DbDeadline::get())
+                    : 0) {}
+  ~DeadlineWatch() {
+    if (mTicket) {
+      mWatchdog.release(mTicket);
+    }
+  }
+
+  DbCancelWatchdog &mWatchdog;
+  const uint64_t mTicket;
+};
+
+//! run query as the cached prepared statement when there is one
+pqxx::result execStatement(pqxx::transaction_base &dbWork,
+                           const std::string &query,
+                           const std::string &statement,
+                           const pqxx::params &params) {
+  return statement.empty() ? dbWork.exec(query, params)
+                           : dbWork.exec(pqxx::prepped{statement}, params);
+}
+} // namespace
+
+//========================================================================+
+bool DatabaseInterface::checkConnection(PooledConnection &connection,
+                                        string &message) {
+  if (DbDeadline::isExpired()) {
+    message = "request deadline exceeded";
+    return false;
+  }
+  if (!isConnected(message)) {
+    return false;
+  }
+  //! fail fast while the health monitor is reconnecting the primary
+  if (!connection.getReplica() && mHealth.isTripped()) {
+    message = "database unavailable: " + mHealth.getReason();
+    return false;
+  }
+  if (!connection) {
+    message = "no database connection available in the pool";
     return false;
   }
 
-  return mDBConnection->is_open();
+  if (!connection->isOpen()) {
+    if (connection->getTransaction()) {
+      message = "database connection lost inside a transaction";
+      recordFailure(connection, message);
+      return false;
+    }
+    logger.logWarning("DatabaseInterface::checkConnection: connection " +
+                      std::to_string(connection->getIndex()) +
+                      " lost, trying to reconnect");
+    if (!connection->reconnect(message)) {
+      recordFailure(connection, message);
+      return false;
+    }
+  }
+  return true;
 }
 
 //========================================================================+
-void DatabaseInterface::executeQuery(const string &query, bool &status,
-                                     string &message, rows_t &rows) {
-  status = DatabaseInterface::isConnected(message);
-  std::string query_name("query");
+void DatabaseInterface::executeQuery(PooledConnection &connection,
+                                     const string &query, bool &status,
+                                     string &message, DbResult &result) {
+  DatabaseInterface::executeQuery(connection, query, sql_params_t(), status,
+                                  message, result);
+}
 
+//========================================================================+
+void DatabaseInterface::executeQuery(PooledConnection &connection,
+                                     const string &query,
+                                     const sql_params_t &params, bool &status,
+                                     string &message, DbResult &result) {
+  status = checkConnection(connection, message);
   if (!status) {
-    clearQueryResult(rows);
+    result.clear();
     return;
   }
+
+  QueryTimer timer(mQueryStats, mSlowLog, healthOf(connection), query, params);
   try {
-    // check connection was opened
-    // if (!DatabaseInterface::instance)
-    //   throw runtime_error(
-    //       "DatabaseInterface is uninitialized! You either forgotten to call "
-    //       "DatabaseInterface.connect() function or ignored its result.");
-
-    std::lock_guard<std::recursive_mutex> dbLock(mMutex);
-
-    if (!isConnected(message)) {
-      std::cout << "Database timeout reached, trying to reconnect!"
-                << std::endl;
-      if (!reconnect()) {
-        close();
-      }
-    }
+    //! lookup or prepare the statement before opening the transaction
+    const std::string &statement = connection->prepare(query);
+    const pqxx::params pqParams = toPqxxParams(params);
 
-    //! prepare statement
     // logger.logInfo(query);
-    mDBConnection->prepare(query_name, query);
-    pqxx::prepped prepare_name{query_name};
-    pqxx::result res{mDBWork->exec(prepare_name)};
-    for (const auto &row : res) {
-      row_t rowResult;
-      for (uint8_t i{0}; i < row.size(); ++i) {
-        const auto &data_field = row[i];
-        if (data_field.is_null()) {
-          rowResult.push_back(nullptr);
-          continue;
-        }
-        switch (data_field.type()) {
-        case 16: // bool
-        case 20: // int8
-        case 21: // int2
-        case 23: // integer
-          rowResult.push_back(data_field.as<int>());
-          break;
-        case 700: // float4
-        case 701: // float8
-          rowResult.push_back(data_field.as<double>());
-          break;
-        default:
-          rowResult.push_back(data_field.as<std::string>());
-          break;
-        }
-      }
-      rows.push_back(rowResult);
+    DeadlineWatch watch(mCancelWatchdog, connection->get());
+    const auto run = [&](pqxx::transaction_base &dbWork) {
+      applyDeadline(dbWork);
+      mFaults.beforeStatement(dbWork, query);
+      return DbResult(execStatement(dbWork, query, statement, pqParams));
+    };
+    if (pqxx::work *transaction = connection->getTransaction()) {
+      result = run(*transaction);
+    } else if (DbDeadline::isSet()) {
+      //! SET LOCAL needs a transaction block
+      pqxx::work dbWork(connection->get());
+      result = run(dbWork);
+      mFaults.beforeCommit(dbWork);
+      dbWork.commit();
+    } else {
+      pqxx::nontransaction dbWork(connection->get());
+      result = run(dbWork);
+    }
+    timer.rows = result.empty() ? result.affectedRows() : result.size();
+    timer.bytes = result.bytes();
+    timer.ok = true;
+    if (!isReadStatement(query)) {
+      noteWrite();
     }
-    // remove query statement
-    mDBWork->exec("DEALLOCATE PREPARE " + query_name);
     return;
+  } catch (pqxx::broken_connection const &e) {
+    message = std::string("Connection error: ") + e.what();
+    recordFailure(connection, message);
+    status = false;
+  } catch (pqxx::query_canceled const &e) {
+    message = std::string("Query cancelled: ") + e.what() +
+              std::string("Query was: ") + e.query();
+    status = false;
+  } catch (pqxx::transaction_rollback const &e) {
+    message = std::string(kDbRetryableMessage) + e.what() +
+              std::string("Query was: ") + e.query();
+    status = false;
   } catch (pqxx::sql_error const &e) {
-    // clear prepare
-    mDBWork->exec("DEALLOCATE PREPARE " + query_name);
     message = std::string("SQL error: ") + e.what() +
               std::string("Query was: ") + e.query();
     status = false;
+  } catch (std::exception const &e) {
+    message = std::string("Error: ") + e.what();
+    status = false;
   }
-  clearQueryResult(rows);
+  result.clear();
 
   return;
 }
 
+//========================================================================+
+void DatabaseInterface::executeStream(PooledConnection &connection,
+                                      const string &query,
+                                      const sql_params_t &params,
+                                      size_t batchSize,
+                                      const DbStreamCallback &callback,
+                                      bool &status, string &message) {
+  status = checkConnection(connection, message);
+  if (!status) {
+    return;
+  }
+
+  batchSize = std::max<size_t>(batchSize, 1);
+  QueryTimer timer(mQueryStats, mSlowLog, healthOf(connection), query, params);
+  try {
+    //! server side cursors only live inside a transaction block
+    std::unique_ptr<pqxx::work> ownWork;
+    pqxx::work *transaction = connection->getTransaction();
+    if (!transaction) {
+      ownWork = std::make_unique<pqxx::work>(connection->get());
+      transaction = ownWork.get();
+    }
+    pqxx::work &dbWork = *transaction;
+    DeadlineWatch watch(mCancelWatchdog, connection->get());
+    applyDeadline(dbWork);
+    mFaults.beforeStatement(dbWork, query);
+    const bool binary = mBinaryResults;
+    dbWork.exec(std::string("DECLARE svt_stream ") +
+                    (binary ? "BINARY " : "") + "NO SCROLL CURSOR FOR " +
+                    query,
+                toPqxxParams(params));
+
+    //! FETCH has no parameters, it is sent as a simple query and the
+    //! format of the cursor applies to its result
+    const std::string fetch =
+        "FETCH FORWARD " + std::to_string(batchSize) + " FROM svt_stream";
+    while (true) {
+      DbResult batch(dbWork.exec(fetch), binary);
+      timer.rows += batch.size();
+      timer.bytes += batch.bytes();
+      if (batch.empty() || !callback(batch) || batch.size() < batchSize) {
+        break;
+      }
+    }
+    dbWork.exec("CLOSE svt_stream");
+    if (ownWork) {
+      mFaults.beforeCommit(dbWork);
+      dbWork.commit();
+    }
+    timer.ok = true;
+    return;
+  } catch (pqxx::broken_connection const &e) {
+    message = std::string("Connection error: ") + e.what();
+    recordFailure(connection, message);
+    status = false;
+  } catch (pqxx::query_canceled const &e) {
+    message = std::string("Query cancelled: ") + e.what() +
+              std::string("Query was: ") + e.query();
+    status = false;
+  } catch (pqxx::transaction_rollback const &e) {
+    message = std::string(kDbRetryableMessage) + e.what() +
+              std::string("Query was: ") + e.query();
+    status = false;
+  } catch (pqxx::sql_error const &e) {
+    message = std::string("SQL error: ") + e.what() +
+              std::string("Query was: ") + e.query();
+    status = false;
+  } catch (std::exception const &e) {
+    message = std::string("Error: ") + e.what();
+    status = false;
+  }
+}
+
+//========================================================================+
+void DatabaseInterface::executeQuery(const string &query, bool &status,
+                                     string &message, DbResult &result) {
+  PooledConnection connection = checkout();
+  DatabaseInterface::executeQuery(connection, query, status, message, result);
+}
+
 //========================================================================+
 void DatabaseInterface::executeQuery(const string &query, bool &status,
-                                     rows_t &rows) {
+                                     DbResult &result) {
   string message;
-  DatabaseInterface::executeQuery(query, status, message, rows);
+  DatabaseInterface::executeQuery(query, status, message, result);
 }
 
 //========================================================================+
-void DatabaseInterface::executeQuery(const string &query, rows_t &rows) {
+void DatabaseInterface::executeQuery(const string &query, DbResult &result) {
   string message;
   bool status;
-  DatabaseInterface::executeQuery(query, status, message, rows);
+  DatabaseInterface::executeQuery(query, status, message, result);
 }
 
 //========================================================================+
-void DatabaseInterface::clearQueryResult(rows_t &result) {
-  for (auto &row : result) {
-    row_t().swap(row);
-  }
-  rows_t().swap(result);
+bool DatabaseInterface::executeUpdate(PooledConnection &connection,
+                                      const string &update, string &message) {
+  return DatabaseInterface::executeUpdate(connection, update, sql_params_t(),
+                                          message);
 }
 
-//========================================================================+
-bool DatabaseInterface::executeUpdate(const string &update, string &message) {
+bool DatabaseInterface::executeUpdate(PooledConnection &connection,
+                                      const string &update,
+                                      const sql_params_t &params,
+                                      string &message) {
   bool status;
-  rows_t rows;
-  executeQuery(update, status, message, rows);
-  clearQueryResult(rows);
+  DbResult result;
+  executeQuery(connection, update, params, status, message, result);
 
   return status;
 }
 
+bool DatabaseInterface::executeUpdate(const string &update, string &message) {
+  PooledConnection connection = checkout();
+  return DatabaseInterface::executeUpdate(connection, update, message);
+}
+
 bool DatabaseInterface::executeUpdate(const string &update) {
   string message;
   return DatabaseInterface::executeUpdate(update, message);
 }
 
 //========================================================================+
-bool DatabaseInterface::commitUpdate(bool commit) {
-  // if (!DatabaseInterface::instance)
-  //   throw runtime_error(
-  //       "DatabaseInterface is uninitialized! You either forgotten to call "
-  //       "DatabaseInterface.connect() function or ignored its result.");
-
-  std::lock_guard<std::recursive_mutex> dbLock(mMutex);
-
-  if (!isConnected()) {
+bool DatabaseInterface::executeCopy(PooledConnection &connection,
+                                    const string &table, const string &columns,
+                                    const vector<sql_copy_row_t> &rows,
+                                    string &message) {
+  if (!checkConnection(connection, message)) {
     return false;
   }
+  if (rows.empty()) {
+    return true;
+  }
 
-  if (mDBWork) {
-    if (commit) {
-      mDBWork->exec("commit;");
-    } else {
-      mDBWork->abort();
+  const string copy = "COPY " + table + " (" + columns + ") FROM STDIN";
+  const sql_params_t noParams;
+  QueryTimer timer(mQueryStats, mSlowLog, healthOf(connection), copy, noParams);
+  try {
+    std::unique_ptr<pqxx::work> ownWork;
+    pqxx::work *transaction = connection->getTransaction();
+    if (!transaction) {
+      ownWork = std::make_unique<pqxx::work>(connection->get());
+      transaction = ownWork.get();
     }
-  } else {
-    std::cout << "ERROR: null connection work." << std::endl;
-    return false;
+    DeadlineWatch watch(mCancelWatchdog, connection->get());
+    applyDeadline(*transaction);
+    mFaults.beforeStatement(*transaction, copy);
+    auto stream = pqxx::stream_to::raw_table(*transaction, table, columns);
+    for (const auto &row : rows) {
+      stream.write_row(row);
+      for (const auto &field : row) {
+        timer.bytes += field ? field->size() : 0;
+      }
+    }
+    stream.complete();
+    if (ownWork) {
+      mFaults.beforeCommit(*ownWork);
+      ownWork->commit();
+    }
+    timer.rows = rows.size();
+    timer.ok = true;
+    noteWrite();
+    return true;
+  } catch (pqxx::broken_connection const &e) {
+    message = std::string("Connection error: ") + e.what();
+    recordFailure(connection, message);
+  } catch (pqxx::query_canceled const &e) {
+    message = std::string("Query cancelled: ") + e.what() +
+              std::string("Query was: ") + e.query();
+  } catch (pqxx::transaction_rollback const &e) {
+    message = std::string(kDbRetryableMessage) + e.what() +
+              std::string("Query was: ") + e.query();
+  } catch (pqxx::sql_error const &e) {
+    message = std::string("SQL error: ") + e.what() +
+              std::string("Query was: ") + e.query();
+  } catch (std::exception const &e) {
+    message = std::string("Error: ") + e.what();
   }
-  return true;
+  return false;
 }
+
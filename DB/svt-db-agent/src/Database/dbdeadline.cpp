@@ -0,0 +1,120 @@
+#include "Database/dbdeadline.h"
+#include "SVTUtilities/SvtLogger.h"
+#include "SVTUtilities/SvtUtilities.h"
+
+#include <algorithm>
+#include <string>
+
+namespace {
+thread_local std::optional<DbDeadline::clock::time_point> tDeadline;
+} // namespace
+
+//========================================================================+
+DbDeadline::Scope::Scope(std::chrono::milliseconds timeout)
+    : mPrevious(tDeadline) {
+  if (timeout.count() > 0) {
+    //! saturate, a huge timeout would overflow the time point
+    const auto now = clock::now();
+    const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+        clock::time_point::max() - now);
+    tDeadline = (timeout < left)
+                    ? now + std::chrono::duration_cast<clock::duration>(timeout)
+                    : clock::time_point::max();
+  }
+}
+
+//========================================================================+
+DbDeadline::Scope::~Scope() { tDeadline = mPrevious; }
+
+//========================================================================+
+bool DbDeadline::isSet() { return tDeadline.has_value(); }
+
+//========================================================================+
+bool DbDeadline::isExpired() {
+  return tDeadline && (clock::now() >= *tDeadline);
+}
+
+//========================================================================+
+DbDeadline::clock::time_point DbDeadline::get() {
+  return tDeadline ? *tDeadline : clock::time_point::max();
+}
+
+//========================================================================+
+std::chrono::milliseconds DbDeadline::remaining() {
+  if (!tDeadline) {
+    return std::chrono::milliseconds::max();
+  }
+  const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+      *tDeadline - clock::now());
+  return std::max(left, std::chrono::milliseconds(1));
+}
+
+//========================================================================+
+void DbCancelWatchdog::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStop = true;
+  }
+  mWake.notify_all();
+  if (mThread.joinable()) {
+    mThread.join();
+  }
+}
+
+//========================================================================+
+uint64_t DbCancelWatchdog::watch(pqxx::connection &connection,
+                                 DbDeadline::clock::time_point deadline) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (!mThread.joinable()) {
+    mStop = false;
+    mThread = std::thread(&DbCancelWatchdog::run, this);
+  }
+  const uint64_t ticket = mNextTicket++;
+  mWatched[ticket] = Watch{&connection, deadline + kGrace};
+  mWake.notify_all();
+  return ticket;
+}
+
+//========================================================================+
+void DbCancelWatchdog::release(uint64_t ticket) {
+  //! once released the connection may run the next statement, it must
+  //! not be cancelled any more
+  std::lock_guard<std::mutex> lock(mMutex);
+  mWatched.erase(ticket);
+}
+
+//========================================================================+
+void DbCancelWatchdog::run() {
+  SvtLogger &logger = SvtDbAgent::Singleton<SvtLogger>::instance();
+  std::unique_lock<std::mutex> lock(mMutex);
+  while (!mStop) {
+    auto next = DbDeadline::clock::time_point::max();
+    for (const auto &[ticket, watch] : mWatched) {
+      next = std::min(next, watch.deadline);
+    }
+    if (next == DbDeadline::clock::time_point::max()) {
+      mWake.wait(lock);
+      continue;
+    }
+    mWake.wait_until(lock, next);
+
+    const auto now = DbDeadline::clock::now();
+    for (auto it = mWatched.begin(); it != mWatched.end();) {
+      if (it->second.deadline > now) {
+        ++it;
+        continue;
+      }
+      //! the statement holds the connection until it is released, the
+      //! lock keeps it from being released meanwhile
+      try {
+        it->second.connection->cancel_query();
+        logger.logWarning("DbCancelWatchdog: statement cancelled after "
+                          "its deadline");
+      } catch (const std::exception &e) {
+        logger.logError(std::string("DbCancelWatchdog: cancel failed, ") +
+                        e.what());
+      }
+      it = mWatched.erase(it);
+    }
+  }
+}
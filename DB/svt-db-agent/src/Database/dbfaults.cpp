@@ -0,0 +1,216 @@
+#include "Database/dbfaults.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using std::string;
+
+namespace {
+std::vector<string> split(const string &str, char delimiter) {
+  std::vector<string> items;
+  std::stringstream ss(str);
+  string item;
+  while (std::getline(ss, item, delimiter)) {
+    items.push_back(item);
+  }
+  return items;
+}
+
+bool parseProbability(const string &str, double &probability) {
+  try {
+    probability = std::stod(str);
+  } catch (const std::exception &) {
+    return false;
+  }
+  return (probability >= 0.) && (probability <= 1.);
+}
+} // namespace
+
+//========================================================================+
+bool DbLatency::parse(const string &spec, DbLatency &latency) {
+  const std::vector<string> items = split(spec, ':');
+  if (items.empty()) {
+    return false;
+  }
+  std::vector<double> values;
+  try {
+    for (size_t i = 1; i < items.size(); ++i) {
+      values.push_back(std::stod(items[i]));
+    }
+  } catch (const std::exception &) {
+    return false;
+  }
+  if (std::any_of(values.begin(), values.end(),
+                  [](double value) { return value < 0.; })) {
+    return false;
+  }
+
+  latency = DbLatency();
+  const string &kind = items[0];
+  if ((kind == "fixed") && (values.size() == 1)) {
+    latency.kind = Kind::Fixed;
+  } else if ((kind == "uniform") && (values.size() == 2) &&
+             (values[0] <= values[1])) {
+    latency.kind = Kind::Uniform;
+  } else if ((kind == "exp") && (values.size() == 1) && (values[0] > 0.)) {
+    latency.kind = Kind::Exponential;
+  } else if ((kind == "lognormal") && (values.size() == 2) &&
+             (values[0] > 0.)) {
+    latency.kind = Kind::LogNormal;
+  } else {
+    return false;
+  }
+  latency.a = values[0];
+  latency.b = (values.size() > 1) ? values[1] : 0.;
+  return true;
+}
+
+//========================================================================+
+double DbLatency::sample(std::mt19937_64 &rng) const {
+  switch (kind) {
+  case Kind::Fixed:
+    return a;
+  case Kind::Uniform:
+    return std::uniform_real_distribution<double>(a, b)(rng);
+  case Kind::Exponential:
+    return std::exponential_distribution<double>(1. / a)(rng);
+  case Kind::LogNormal:
+    //! a is the median, b the sigma of the log
+    return std::lognormal_distribution<double>(std::log(a), b)(rng);
+  case Kind::None:
+  default:
+    return 0.;
+  }
+}
+
+//========================================================================+
+bool DbFaultInjector::configure(const string &spec, string &message) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  mEnabled = false;
+  mLatency = DbLatency();
+  mCommitLatency = DbLatency();
+  mSpikeProbability = mErrorProbability = mDropProbability = 0.;
+  mMatch.clear();
+  mRng.seed(std::random_device()());
+
+  bool enabled = false;
+  for (const string &item : split(spec, ',')) {
+    if (item.empty()) {
+      continue;
+    }
+    const size_t sep = item.find('=');
+    const string key = item.substr(0, sep);
+    const string value = (sep == string::npos) ? "" : item.substr(sep + 1);
+    bool ok = true;
+    if (key == "latency") {
+      ok = DbLatency::parse(value, mLatency);
+    } else if (key == "commit") {
+      ok = DbLatency::parse(value, mCommitLatency);
+    } else if (key == "spike") {
+      const std::vector<string> values = split(value, ':');
+      DbLatency spike;
+      ok = (values.size() == 2) &&
+           parseProbability(values[0], mSpikeProbability) &&
+           DbLatency::parse("fixed:" + values[1], spike);
+      mSpikeMs = ok ? spike.a : 0.;
+    } else if (key == "error") {
+      ok = parseProbability(value, mErrorProbability);
+    } else if (key == "drop") {
+      ok = parseProbability(value, mDropProbability);
+    } else if (key == "match") {
+      mMatch = value;
+    } else if (key == "seed") {
+      try {
+        mRng.seed(std::stoull(value));
+      } catch (const std::exception &) {
+        ok = false;
+      }
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      message = "wrong fault injection setting: " + item;
+      return false;
+    }
+    enabled = enabled || ((key != "match") && (key != "seed"));
+  }
+  mEnabled = enabled;
+  return true;
+}
+
+//========================================================================+
+void DbFaultInjector::sleep(pqxx::transaction_base &dbWork, double ms) {
+  if (ms <= 0.) {
+    return;
+  }
+  pqxx::params params;
+  params.append(ms / 1000.);
+  dbWork.exec("SELECT pg_sleep($1)", params);
+}
+
+//========================================================================+
+void DbFaultInjector::beforeStatement(pqxx::transaction_base &dbWork,
+                                      const string &query) {
+  if (!mEnabled) {
+    return;
+  }
+  if (!mMatch.empty() && (query.find(mMatch) == string::npos)) {
+    return;
+  }
+
+  double delay_ms = 0.;
+  bool drop = false;
+  bool error = false;
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::uniform_real_distribution<double> uniform(0., 1.);
+    drop = uniform(mRng) < mDropProbability;
+    error = uniform(mRng) < mErrorProbability;
+    delay_ms = mLatency.sample(mRng);
+    if (uniform(mRng) < mSpikeProbability) {
+      delay_ms += mSpikeMs;
+      ++mSpikes;
+    }
+  }
+
+  if (drop) {
+    ++mDrops;
+    dbWork.exec("SELECT pg_terminate_backend(pg_backend_pid())");
+  }
+  if (delay_ms > 0.) {
+    ++mDelays;
+    sleep(dbWork, delay_ms);
+  }
+  if (error) {
+    ++mErrors;
+    dbWork.exec("DO $$BEGIN RAISE EXCEPTION 'injected fault'; END$$");
+  }
+}
+
+//========================================================================+
+void DbFaultInjector::beforeCommit(pqxx::transaction_base &dbWork) {
+  if (!mEnabled || (mCommitLatency.kind == DbLatency::Kind::None)) {
+    return;
+  }
+  double delay_ms = 0.;
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    delay_ms = mCommitLatency.sample(mRng);
+  }
+  ++mCommitDelays;
+  sleep(dbWork, delay_ms);
+}
+
+//========================================================================+
+nlohmann::ordered_json DbFaultInjector::toJson() const {
+  nlohmann::ordered_json faults;
+  faults["delays"] = mDelays.load();
+  faults["spikes"] = mSpikes.load();
+  faults["errors"] = mErrors.load();
+  faults["drops"] = mDrops.load();
+  faults["commitDelays"] = mCommitDelays.load();
+  return faults;
+}
@@ -0,0 +1,135 @@
+#include "Database/dbhealth.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using std::string;
+
+//========================================================================+
+void DbHealthMonitor::start() {
+  stop();
+  std::lock_guard<std::mutex> lock(mMutex);
+  mStop = false;
+  mThread = std::thread(&DbHealthMonitor::run, this);
+}
+
+//========================================================================+
+void DbHealthMonitor::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStop = true;
+  }
+  mWake.notify_all();
+  if (mThread.joinable()) {
+    mThread.join();
+  }
+}
+
+//========================================================================+
+string DbHealthMonitor::getReason() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mReason;
+}
+
+//========================================================================+
+void DbHealthMonitor::trip(const string &reason) {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mTripped) {
+      return;
+    }
+    mReason = reason;
+    mTripped = true;
+  }
+  logger.logError("DbHealthMonitor: database unavailable, " + reason);
+  mWake.notify_all();
+}
+
+//========================================================================+
+void DbHealthMonitor::reset() {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mTripped) {
+      return;
+    }
+    mReason.clear();
+    mFailures = 0;
+    mTripped = false;
+  }
+  logger.logInfo("DbHealthMonitor: database available again",
+                 SvtLogger::Mode::STANDARD);
+}
+
+//========================================================================+
+void DbHealthMonitor::recordFailure(const string &reason) {
+  if (++mFailures >= mFailureThreshold) {
+    trip(reason);
+  }
+}
+
+//========================================================================+
+bool DbHealthMonitor::checkIdle(bool reconnectAll) {
+  //! hold the checked connections so each idle one is visited once
+  std::vector<DbConnection *> checked;
+  bool healthy = true;
+  while (DbConnection *connection = mPool.tryAcquire()) {
+    checked.push_back(connection);
+
+    bool alive = connection->isOpen() && !reconnectAll;
+    if (alive) {
+      try {
+        pqxx::nontransaction ping(connection->get());
+        ping.exec("SELECT 1");
+      } catch (std::exception const &) {
+        alive = false;
+      }
+    }
+    if (!alive) {
+      string message;
+      if (!connection->reconnect(message)) {
+        healthy = false;
+        recordFailure("reconnect failed, " + message);
+        break;
+      }
+    }
+  }
+  for (auto *connection : checked) {
+    mPool.release(connection);
+  }
+  //! nothing was verified while recovering
+  return healthy && !(reconnectAll && checked.empty());
+}
+
+//========================================================================+
+void DbHealthMonitor::run() {
+  std::chrono::seconds backoff(1);
+  std::unique_lock<std::mutex> lock(mMutex);
+  while (!mStop) {
+    const bool tripped = mTripped;
+    mWake.wait_for(lock, tripped ? backoff : mKeepalive,
+                   [this, tripped] { return mStop || (mTripped != tripped); });
+    if (mStop) {
+      return;
+    }
+    if (mTripped && !tripped) {
+      //! just tripped, start reconnecting with the shortest delay
+      backoff = std::chrono::seconds(1);
+      continue;
+    }
+
+    lock.unlock();
+    const bool healthy = checkIdle(mTripped);
+    if (mTripped) {
+      if (healthy) {
+        reset();
+      } else {
+        logger.logWarning("DbHealthMonitor: reconnect failed, next attempt "
+                          "in " +
+                          std::to_string(backoff.count()) + " s");
+        backoff = std::min(backoff * 2, mMaxBackoff);
+      }
+    }
+    lock.lock();
+  }
+}
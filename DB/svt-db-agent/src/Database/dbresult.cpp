@@ -0,0 +1,378 @@
+#include "Database/dbresult.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+using namespace DbBinary;
+
+namespace {
+//! binary dates and timestamps count from 2000-01-01, 10957 days after the
+//! unix epoch
+constexpr long long kPgEpochDays = 10957;
+constexpr long long kDay_us = 86400LL * 1000000LL;
+
+template <typename T> T parseNumber(std::string_view text) {
+  T value{};
+  const auto [ptr, ec] =
+      std::from_chars(text.data(), text.data() + text.size(), value);
+  if (ec != std::errc() || ptr != text.data() + text.size()) {
+    throw std::invalid_argument("DbResult: cannot convert '" +
+                                std::string(text) + "' to a number");
+  }
+  return value;
+}
+
+//! binary values are sent in network byte order
+template <typename T> T readBigEndian(std::string_view bytes) {
+  if (bytes.size() != sizeof(T)) {
+    throw std::invalid_argument("DbResult: binary value of " +
+                                std::to_string(bytes.size()) +
+                                " bytes, expected " +
+                                std::to_string(sizeof(T)));
+  }
+  std::make_unsigned_t<T> value = 0;
+  for (const unsigned char byte : bytes) {
+    value = static_cast<std::make_unsigned_t<T>>(value << 8) | byte;
+  }
+  return static_cast<T>(value);
+}
+
+template <typename F, typename I> F bitsToFloat(I bits) {
+  static_assert(sizeof(F) == sizeof(I));
+  F value;
+  std::memcpy(&value, &bits, sizeof(F));
+  return value;
+}
+
+std::string formatDate(const DbDate &date) {
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), "%04d-%02d-%02d", date.year,
+                date.month, date.day);
+  return buffer;
+}
+
+//! same as the postgres ISO output, trailing zeros of the fraction dropped
+std::string formatTimestamp(const DbTimestamp &ts) {
+  char buffer[48];
+  int length = std::snprintf(buffer, sizeof(buffer),
+                             "%04d-%02d-%02d %02d:%02d:%02d", ts.date.year,
+                             ts.date.month, ts.date.day, ts.hour, ts.minute,
+                             ts.second);
+  if (ts.microsecond) {
+    length += std::snprintf(buffer + length, sizeof(buffer) - length, ".%06d",
+                            ts.microsecond);
+    while (buffer[length - 1] == '0') {
+      --length;
+    }
+  }
+  return std::string(buffer, length);
+}
+
+//! shortest text reading back to the same value, as extra_float_digits=1
+template <typename F> std::string formatFloat(F value) {
+  if (std::isnan(value)) {
+    return "NaN";
+  }
+  if (std::isinf(value)) {
+    return (value > 0) ? "Infinity" : "-Infinity";
+  }
+  char buffer[32];
+  const auto [ptr, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+  return std::string(buffer, ptr);
+}
+} // namespace
+
+//========================================================================+
+DbResult::DbResult(pqxx::result result, bool binary)
+    : mResult(std::move(result)), mBinary(binary) {
+  const int nColumns = mResult.columns();
+  mColumnTypes.reserve(nColumns);
+  for (int col = 0; col < nColumns; ++col) {
+    mColumnTypes.push_back(mResult.column_type(col));
+  }
+}
+
+//========================================================================+
+long long DbResult::decodeInt(size_t row, size_t col) const {
+  const std::string_view bytes = getStringView(row, col);
+  switch (mColumnTypes.at(col)) {
+  case kInt2:
+    return readBigEndian<int16_t>(bytes);
+  case kInt4:
+    return readBigEndian<int32_t>(bytes);
+  case kInt8:
+    return readBigEndian<int64_t>(bytes);
+  default:
+    return parseNumber<long long>(bytes);
+  }
+}
+
+//========================================================================+
+double DbResult::decodeFloat(size_t row, size_t col) const {
+  switch (mColumnTypes.at(col)) {
+  case kFloat4:
+    //! through the shortest text, a float4 reads as in a text result
+    return parseNumber<double>(formatFloat(bitsToFloat<float>(
+        readBigEndian<uint32_t>(getStringView(row, col)))));
+  case kFloat8:
+    return bitsToFloat<double>(
+        readBigEndian<uint64_t>(getStringView(row, col)));
+  case kInt2:
+  case kInt4:
+  case kInt8:
+    return static_cast<double>(decodeInt(row, col));
+  default:
+    return parseNumber<double>(getStringView(row, col));
+  }
+}
+
+//========================================================================+
+DbDate DbBinary::civilFromDays(long long days) {
+  days += 719468;
+  const long long era = (days >= 0 ? days : days - 146096) / 146097;
+  const long long doe = days - era * 146097;
+  const long long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  const long long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  const long long mp = (5 * doy + 2) / 153;
+  DbDate date;
+  date.day = static_cast<int>(doy - (153 * mp + 2) / 5 + 1);
+  date.month = static_cast<int>(mp < 10 ? mp + 3 : mp - 9);
+  date.year = static_cast<int>(yoe + era * 400 + (date.month <= 2));
+  return date;
+}
+
+//========================================================================+
+DbTimestamp DbBinary::timestampFromMicroseconds(long long us) {
+  long long days = us / kDay_us;
+  long long time_us = us % kDay_us;
+  if (time_us < 0) {
+    --days;
+    time_us += kDay_us;
+  }
+  DbTimestamp ts;
+  ts.date = civilFromDays(days + kPgEpochDays);
+  ts.microsecond = static_cast<int>(time_us % 1000000);
+  const long long seconds = time_us / 1000000;
+  ts.second = static_cast<int>(seconds % 60);
+  ts.minute = static_cast<int>((seconds / 60) % 60);
+  ts.hour = static_cast<int>(seconds / 3600);
+  return ts;
+}
+
+//========================================================================+
+std::string DbBinary::toText(uint32_t type, std::string_view bytes) {
+  switch (type) {
+  case kBool:
+    return (readBigEndian<uint8_t>(bytes) != 0) ? "t" : "f";
+  case kInt2:
+    return std::to_string(readBigEndian<int16_t>(bytes));
+  case kInt4:
+    return std::to_string(readBigEndian<int32_t>(bytes));
+  case kInt8:
+    return std::to_string(readBigEndian<int64_t>(bytes));
+  case kFloat4:
+    return formatFloat(bitsToFloat<float>(readBigEndian<uint32_t>(bytes)));
+  case kFloat8:
+    return formatFloat(bitsToFloat<double>(readBigEndian<uint64_t>(bytes)));
+  case kDate: {
+    const int32_t days = readBigEndian<int32_t>(bytes);
+    if (days == std::numeric_limits<int32_t>::max()) {
+      return "infinity";
+    }
+    if (days == std::numeric_limits<int32_t>::min()) {
+      return "-infinity";
+    }
+    return formatDate(civilFromDays(days + kPgEpochDays));
+  }
+  case kTimestamp:
+  case kTimestamptz: {
+    const int64_t us = readBigEndian<int64_t>(bytes);
+    if (us == std::numeric_limits<int64_t>::max()) {
+      return "infinity";
+    }
+    if (us == std::numeric_limits<int64_t>::min()) {
+      return "-infinity";
+    }
+    //! binary timestamptz is UTC, not the session time zone
+    return formatTimestamp(timestampFromMicroseconds(us)) +
+           ((type == kTimestamptz) ? "+00" : "");
+  }
+  default:
+    return std::string(bytes);
+  }
+}
+
+//========================================================================+
+std::string DbResult::getString(size_t row, size_t col) const {
+  if (!mBinary) {
+    return std::string(getStringView(row, col));
+  }
+  return toText(mColumnTypes.at(col), getStringView(row, col));
+}
+
+//========================================================================+
+int DbResult::getInt(size_t row, size_t col) const {
+  if (!mBinary) {
+    return parseNumber<int>(getStringView(row, col));
+  }
+  const long long value = decodeInt(row, col);
+  if (value < std::numeric_limits<int>::min() ||
+      value > std::numeric_limits<int>::max()) {
+    throw std::out_of_range("DbResult: " + std::to_string(value) +
+                            " does not fit an int");
+  }
+  return static_cast<int>(value);
+}
+
+//========================================================================+
+size_t DbResult::bytes() const {
+  size_t total = 0;
+  for (size_t row = 0; row < size(); ++row) {
+    for (size_t col = 0; col < columns(); ++col) {
+      total += mResult[row][col].size();
+    }
+  }
+  return total;
+}
+
+//========================================================================+
+long long DbResult::getInt64(size_t row, size_t col) const {
+  return mBinary ? decodeInt(row, col)
+                 : parseNumber<long long>(getStringView(row, col));
+}
+
+//========================================================================+
+double DbResult::getDouble(size_t row, size_t col) const {
+  return mBinary ? decodeFloat(row, col)
+                 : parseNumber<double>(getStringView(row, col));
+}
+
+//========================================================================+
+bool DbResult::getBool(size_t row, size_t col) const {
+  const std::string_view text = getStringView(row, col);
+  if (mBinary && mColumnTypes.at(col) == kBool) {
+    return readBigEndian<uint8_t>(text) != 0;
+  }
+  return !text.empty() && (text[0] == 't' || text[0] == 'T' || text[0] == '1');
+}
+
+//========================================================================+
+DbDate DbResult::getDate(size_t row, size_t col) const {
+  if (mBinary) {
+    switch (mColumnTypes.at(col)) {
+    case kDate:
+      return civilFromDays(readBigEndian<int32_t>(getStringView(row, col)) +
+                           kPgEpochDays);
+    case kTimestamp:
+    case kTimestamptz:
+      return getTimestamp(row, col).date;
+    default:
+      break;
+    }
+  }
+  //! ISO format YYYY-MM-DD[ HH:MM:SS...]
+  const std::string_view text = getStringView(row, col);
+  if (text.size() < 10 || text[4] != '-' || text[7] != '-') {
+    throw std::invalid_argument("DbResult: cannot convert '" +
+                                std::string(text) + "' to a date");
+  }
+  DbDate date;
+  date.year = parseNumber<int>(text.substr(0, 4));
+  date.month = parseNumber<int>(text.substr(5, 2));
+  date.day = parseNumber<int>(text.substr(8, 2));
+  return date;
+}
+
+//========================================================================+
+DbTimestamp DbResult::getTimestamp(size_t row, size_t col) const {
+  if (mBinary) {
+    switch (mColumnTypes.at(col)) {
+    case kTimestamp:
+    case kTimestamptz:
+      return timestampFromMicroseconds(
+          readBigEndian<int64_t>(getStringView(row, col)));
+    default:
+      break;
+    }
+  }
+  DbTimestamp ts;
+  ts.date = getDate(row, col);
+  if (mBinary && mColumnTypes[col] == kDate) {
+    return ts;
+  }
+  //! ISO format YYYY-MM-DD HH:MM:SS[.ffffff][+TZ], the time may be missing
+  const std::string_view text = getStringView(row, col);
+  if (text.size() < 19) {
+    return ts;
+  }
+  if ((text[10] != ' ' && text[10] != 'T') || text[13] != ':' ||
+      text[16] != ':') {
+    throw std::invalid_argument("DbResult: cannot convert '" +
+                                std::string(text) + "' to a timestamp");
+  }
+  ts.hour = parseNumber<int>(text.substr(11, 2));
+  ts.minute = parseNumber<int>(text.substr(14, 2));
+  ts.second = parseNumber<int>(text.substr(17, 2));
+  if (text.size() > 20 && text[19] == '.') {
+    int digits = 0;
+    for (size_t i = 20; i < text.size() && digits < 6; ++i, ++digits) {
+      if (text[i] < '0' || text[i] > '9') {
+        break;
+      }
+      ts.microsecond = 10 * ts.microsecond + (text[i] - '0');
+    }
+    for (; digits < 6; ++digits) {
+      ts.microsecond *= 10;
+    }
+  }
+  return ts;
+}
+
+//========================================================================+
+nlohmann::ordered_json DbResult::toJson(size_t row, size_t col) const {
+  if (isNull(row, col)) {
+    return nullptr;
+  }
+  switch (mColumnTypes.at(col)) {
+  case kBool:
+    return getBool(row, col);
+  case kInt2:
+  case kInt4:
+  case kInt8:
+    return getInt64(row, col);
+  case kFloat4:
+  case kFloat8:
+    return getDouble(row, col);
+  default:
+    //! dates and timestamps are sent as their ISO text
+    return getString(row, col);
+  }
+}
+
+//========================================================================+
+bool DbResult::hasNativeJson(size_t col) const {
+  switch (mColumnTypes.at(col)) {
+  case kBool:
+  case kInt2:
+  case kInt4:
+  case kInt8:
+  case kFloat4:
+  case kFloat8:
+    return true;
+  default:
+    return false;
+  }
+}
+
+//========================================================================+
+void DbResult::clear() {
+  mResult.clear();
+  mColumnTypes.clear();
+  mBinary = false;
+}
@@ -0,0 +1,130 @@
+#include "Database/dbtransaction.h"
+#include "Database/databaseinterface.h"
+
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+using SvtDbAgent::Singleton;
+
+namespace {
+thread_local DbTransaction *tCurrent = nullptr;
+} // namespace
+
+//========================================================================+
+DbTransaction::DbTransaction(DatabaseInterface &db)
+    : mDb(&db), mOuter(tCurrent) {
+  if (mOuter && (mOuter->mDb == mDb)) {
+    tCurrent = this;
+    return;
+  }
+  mOuter = nullptr;
+
+  mConnection = db.checkout();
+  std::string message;
+  if (!db.checkConnection(mConnection, message)) {
+    if (db.isUnavailable()) {
+      throw DbUnavailableError("DbTransaction: " + message);
+    }
+    if (DbDeadline::isExpired()) {
+      throw DbTimeoutError("DbTransaction: " + message);
+    }
+    throw std::runtime_error("DbTransaction: " + message);
+  }
+  mWork = std::make_unique<pqxx::work>(mConnection->get());
+  mConnection->setTransaction(mWork.get());
+  tCurrent = this;
+}
+
+//========================================================================+
+DbTransaction::~DbTransaction() {
+  if (!mDone) {
+    rollback();
+  }
+}
+
+//========================================================================+
+DbTransaction *DbTransaction::current() { return tCurrent; }
+
+//========================================================================+
+void DbTransaction::commit() {
+  if (mDone) {
+    return;
+  }
+  if (isNested()) {
+    finish();
+    return;
+  }
+  if (mRollbackOnly) {
+    rollback();
+    throw std::runtime_error(
+        "DbTransaction::commit: a nested transaction was rolled back");
+  }
+
+  try {
+    mDb->mFaults.beforeCommit(*mWork);
+    mWork->commit();
+  } catch (...) {
+    finish();
+    runCommitCallbacks();
+    throw;
+  }
+  finish();
+  mDb->noteWrite();
+  runCommitCallbacks();
+}
+
+//========================================================================+
+void DbTransaction::onCommit(std::function<void()> callback) {
+  if (isNested()) {
+    mOuter->onCommit(std::move(callback));
+    return;
+  }
+  mCommitCallbacks.push_back(std::move(callback));
+}
+
+//========================================================================+
+void DbTransaction::runCommitCallbacks() {
+  std::vector<std::function<void()>> callbacks;
+  callbacks.swap(mCommitCallbacks);
+  for (const auto &callback : callbacks) {
+    try {
+      callback();
+    } catch (std::exception const &e) {
+      Singleton<SvtLogger>::instance().logError(
+          std::string("DbTransaction::commit: ") + e.what());
+    }
+  }
+}
+
+//========================================================================+
+void DbTransaction::rollback() {
+  if (mDone) {
+    return;
+  }
+  if (isNested()) {
+    mOuter->mRollbackOnly = true;
+    finish();
+    return;
+  }
+
+  try {
+    mWork->abort();
+  } catch (std::exception const &e) {
+    Singleton<SvtLogger>::instance().logError(
+        std::string("DbTransaction::rollback: ") + e.what());
+  }
+  finish();
+}
+
+//========================================================================+
+void DbTransaction::finish() {
+  mDone = true;
+  tCurrent = mOuter;
+  if (isNested()) {
+    return;
+  }
+  mConnection->setTransaction(nullptr);
+  mWork.reset();
+  mConnection.release();
+}
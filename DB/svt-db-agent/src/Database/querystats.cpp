@@ -0,0 +1,202 @@
+#include "Database/querystats.h"
+#include "Database/statementcache.h"
+
+#include <algorithm>
+#include <cctype>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <vector>
+
+using std::string;
+
+//========================================================================+
+void LatencyHistogram::record(uint64_t us, size_t nRows, size_t nBytes,
+                              bool ok) {
+  const auto bucket =
+      std::lower_bound(kBounds_us.begin(), kBounds_us.end(), us) -
+      kBounds_us.begin();
+  ++buckets[bucket];
+  ++count;
+  if (!ok) {
+    ++errors;
+  }
+  total_us += us;
+  max_us = std::max(max_us, us);
+  rows += nRows;
+  bytes += nBytes;
+}
+
+//========================================================================+
+uint64_t LatencyHistogram::percentile(double p) const {
+  if (!count) {
+    return 0;
+  }
+  const uint64_t rank = std::max<uint64_t>(1, p * count + 0.5);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kBounds_us.size(); ++i) {
+    seen += buckets[i];
+    if (seen >= rank) {
+      return std::min(kBounds_us[i], max_us);
+    }
+  }
+  return max_us;
+}
+
+//========================================================================+
+nlohmann::ordered_json LatencyHistogram::toJson() const {
+  nlohmann::ordered_json histo;
+  histo["count"] = count;
+  histo["errors"] = errors;
+  histo["mean_us"] = count ? total_us / count : 0;
+  histo["p50_us"] = percentile(0.50);
+  histo["p99_us"] = percentile(0.99);
+  histo["max_us"] = max_us;
+  histo["rows"] = rows;
+  histo["bytes"] = bytes;
+
+  nlohmann::ordered_json counts = nlohmann::ordered_json::object();
+  for (size_t i = 0; i < buckets.size(); ++i) {
+    if (buckets[i]) {
+      counts[(i < kBounds_us.size()) ? "le_" + std::to_string(kBounds_us[i])
+                                     : string("inf")] = buckets[i];
+    }
+  }
+  histo["buckets_us"] = std::move(counts);
+  return histo;
+}
+
+//========================================================================+
+void QueryStats::record(const string &query, uint64_t us, size_t rows,
+                        size_t bytes, bool ok) {
+  string shape = StatementCache::normalize(query);
+  string table = tableOf(shape);
+
+  std::lock_guard<std::mutex> lock(mMutex);
+  if ((mShapes.size() >= kMaxShapes) && !mShapes.count(shape)) {
+    shape = kOtherShape;
+  }
+  mShapes[shape].record(us, rows, bytes, ok);
+  if (!table.empty()) {
+    mTables[table].record(us, rows, bytes, ok);
+  }
+}
+
+//========================================================================+
+void QueryStats::reset() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  mShapes.clear();
+  mTables.clear();
+}
+
+//========================================================================+
+nlohmann::ordered_json QueryStats::toJson() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  nlohmann::ordered_json stats;
+  nlohmann::ordered_json tables = nlohmann::ordered_json::object();
+  for (const auto &[table, histo] : mTables) {
+    tables[table] = histo.toJson();
+  }
+  nlohmann::ordered_json shapes = nlohmann::ordered_json::array();
+  for (const auto &[shape, histo] : mShapes) {
+    nlohmann::ordered_json entry;
+    entry["statement"] = shape;
+    entry["latency"] = histo.toJson();
+    shapes.push_back(std::move(entry));
+  }
+  stats["tables"] = std::move(tables);
+  stats["statements"] = std::move(shapes);
+  return stats;
+}
+
+//========================================================================+
+std::string QueryStats::toString() {
+  using entry_t = std::pair<string, LatencyHistogram>;
+  std::vector<entry_t> tables, shapes;
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    tables.assign(mTables.begin(), mTables.end());
+    shapes.assign(mShapes.begin(), mShapes.end());
+  }
+  const auto slowest = [](const entry_t &a, const entry_t &b) {
+    return a.second.percentile(0.99) > b.second.percentile(0.99);
+  };
+  std::sort(tables.begin(), tables.end(), slowest);
+  std::sort(shapes.begin(), shapes.end(), slowest);
+
+  std::ostringstream ss;
+  const auto line = [&ss](const string &name, const LatencyHistogram &h) {
+    ss << "\n  n " << h.count << ", err " << h.errors << ", mean "
+       << (h.count ? h.total_us / h.count : 0) << " us, p50 "
+       << h.percentile(0.50) << " us, p99 " << h.percentile(0.99)
+       << " us, max " << h.max_us << " us, rows " << h.rows << ", bytes "
+       << h.bytes << " | " << name;
+  };
+  ss << "DB latency per table:";
+  for (const auto &[table, histo] : tables) {
+    line(table, histo);
+  }
+  ss << "\nDB latency per statement:";
+  for (const auto &[shape, histo] : shapes) {
+    line(shape, histo);
+  }
+  return ss.str();
+}
+
+//========================================================================+
+std::string QueryStats::tableOf(const string &query) {
+  //! first identifier after the keyword introducing the target table. A
+  //! write is named by its leading verb, its FROM is a source table, a
+  //! WITH may introduce a data-modifying statement, reads use FROM
+  static const std::map<string, std::vector<string>> verbs = {
+      {"INSERT", {"INSERT INTO "}},
+      {"UPDATE", {"UPDATE "}},
+      {"DELETE", {"DELETE FROM "}},
+      {"COPY", {"COPY "}},
+      {"WITH", {"INSERT INTO ", "DELETE FROM ", "(UPDATE ", ") UPDATE "}}};
+  string upper(query);
+  std::transform(upper.begin(), upper.end(), upper.begin(),
+                 [](unsigned char c) { return std::toupper(c); });
+
+  const size_t lead = upper.find_first_not_of(" \t\r\n");
+  const size_t leadEnd = upper.find_first_of(" \t\r\n(", lead);
+  std::vector<string> keywords;
+  if (lead != string::npos) {
+    const auto verb = verbs.find(upper.substr(lead, leadEnd - lead));
+    if (verb != verbs.end()) {
+      keywords = verb->second;
+    }
+  }
+  keywords.push_back(" FROM ");
+
+  for (const auto &keyword : keywords) {
+    size_t pos = upper.find(keyword);
+    //! skip subqueries, the table is found inside them
+    while ((pos != string::npos) && (pos + keyword.size() < query.size()) &&
+           (query[pos + keyword.size()] == '(')) {
+      pos = upper.find(keyword, pos + 1);
+    }
+    if (pos == string::npos) {
+      continue;
+    }
+    pos += keyword.size();
+    size_t end = pos;
+    bool quoted = false;
+    while (end < query.size()) {
+      const char c = query[end];
+      if (c == '"') {
+        quoted = !quoted;
+      } else if (!quoted && (std::isspace(static_cast<unsigned char>(c)) ||
+                             c == '(' || c == ';' || c == ',')) {
+        break;
+      }
+      ++end;
+    }
+    string table = query.substr(pos, end - pos);
+    table.erase(std::remove(table.begin(), table.end(), '"'), table.end());
+    //! drop the schema
+    const size_t dot = table.rfind('.');
+    return (dot == string::npos) ? table : table.substr(dot + 1);
+  }
+  return "";
+}
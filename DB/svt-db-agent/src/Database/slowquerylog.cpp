@@ -0,0 +1,230 @@
+#include "Database/slowquerylog.h"
+#include "SVTUtilities/SvtLogger.h"
+#include "SVTUtilities/SvtUtilities.h"
+
+#include <pqxx/pqxx>
+
+#include <algorithm>
+#include <cctype>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+#include <type_traits>
+
+using std::string;
+using SvtDbAgent::Singleton;
+
+namespace {
+thread_local string tCorrelationId;
+
+//! longest parameter value written to the log
+constexpr size_t kMaxParamLength = 256;
+
+string timestamp() {
+  std::time_t time_now = std::time(nullptr);
+  std::stringstream ss;
+  ss << std::put_time(std::localtime(&time_now), "%Y-%m-%d %OH:%OM:%OS");
+  return ss.str();
+}
+
+//! only statements without side effects are run by EXPLAIN ANALYZE: a
+//! SELECT reading a table. A SELECT without FROM only calls functions,
+//! such as pg_advisory_xact_lock() or pg_terminate_backend(), it is only
+//! planned
+bool isReadOnly(const string &query) {
+  string words;
+  for (char c : query) {
+    words += std::isspace(static_cast<unsigned char>(c))
+                 ? ' '
+                 : static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+  }
+  words += ' ';
+  const size_t head = words.find_first_not_of(' ');
+  return (head != string::npos) && (words.compare(head, 7, "SELECT ") == 0) &&
+         (words.find(" FROM ", head) != string::npos);
+}
+} // namespace
+
+//========================================================================+
+SlowQueryLog::~SlowQueryLog() { stopExplain(); }
+
+//========================================================================+
+void SlowQueryLog::setFileName(const string &fileName) {
+  std::lock_guard<std::mutex> lock(mFileMutex);
+  mFile.close();
+  mFileName = fileName;
+}
+
+//========================================================================+
+void SlowQueryLog::setExplain(bool enable, const string &connString,
+                              std::chrono::seconds interval) {
+  stopExplain();
+
+  std::lock_guard<std::mutex> lock(mExplainMutex);
+  mExplain = enable;
+  mConnString = connString;
+  mExplainInterval = interval;
+  mLastExplain = std::chrono::steady_clock::time_point();
+  if (mExplain) {
+    mStop = false;
+    mExplainThread = std::thread(&SlowQueryLog::explainLoop, this);
+  }
+}
+
+//========================================================================+
+void SlowQueryLog::stopExplain() {
+  {
+    std::lock_guard<std::mutex> lock(mExplainMutex);
+    mStop = true;
+    mExplainJob.reset();
+  }
+  mExplainCv.notify_all();
+  if (mExplainThread.joinable()) {
+    mExplainThread.join();
+  }
+  mConnection.reset();
+}
+
+//========================================================================+
+void SlowQueryLog::setCorrelationId(const string &correlationId) {
+  tCorrelationId = correlationId;
+}
+
+const string &SlowQueryLog::getCorrelationId() { return tCorrelationId; }
+
+//========================================================================+
+string SlowQueryLog::formatParams(const sql_params_t &params) {
+  std::ostringstream ss;
+  ss << "[";
+  for (size_t i = 0; i < params.size(); ++i) {
+    ss << (i ? ", " : "") << "$" << (i + 1) << "=";
+    std::visit(
+        [&ss](const auto &value) {
+          using T = std::decay_t<decltype(value)>;
+          if constexpr (std::is_same_v<T, std::nullptr_t>) {
+            ss << "NULL";
+          } else if constexpr (std::is_same_v<T, bool>) {
+            ss << (value ? "true" : "false");
+          } else if constexpr (std::is_same_v<T, string>) {
+            ss << "'" << value.substr(0, kMaxParamLength)
+               << ((value.size() > kMaxParamLength) ? "...'" : "'");
+          } else {
+            ss << value;
+          }
+        },
+        params[i]);
+  }
+  ss << "]";
+  return ss.str();
+}
+
+//========================================================================+
+void SlowQueryLog::record(const string &query, const sql_params_t &params,
+                          uint64_t us, size_t rows, bool ok) {
+  std::ostringstream ss;
+  ss << timestamp() << " duration_us=" << us << " rows=" << rows
+     << " status=" << (ok ? "ok" : "error") << " correlationId="
+     << (tCorrelationId.empty() ? "-" : tCorrelationId);
+  const string header = ss.str();
+
+  ss << "\n  query: " << query << "\n  params: " << formatParams(params)
+     << "\n";
+  write(ss.str());
+
+  Singleton<SvtLogger>::instance().logWarning(
+      "Slow query " + std::to_string(us / 1000) + " ms, correlationId " +
+      (tCorrelationId.empty() ? "-" : tCorrelationId));
+
+  //! hand the statement to the explain worker unless rate limited
+  {
+    std::lock_guard<std::mutex> lock(mExplainMutex);
+    const auto now = std::chrono::steady_clock::now();
+    if (!mExplain || mExplainJob || (now - mLastExplain < mExplainInterval)) {
+      return;
+    }
+    mLastExplain = now;
+    mExplainJob = ExplainJob{header, query, params};
+  }
+  mExplainCv.notify_one();
+}
+
+//========================================================================+
+void SlowQueryLog::write(const string &entry) {
+  std::lock_guard<std::mutex> lock(mFileMutex);
+  if (mFileName.empty()) {
+    return;
+  }
+  if (!mFile.is_open()) {
+    mFile.open(mFileName, std::ios::app);
+    if (!mFile.is_open()) {
+      Singleton<SvtLogger>::instance().logError(
+          "SlowQueryLog: unable to open " + mFileName);
+      return;
+    }
+  }
+  mFile << entry;
+  mFile.flush();
+}
+
+//========================================================================+
+void SlowQueryLog::explainLoop() {
+  while (true) {
+    ExplainJob job;
+    {
+      std::unique_lock<std::mutex> lock(mExplainMutex);
+      mExplainCv.wait(lock, [this] { return mStop || mExplainJob; });
+      if (mStop) {
+        return;
+      }
+      job = std::move(*mExplainJob);
+      mExplainJob.reset();
+    }
+    write(job.header + "\n  plan:\n" + explain(job));
+  }
+}
+
+//========================================================================+
+string SlowQueryLog::explain(const ExplainJob &job) {
+  pqxx::params pqParams;
+  for (const auto &param : job.params) {
+    std::visit(
+        [&pqParams](const auto &value) {
+          using T = std::decay_t<decltype(value)>;
+          if constexpr (std::is_same_v<T, std::nullptr_t>) {
+            pqParams.append();
+          } else {
+            pqParams.append(value);
+          }
+        },
+        param);
+  }
+
+  std::ostringstream plan;
+  try {
+    //! a connection of its own, the pool is never blocked by a plan
+    if (!mConnection || !mConnection->is_open()) {
+      mConnection = std::make_unique<pqxx::connection>(mConnString);
+    }
+    //! the statement is executed by ANALYZE, writes are only planned and
+    //! everything is rolled back
+    pqxx::work dbWork(*mConnection);
+    //! the plan of a statement that hangs must not block the worker for
+    //! longer than its rate limit interval
+    const auto timeout = std::max(mExplainInterval, std::chrono::seconds(1));
+    dbWork.exec("SET LOCAL statement_timeout = " +
+                std::to_string(
+                    std::chrono::milliseconds(timeout).count()));
+    const string explain = isReadOnly(job.query)
+                               ? "EXPLAIN (ANALYZE, BUFFERS) "
+                               : "EXPLAIN ";
+    const pqxx::result result = dbWork.exec(explain + job.query, pqParams);
+    for (pqxx::result::size_type row = 0; row < result.size(); ++row) {
+      plan << "    " << result[row][0].view() << "\n";
+    }
+    dbWork.abort();
+  } catch (std::exception const &e) {
+    plan << "    EXPLAIN failed: " << e.what() << "\n";
+    mConnection.reset();
+  }
+  return plan.str();
+}
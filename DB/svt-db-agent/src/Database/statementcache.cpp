@@ -0,0 +1,173 @@
+#include "Database/statementcache.h"
+
+#include <algorithm>
+#include <cctype>
+#include <string>
+
+using std::string;
+
+namespace {
+const string kNoStatement;
+} // namespace
+
+namespace {
+//! length of the $tag$ opening a dollar quoted string at pos, 0 if none.
+//! $1 is a parameter, tags do not start with a digit
+size_t dollarTag(const string &query, size_t pos) {
+  size_t end = pos + 1;
+  while (end < query.size() &&
+         (std::isalpha(static_cast<unsigned char>(query[end])) ||
+          query[end] == '_' ||
+          (end > pos + 1 &&
+           std::isdigit(static_cast<unsigned char>(query[end]))))) {
+    ++end;
+  }
+  return (end < query.size() && query[end] == '$') ? end - pos + 1 : 0;
+}
+} // namespace
+
+//========================================================================+
+string StatementCache::normalize(const string &query) {
+  string normalized;
+  normalized.reserve(query.size());
+
+  //! whitespace inside quoted literals and identifiers is kept as is,
+  //! comments are dropped first since the line end closing a -- comment
+  //! is collapsed with the rest of the whitespace
+  bool space = false;
+  size_t i = 0;
+  while (i < query.size()) {
+    const char c = query[i];
+    if (c == '-' && i + 1 < query.size() && query[i + 1] == '-') {
+      i = query.find('\n', i);
+      i = (i == string::npos) ? query.size() : i;
+      space = !normalized.empty();
+      continue;
+    }
+    if (c == '/' && i + 1 < query.size() && query[i + 1] == '*') {
+      //! block comments nest
+      int depth = 0;
+      do {
+        if (query.compare(i, 2, "/*") == 0) {
+          ++depth;
+          i += 2;
+        } else if (query.compare(i, 2, "*/") == 0) {
+          --depth;
+          i += 2;
+        } else {
+          ++i;
+        }
+      } while (depth > 0 && i < query.size());
+      space = !normalized.empty();
+      continue;
+    }
+    if (std::isspace(static_cast<unsigned char>(c))) {
+      space = !normalized.empty();
+      ++i;
+      continue;
+    }
+    if (space) {
+      normalized += ' ';
+      space = false;
+    }
+
+    size_t end = i + 1;
+    if (c == '\'' || c == '"') {
+      end = query.find(c, i + 1);
+    } else if (c == '$') {
+      const size_t tag = dollarTag(query, i);
+      if (tag) {
+        end = query.find(query.substr(i, tag), i + tag);
+        end = (end == string::npos) ? end : end + tag - 1;
+      } else {
+        end = i;
+      }
+    } else {
+      end = i;
+    }
+    //! an unterminated quote runs to the end of the statement
+    end = (end == string::npos) ? query.size() : end + 1;
+    normalized.append(query, i, end - i);
+    i = end;
+  }
+  //! a trailing ';' does not change the statement, nor the space before it
+  while (!normalized.empty() &&
+         (normalized.back() == ';' || normalized.back() == ' ')) {
+    normalized.pop_back();
+  }
+  return normalized;
+}
+
+//========================================================================+
+bool StatementCache::isCacheable(const string &query) {
+  static const char *kKeywords[] = {"SELECT", "INSERT", "UPDATE", "DELETE",
+                                    "WITH"};
+  for (const char *keyword : kKeywords) {
+    const size_t len = std::char_traits<char>::length(keyword);
+    if (query.size() > len &&
+        std::equal(keyword, keyword + len, query.begin(),
+                   [](char a, char b) {
+                     return a == std::toupper(static_cast<unsigned char>(b));
+                   }) &&
+        std::isspace(static_cast<unsigned char>(query[len]))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+//========================================================================+
+const string &StatementCache::prepare(pqxx::connection &connection,
+                                      const string &query) {
+  const string key = normalize(query);
+  if (!isCacheable(key) || mCapacity == 0) {
+    return kNoStatement;
+  }
+
+  auto it = mStatements.find(key);
+  if (it != mStatements.end()) {
+    ++mHits;
+    mLru.splice(mLru.begin(), mLru, it->second.lruPos);
+    return it->second.name;
+  }
+
+  ++mMisses;
+  //! make room first so the server never holds more than capacity
+  while (mStatements.size() >= mCapacity && !mLru.empty()) {
+    auto victim = mStatements.find(mLru.back());
+    try {
+      connection.unprepare(victim->second.name);
+    } catch (std::exception const &) {
+      //! the statement is gone with the session anyway
+    }
+    mStatements.erase(victim);
+    mLru.pop_back();
+    ++mEvictions;
+  }
+
+  Entry entry;
+  entry.name = "svt_stmt_" + std::to_string(mNextId++);
+  connection.prepare(entry.name, key);
+
+  mLru.push_front(key);
+  entry.lruPos = mLru.begin();
+  auto inserted = mStatements.emplace(key, std::move(entry)).first;
+  mSize = mStatements.size();
+  return inserted->second.name;
+}
+
+//========================================================================+
+void StatementCache::clear() {
+  mStatements.clear();
+  mLru.clear();
+  mSize = 0;
+}
+
+//========================================================================+
+void StatementCache::addStats(StatementCacheStats &stats) const {
+  stats.hits += mHits;
+  stats.misses += mMisses;
+  stats.evictions += mEvictions;
+  stats.size += mSize;
+  stats.capacity += mCapacity;
+}
@@ -6,9 +6,12 @@
  */
 
 #include "SVTDb/SvtDbInterface.h"
+#include "Database/dbtransaction.h"
+#include "SVTDb/SvtDbVersionGraph.h"
 #include "SVTDb/sqlmapi.h"
 #include "SVTUtilities/SvtUtilities.h"
 
+#include <map>
 #include <string>
 #include <vector>
 
@@ -26,32 +29,32 @@ size_t SvtDbInterface::getAllVersions(
   query.addColumn("baseVersion");
   query.addColumn("note");
 
-  rows_t rows;
-  query.doQuery(rows);
+  DbResult result;
+  query.doQuery(result);
 
-  for (const auto &row : rows)
+  for (size_t row = 0; row < result.size(); ++row)
   {
     dbVersion version;
-    version.id = row.at(0).get<int>();
-    if ((row.size() > 1) && (row.at(1) != NULL))
+    version.id = result.getInt(row, 0);
+    if (!result.isNull(row, 1))
     {
-      version.name = row.at(1).get<std::string>();
+      version.name = result.getString(row, 1);
     }
     else
     {
       version.name = std::string("NONAME_ID" + std::to_string(version.id));
     }
-    if ((row.size() > 2) && (row.at(2) != NULL))
+    if (!result.isNull(row, 2))
     {
-      version.baseVersion = row.at(2).get<int>();
+      version.baseVersion = result.getInt(row, 2);
     }
     else
     {
       version.baseVersion = -1;
     }
-    if ((row.size() > 3) && (row.at(3) != NULL))
+    if (!result.isNull(row, 3))
     {
-      version.note = row.at(3).get<std::string>();
+      version.note = result.getString(row, 3);
     }
     else
     {
@@ -59,31 +62,104 @@ size_t SvtDbInterface::getAllVersions(
     }
     versions.push_back(version);
   }
-  finishQuery(rows);
+  finishQuery(result);
 
   return versions.size();
 }
 
+//========================================================================+
+bool SvtDbInterface::createVersion(SvtDbInterface::dbVersion &version)
+{
+  SimpleInsert insert;
+
+  insert.setTableName("Version");
+  insert.addColumnAndValue("name", version.name);
+  if (version.baseVersion >= 0)
+  {
+    insert.addColumnAndValue("baseVersion", version.baseVersion);
+  }
+  insert.addColumnAndValue("note", version.note);
+  insert.addReturning("id");
+
+  DbResult result;
+  if (!insert.doInsert(result) || result.empty())
+  {
+    return false;
+  }
+  version.id = result.getInt(0, 0);
+  if (version.baseVersion < 0)
+  {
+    version.baseVersion = -1;
+  }
+  //! a rolled back version must not stay in the graph, it is added once
+  //! committed
+  if (DbTransaction *transaction = DbTransaction::current())
+  {
+    transaction->onCommit([version]() {
+      SvtDbAgent::Singleton<SvtDbVersionGraph>::instance().add(version);
+    });
+  }
+  else
+  {
+    SvtDbAgent::Singleton<SvtDbVersionGraph>::instance().add(version);
+  }
+  return true;
+}
+
+//========================================================================+
+const std::string &
+SvtDbInterface::getConfigurationKey(const std::string &tableName)
+{
+  static const std::map<std::string, std::string> keys = {
+      {"AsicConfiguration", "probeStationId"},
+      {"WpConfiguration", "wpMachineId"},
+      {"ProbeCardConfiguration", "probeCardId"}};
+
+  const auto key = keys.find(tableName);
+  if (key == keys.end())
+  {
+    raiseError(tableName + " is not a versioned configuration table");
+  }
+  return key->second;
+}
+
+//========================================================================+
+size_t SvtDbInterface::saveConfigurationDiff(
+    const std::string &tableName, int versionId,
+    const std::vector<nlohmann::json> &rows)
+{
+  VersionedBulkInsert insert;
+
+  insert.setTableName(tableName);
+  insert.addPrimaryKey(getConfigurationKey(tableName));
+  insert.setVersionId(versionId);
+  for (const auto &row : rows)
+  {
+    insert.addRow(row);
+  }
+  return insert.doInsert();
+}
+
 //========================================================================+
 size_t SvtDbInterface::getMaxId(const std::string &tableName)
 {
   std::string queryString = "SELECT MAX(ID) FROM " + SvtDbAgent::db_schema +
                             "." + "\"" + tableName + "\"";
 
-  rows_t rows;
-  doGenericQuery(queryString, rows);
+  DbResult result;
+  doGenericQuery(queryString, result);
   int maxId = -1;
 
-  if (!rows.empty())
+  if (!result.empty())
   {
-    maxId = rows.at(0).at(0).get<int>();
+    maxId = result.getInt(0, 0);
   }
   else
   {
     raiseError("Max Wafer ID returned nothing");
   }
 
-  finishQuery(rows);
+  finishQuery(result);
   return maxId;
 }
 
@@ -93,10 +169,11 @@ bool SvtDbInterface::checkIdExist(const std::string &tableName, int id)
   SimpleQuery query;
 
   query.setTableName(tableName);
+  query.setRoute(DbRoute::Replica);
   query.addWhereEquals("id", id);
   // string queryString = "SELECT 1 FROM " + full_tableName;
 
-  rows_t rows;
-  query.doQuery(rows);
-  return !rows.empty();
+  DbResult result;
+  query.doQuery(result);
+  return !result.empty();
 }
@@ -0,0 +1,193 @@
+/*!
+ * @file SvtDbPartitions.cpp
+ * @date Oct-2026
+ * @brief Range partitions of a partitioned table, created on demand
+ */
+
+#include "SVTDb/SvtDbPartitions.h"
+#include "Database/databaseinterface.h"
+#include "SVTDb/sqlmapi.h"
+#include "SVTUtilities/SvtLogger.h"
+#include "SVTUtilities/SvtUtilities.h"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+
+using SvtDbAgent::Singleton;
+
+//========================================================================+
+SvtDbRangePartitions::SvtDbRangePartitions(std::string tableName,
+                                           std::string keyColumn,
+                                           long long rangeSize)
+    : mTableName(std::move(tableName)), mKeyColumn(std::move(keyColumn)),
+      mRangeSize(std::max(rangeSize, 1LL))
+{
+}
+
+//========================================================================+
+void SvtDbRangePartitions::setRangeSize(long long rangeSize)
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  mRangeSize = std::max(rangeSize, 1LL);
+  mKnown.clear();
+}
+
+//========================================================================+
+bool SvtDbRangePartitions::isPartitioned()
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (mChecked)
+  {
+    return mPartitioned;
+  }
+
+  DbResult result;
+  doGenericQuery(
+      "SELECT EXISTS (SELECT 1 FROM pg_partitioned_table p "
+      "JOIN pg_class c ON c.oid = p.partrelid "
+      "JOIN pg_namespace n ON n.oid = c.relnamespace "
+      "WHERE n.nspname = $1 AND c.relname = $2)",
+      {std::string(SvtDbAgent::db_schema), mTableName}, result);
+  mPartitioned = !result.empty() && result.getBool(0, 0);
+  mChecked = true;
+  Singleton<SvtLogger>::instance().logInfo(
+      "Table " + mTableName +
+      (mPartitioned ? " is partitioned by " + mKeyColumn
+                    : " is not partitioned"));
+  if (mPartitioned)
+  {
+    checkRangeSize();
+  }
+  return mPartitioned;
+}
+
+//========================================================================+
+void SvtDbRangePartitions::checkRangeSize()
+{
+  //! sizes of the ranges of the existing partitions, the DEFAULT one has
+  //! no bounds
+  DbResult result;
+  doGenericQuery(
+      "SELECT DISTINCT bound[2]::bigint - bound[1]::bigint FROM ("
+      "SELECT regexp_match(pg_get_expr(c.relpartbound, c.oid), "
+      "'FROM \\((-?\\d+)\\) TO \\((-?\\d+)\\)') AS bound "
+      "FROM pg_inherits i "
+      "JOIN pg_class c ON c.oid = i.inhrelid "
+      "JOIN pg_class p ON p.oid = i.inhparent "
+      "JOIN pg_namespace n ON n.oid = p.relnamespace "
+      "WHERE n.nspname = $1 AND p.relname = $2) AS bounds "
+      "WHERE bound IS NOT NULL",
+      {std::string(SvtDbAgent::db_schema), mTableName}, result);
+  if (result.size() > 1)
+  {
+    Singleton<SvtLogger>::instance().logError(
+        "The partitions of " + mTableName + " have ranges of " +
+        std::to_string(result.size()) + " different sizes, new partitions "
+        "of " + std::to_string(mRangeSize) + " keys may overlap them");
+    return;
+  }
+  if (result.empty() || (result.getInt64(0, 0) == mRangeSize))
+  {
+    return;
+  }
+  //! the partitions of the DB are the reference, a different size would
+  //! create overlapping ranges
+  Singleton<SvtLogger>::instance().logError(
+      "The partitions of " + mTableName + " hold " +
+      std::to_string(result.getInt64(0, 0)) + " keys, not " +
+      std::to_string(mRangeSize) + ", using the size of the DB");
+  mRangeSize = std::max(result.getInt64(0, 0), 1LL);
+  mKnown.clear();
+}
+
+//========================================================================+
+void SvtDbRangePartitions::ensurePartition(long long key)
+{
+  if (!isPartitioned())
+  {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mMutex);
+  //! floor division, keys may be negative
+  long long first = key / mRangeSize * mRangeSize;
+  if (first > key)
+  {
+    first -= mRangeSize;
+  }
+  const long long next = first + mRangeSize;
+
+  //! the rows of key are written right after, the partition is created in
+  //! the transaction of the caller. A partition is known only once it is
+  //! committed: the one of key is looked up again after the commit, and
+  //! the next one is then created ahead in a short transaction of its
+  //! own, so that the DDL, which locks the whole table, is seldom held by
+  //! a request. It cannot run on another connection before the commit,
+  //! the foreign keys of the partition wait for the rows of the request
+  if (DbTransaction *transaction = DbTransaction::current())
+  {
+    if (!mKnown.count(first))
+    {
+      createPartition(first);
+    }
+    if (!mKnown.count(first) || !mKnown.count(next))
+    {
+      transaction->onCommit([this, first, next]() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (const long long start : {first, next})
+        {
+          if (!mKnown.count(start))
+          {
+            createPartition(start);
+            mKnown.insert(start);
+          }
+        }
+      });
+    }
+    return;
+  }
+
+  for (const long long start : {first, next})
+  {
+    if (!mKnown.count(start))
+    {
+      createPartition(start);
+      mKnown.insert(start);
+    }
+  }
+}
+
+//========================================================================+
+std::string SvtDbRangePartitions::getPartitionName(long long first) const
+{
+  return mTableName + "_p" + std::to_string(first);
+}
+
+//========================================================================+
+void SvtDbRangePartitions::createPartition(long long first)
+{
+  const std::string partition = addSchema(formatStr(getPartitionName(first)));
+
+  //! lookup first, the partitions of running ranges exist already
+  DbResult result;
+  doGenericQuery("SELECT to_regclass($1) IS NOT NULL", {partition}, result);
+  if (!result.empty() && result.getBool(0, 0))
+  {
+    return;
+  }
+
+  //! serialize the agents creating the same partition, the lock is held
+  //! until the end of the transaction
+  DbTransaction transaction(Singleton<DatabaseInterface>::instance());
+  doGenericQuery("SELECT pg_advisory_xact_lock(hashtext($1))", {partition},
+                 result);
+  //! DDL takes no parameters, the bounds are integers
+  doGenericQuery("CREATE TABLE IF NOT EXISTS " + partition + " PARTITION OF " +
+                     addSchema(formatStr(mTableName)) + " FOR VALUES FROM (" +
+                     std::to_string(first) + ") TO (" +
+                     std::to_string(first + mRangeSize) + ")",
+                 sql_params_t(), result);
+  transaction.commit();
+  Singleton<SvtLogger>::instance().logInfo("Created partition " + partition);
+}
@@ -0,0 +1,85 @@
+/*!
+ * @file SvtDbVersionGraph.cpp
+ * @date Oct-2026
+ * @brief In-memory copy of the Version table
+ */
+
+#include "SVTDb/SvtDbVersionGraph.h"
+#include "SVTDb/sqlmapi.h"
+
+#include <string>
+
+//========================================================================+
+void SvtDbVersionGraph::load()
+{
+  std::vector<SvtDbInterface::dbVersion> versions;
+  SvtDbInterface::getAllVersions(versions);
+
+  mBase.clear();
+  for (const auto &version : versions)
+  {
+    mBase[version.id] = version.baseVersion;
+  }
+  mLoaded = true;
+  mLoadTime = std::chrono::steady_clock::now();
+}
+
+//========================================================================+
+std::vector<int> SvtDbVersionGraph::getChain(int versionId)
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  //! created by another client since the last load. The whole table is
+  //! read under the lock, requests for ids that do not exist must not
+  //! reload it each time
+  if (!mLoaded || (!mBase.count(versionId) &&
+                   (std::chrono::steady_clock::now() - mLoadTime >=
+                    kReloadInterval)))
+  {
+    load();
+  }
+
+  std::vector<int> chain;
+  for (int id = versionId; id >= 0;)
+  {
+    const auto node = mBase.find(id);
+    if (node == mBase.end())
+    {
+      raiseError("Version ID " + std::to_string(id) +
+                 " not found when resolving the version chain");
+    }
+    //! a chain cannot be longer than the table, more is a cycle
+    if (chain.size() >= mBase.size())
+    {
+      raiseError("Version ID " + std::to_string(versionId) +
+                 " has a cycle in its base versions");
+    }
+    chain.push_back(id);
+    id = node->second;
+  }
+  return chain;
+}
+
+//========================================================================+
+int SvtDbVersionGraph::getBaseVersion(int versionId)
+{
+  const std::vector<int> chain = getChain(versionId);
+  return (chain.size() > 1) ? chain[1] : -1;
+}
+
+//========================================================================+
+void SvtDbVersionGraph::add(const SvtDbInterface::dbVersion &version)
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (mLoaded)
+  {
+    mBase[version.id] = version.baseVersion;
+  }
+}
+
+//========================================================================+
+void SvtDbVersionGraph::invalidate()
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  mLoaded = false;
+  mBase.clear();
+}
@@ -1,18 +1,24 @@
 #include "SVTDb/sqlmapi.h"
 #include "Database/databaseinterface.h"
+#include "SVTDb/SvtDbVersionGraph.h"
 #include "SVTUtilities/SvtLogger.h"
 #include "nlohmann/json.hpp"
 
+#include <algorithm>
 #include <atomic>
+#include <map>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
+#include <variant>
 
 using std::string;
 using std::vector;
 using SvtDbAgent::Singleton;
 using DatabaseIF = SvtDbAgent::Singleton<DatabaseInterface>;
 
-std::atomic<int> queryTime;
+std::atomic<long long> queryTime;
 std::atomic<int> queryCount;
 std::atomic<int> queryTrialCount;
 
@@ -22,49 +28,54 @@ std::atomic<int> queryTrialCount;
 
 //! helper function quate string
 std::string formatStr(const std::string &str) { return "\"" + str + "\""; }
+
+//! system column, no schema change is needed for the version tokens
+const char *const rowVersionColumn = "xmin";
+
 std::string addSchema(const std::string &str)
 {
   std::string schema(SvtDbAgent::db_schema);
   return schema + "." + str;
 }
 
-//! helper function for joining strings on a delimiter
+//! helper function for joining strings with a prepend
+//! on each string and a delimiter, the result is built in a single
+//! allocation
 //========================================================================+
-string stringJoin(vector<string> strings, string delimiter)
+string stringJoinPrefix(const vector<string> &strings, const string &prefix,
+                        const string &delimiter)
 {
-  string joinedString = "";
+  string joinedString;
+  if (strings.empty())
+  {
+    return joinedString;
+  }
+
+  size_t length = (strings.size() - 1) * delimiter.size() +
+                  strings.size() * prefix.size();
+  for (const auto &str : strings)
+  {
+    length += str.size();
+  }
+  joinedString.reserve(length);
 
   for (auto it = strings.begin(); it != strings.end(); ++it)
   {
-    joinedString += *it;
-    if (it != strings.end() - 1)
+    if (it != strings.begin())
     {
-      joinedString += delimiter;
+      joinedString.append(delimiter);
     }
+    joinedString.append(prefix).append(*it);
   }
 
   return joinedString;
 }
 
-//! helper function for joining strings with a prepend
-//! on each string and a delimiter
+//! helper function for joining strings on a delimiter
 //========================================================================+
-string stringJoinPrefix(vector<string> strings, string prefix,
-                        string delimiter)
+string stringJoin(const vector<string> &strings, const string &delimiter)
 {
-  string joinedString = "";
-
-  for (auto it = strings.begin(); it != strings.end(); ++it)
-  {
-    joinedString += prefix;
-    joinedString += *it;
-    if (it != strings.end() - 1)
-    {
-      joinedString += delimiter;
-    }
-  }
-
-  return joinedString;
+  return stringJoinPrefix(strings, "", delimiter);
 }
 
 /*!
@@ -72,23 +83,39 @@ string stringJoinPrefix(vector<string> strings, string prefix,
  */
 
 //========================================================================+
-void doGenericQuery(string queryString, rows_t &rows)
+void doGenericQuery(const string &queryString, DbResult &result)
+{
+  doGenericQuery(queryString, sql_params_t(), result);
+}
+
+//========================================================================+
+void doGenericQuery(const string &queryString, const sql_params_t &params,
+                    DbResult &result, DbRoute route)
 {
   bool successful = false;
-  int maxRetries = 1;
+  //! a failed statement aborts its transaction, running it again there
+  //! only fails with "current transaction is aborted"
+  int maxRetries = DbTransaction::current() ? 0 : 1;
   int nTrials = 0;
   bool connected = true;
   string errorMessage;
+  string firstError;
   // vector<vector<MultiBase*>> rows;
 
   queryCount++;
 
+  PooledConnection connection = DatabaseIF::instance().checkout(route);
+  if (!connection)
+  {
+    raiseError("doGenericQuery: no database connection available");
+  }
+
   while (connected && (!successful) && (nTrials <= maxRetries))
   {
     std::chrono::high_resolution_clock::time_point t1 =
         std::chrono::high_resolution_clock::now();
-    DatabaseIF::instance().executeQuery(queryString, successful, errorMessage,
-                                        rows);
+    DatabaseIF::instance().executeQuery(connection, queryString, params,
+                                        successful, errorMessage, result);
 
     std::chrono::high_resolution_clock::time_point t2 =
         std::chrono::high_resolution_clock::now();
@@ -97,9 +124,15 @@ void doGenericQuery(string queryString, rows_t &rows)
     queryTime += ms.count();
     queryTrialCount++;
     nTrials++;
+    if (!successful && firstError.empty())
+    {
+      firstError = errorMessage;
+    }
     if ((!successful) && (nTrials <= maxRetries))
     {
-      connected = DatabaseIF::instance().isConnected();
+      connected = DatabaseIF::instance().isConnected() &&
+                  !DatabaseIF::instance().isUnavailable() &&
+                  !DbDeadline::isExpired();
       if (!connected)
       {
         Singleton<SvtLogger>::instance().logError("reconnect failed");
@@ -108,9 +141,78 @@ void doGenericQuery(string queryString, rows_t &rows)
   }
   if (!successful)
   {
+    //! the first error tells the cause, a retry may only fail on its
+    //! consequences
+    result.clear();
+    raiseError(firstError);
+  }
+}
+
+//========================================================================+
+void doGenericStream(const string &queryString, const sql_params_t &params,
+                     size_t batchSize, const DbStreamCallback &callback,
+                     DbRoute route)
+{
+  bool successful = false;
+  string errorMessage;
+
+  queryCount++;
+
+  PooledConnection connection = DatabaseIF::instance().checkout(route);
+  if (!connection)
+  {
+    raiseError("doGenericStream: no database connection available");
+  }
+
+  std::chrono::high_resolution_clock::time_point t1 =
+      std::chrono::high_resolution_clock::now();
+  //! no retry, batches may already have been consumed
+  DatabaseIF::instance().executeStream(connection, queryString, params,
+                                       batchSize, callback, successful,
+                                       errorMessage);
+  std::chrono::high_resolution_clock::time_point t2 =
+      std::chrono::high_resolution_clock::now();
+  queryTime +=
+      std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
+  queryTrialCount++;
+
+  if (!successful)
+  {
+    raiseError(errorMessage);
+  }
+}
+
+//========================================================================+
+bool doGenericUpdate(const string &insertString, const sql_params_t &params,
+                     DbResult &result)
+{
+  bool successful = false;
+  string errorMessage;
+
+  queryCount++;
+
+  PooledConnection connection = DatabaseIF::instance().checkout();
+  if (!connection)
+  {
+    raiseError("doGenericUpdate: no database connection available");
+  }
+
+  std::chrono::high_resolution_clock::time_point t1 =
+      std::chrono::high_resolution_clock::now();
+  DatabaseIF::instance().executeQuery(connection, insertString, params,
+                                      successful, errorMessage, result);
+  std::chrono::high_resolution_clock::time_point t2 =
+      std::chrono::high_resolution_clock::now();
+  queryTime +=
+      std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
+  queryTrialCount++;
+
+  if (!successful)
+  {
+    result.clear();
     raiseError(errorMessage);
-    rows.clear();
   }
+  return successful;
 }
 
 //========================================================================+
@@ -118,73 +220,729 @@ void raiseError(string errorMessage)
 {
   // std::cout << errorMessage << std::endl;
   Singleton<SvtLogger>::instance().logError(errorMessage);
+  if (DatabaseIF::instance().isUnavailable())
+  {
+    throw DbUnavailableError(errorMessage);
+  }
+  //! whatever failed, the request has no time left to retry
+  if (DbDeadline::isExpired())
+  {
+    throw DbTimeoutError(errorMessage);
+  }
+  if (errorMessage.rfind(kDbRetryableMessage, 0) == 0)
+  {
+    throw DbRetryableError(errorMessage);
+  }
   throw std::runtime_error(errorMessage);
 }
 
 //========================================================================+
-void finishQuery(rows_t rows) { DatabaseIF::instance().clearQueryResult(rows); }
+void finishQuery(DbResult &result) { result.clear(); }
+
+//========================================================================+
+bool toSqlParam(const nlohmann::basic_json<> &value, sql_param_t &param)
+{
+  if (value.is_number_integer())
+  {
+    param = value.get<long long>();
+  }
+  else if (value.is_string())
+  {
+    param = value.get<std::string>();
+  }
+  else if (value.is_number_float())
+  {
+    param = value.get<double>();
+  }
+  else if (value.is_boolean())
+  {
+    param = value.get<bool>();
+  }
+  else
+  {
+    return false;
+  }
+  return true;
+}
+
+//========================================================================+
+bool ParameterBinder::bind(const nlohmann::basic_json<> &value,
+                           string &placeholder)
+{
+  sql_param_t param;
+  if (!toSqlParam(value, param))
+  {
+    return false;
+  }
+  placeholder = bind(std::move(param));
+  return true;
+}
+
+/*!
+ * Condition tree
+ */
+
+//========================================================================+
+SqlCondition SqlCondition::compare(string column, Op op, sql_param_t value)
+{
+  SqlCondition condition;
+  condition.mOp = op;
+  condition.mColumn = std::move(column);
+  condition.mValues.push_back(std::move(value));
+  return condition;
+}
+
+//========================================================================+
+SqlCondition SqlCondition::between(string column, sql_param_t low,
+                                   sql_param_t high)
+{
+  SqlCondition condition;
+  condition.mOp = Op::Between;
+  condition.mColumn = std::move(column);
+  condition.mValues.push_back(std::move(low));
+  condition.mValues.push_back(std::move(high));
+  return condition;
+}
+
+//========================================================================+
+SqlCondition SqlCondition::any(string column, vector<long long> values)
+{
+  SqlCondition condition;
+  condition.mOp = Op::Any;
+  condition.mColumn = std::move(column);
+  for (const auto value : values)
+  {
+    condition.mValues.push_back(value);
+  }
+  return condition;
+}
+
+//========================================================================+
+SqlCondition SqlCondition::any(string column, vector<string> values)
+{
+  SqlCondition condition;
+  condition.mOp = Op::Any;
+  condition.mColumn = std::move(column);
+  for (auto &value : values)
+  {
+    condition.mValues.push_back(std::move(value));
+  }
+  return condition;
+}
+
+//========================================================================+
+SqlCondition SqlCondition::isNull(string column, bool null)
+{
+  SqlCondition condition;
+  condition.mOp = null ? Op::IsNull : Op::IsNotNull;
+  condition.mColumn = std::move(column);
+  return condition;
+}
+
+//========================================================================+
+SqlCondition SqlCondition::allOf(vector<SqlCondition> children)
+{
+  SqlCondition condition;
+  condition.mOp = Op::And;
+  condition.mChildren = std::move(children);
+  return condition;
+}
+
+//========================================================================+
+SqlCondition SqlCondition::anyOf(vector<SqlCondition> children)
+{
+  SqlCondition condition;
+  condition.mOp = Op::Or;
+  condition.mChildren = std::move(children);
+  return condition;
+}
+
+//========================================================================+
+SqlCondition SqlCondition::negate(SqlCondition child)
+{
+  SqlCondition condition;
+  condition.mOp = Op::Not;
+  condition.mChildren.push_back(std::move(child));
+  return condition;
+}
+
+//========================================================================+
+bool SqlCondition::fromJson(const string &column,
+                            const nlohmann::basic_json<> &value,
+                            SqlCondition &condition)
+{
+  if (value.is_null())
+  {
+    condition = isNull(column);
+    return true;
+  }
+
+  if (value.is_array())
+  {
+    vector<long long> numbers;
+    vector<string> strings;
+    for (const auto &item : value)
+    {
+      if (item.is_number_integer())
+      {
+        numbers.push_back(item.get<long long>());
+      }
+      else if (item.is_string())
+      {
+        strings.push_back(item.get<string>());
+      }
+      else
+      {
+        return false;
+      }
+    }
+    //! the values are bound as one array of a single type
+    if (!numbers.empty() && !strings.empty())
+    {
+      return false;
+    }
+    condition = strings.empty() ? any(column, std::move(numbers))
+                                : any(column, std::move(strings));
+    return true;
+  }
+
+  if (!value.is_object())
+  {
+    sql_param_t param;
+    if (!toSqlParam(value, param))
+    {
+      return false;
+    }
+    condition = compare(column, Op::Eq, std::move(param));
+    return true;
+  }
+
+  static const std::map<string, Op> operators = {
+      {"eq", Op::Eq}, {"ne", Op::Ne}, {"lt", Op::Lt},
+      {"le", Op::Le}, {"gt", Op::Gt}, {"ge", Op::Ge}};
+
+  vector<SqlCondition> children;
+  for (const auto &item : value.items())
+  {
+    const auto op = operators.find(item.key());
+    SqlCondition child;
+    if (op != operators.end())
+    {
+      sql_param_t param;
+      if (!toSqlParam(item.value(), param))
+      {
+        return false;
+      }
+      child = compare(column, op->second, std::move(param));
+    }
+    else if (item.key() == "between")
+    {
+      sql_param_t low;
+      sql_param_t high;
+      if (!item.value().is_array() || (item.value().size() != 2) ||
+          !toSqlParam(item.value()[0], low) ||
+          !toSqlParam(item.value()[1], high))
+      {
+        return false;
+      }
+      child = between(column, std::move(low), std::move(high));
+    }
+    else if (item.key() == "in")
+    {
+      if (!item.value().is_array() ||
+          !fromJson(column, item.value(), child))
+      {
+        return false;
+      }
+    }
+    else if ((item.key() == "null") && item.value().is_boolean())
+    {
+      child = isNull(column, item.value().get<bool>());
+    }
+    else
+    {
+      return false;
+    }
+    children.push_back(std::move(child));
+  }
+  if (children.empty())
+  {
+    return false;
+  }
+  condition = (children.size() == 1) ? std::move(children.front())
+                                     : allOf(std::move(children));
+  return true;
+}
+
+namespace
+{
+  //! order of a column value and a bound value, std::nullopt for NULL and
+  //! for values that cannot be compared
+  std::optional<int> compareValue(const nlohmann::basic_json<> *value,
+                                  const sql_param_t &param)
+  {
+    if ((value == nullptr) || value->is_null() ||
+        std::holds_alternative<std::nullptr_t>(param))
+    {
+      return std::nullopt;
+    }
+    const nlohmann::basic_json<> other = std::visit(
+        [](const auto &v) -> nlohmann::basic_json<>
+        {
+          if constexpr (std::is_same_v<std::decay_t<decltype(v)>,
+                                       std::nullptr_t>)
+          {
+            return nullptr;
+          }
+          else
+          {
+            return v;
+          }
+        },
+        param);
+    if (value->is_number() && other.is_number())
+    {
+      const double a = value->get<double>();
+      const double b = other.get<double>();
+      return (a < b) ? -1 : ((b < a) ? 1 : 0);
+    }
+    if ((value->is_string() && other.is_string()) ||
+        (value->is_boolean() && other.is_boolean()))
+    {
+      return (*value < other) ? -1 : ((other < *value) ? 1 : 0);
+    }
+    return std::nullopt;
+  }
+}  // namespace
+
+//========================================================================+
+bool SqlCondition::matches(const ColumnLookup &lookup) const
+{
+  return evaluate(lookup).value_or(false);
+}
+
+//========================================================================+
+std::optional<bool> SqlCondition::evaluate(const ColumnLookup &lookup) const
+{
+  switch (mOp)
+  {
+  case Op::And:
+  case Op::Or:
+  {
+    //! AND is false as soon as a child is false, OR is true as soon as a
+    //! child is true, unknown otherwise if a child is unknown
+    const bool stop = (mOp == Op::Or);
+    bool unknown = false;
+    for (const auto &child : mChildren)
+    {
+      const auto result = child.evaluate(lookup);
+      if (!result)
+      {
+        unknown = true;
+      }
+      else if (*result == stop)
+      {
+        return stop;
+      }
+    }
+    return unknown ? std::nullopt : std::optional<bool>(!stop);
+  }
+  case Op::Not:
+  {
+    const auto result = mChildren.at(0).evaluate(lookup);
+    return result ? std::optional<bool>(!*result) : std::nullopt;
+  }
+  case Op::IsNull:
+  case Op::IsNotNull:
+  {
+    const auto *value = lookup(mColumn);
+    const bool null = (value == nullptr) || value->is_null();
+    return null == (mOp == Op::IsNull);
+  }
+  case Op::Between:
+  {
+    const auto *value = lookup(mColumn);
+    const auto low = compareValue(value, mValues.at(0));
+    const auto high = compareValue(value, mValues.at(1));
+    if (!low || !high)
+    {
+      return std::nullopt;
+    }
+    return (*low >= 0) && (*high <= 0);
+  }
+  case Op::Any:
+  {
+    const auto *value = lookup(mColumn);
+    bool unknown = false;
+    for (const auto &param : mValues)
+    {
+      const auto order = compareValue(value, param);
+      if (!order)
+      {
+        unknown = true;
+      }
+      else if (*order == 0)
+      {
+        return true;
+      }
+    }
+    return unknown ? std::nullopt : std::optional<bool>(false);
+  }
+  default:
+    break;
+  }
+
+  const auto order = compareValue(lookup(mColumn), mValues.at(0));
+  if (!order)
+  {
+    return std::nullopt;
+  }
+  switch (mOp)
+  {
+  case Op::Eq:
+    return *order == 0;
+  case Op::Ne:
+    return *order != 0;
+  case Op::Lt:
+    return *order < 0;
+  case Op::Le:
+    return *order <= 0;
+  case Op::Gt:
+    return *order > 0;
+  default:
+    return *order >= 0;
+  }
+}
+
+//========================================================================+
+void SimpleQuery::doQuery(DbResult &result)
+{
+  return doGenericQuery(getQueryString(), mParams, result, mRoute);
+}
+
+//========================================================================+
+void SimpleQuery::doStream(size_t batchSize, const DbStreamCallback &callback)
+{
+  return doGenericStream(getQueryString(), mParams, batchSize, callback,
+                         mRoute);
+}
 
 //========================================================================+
-void SimpleQuery::doQuery(rows_t &rows)
+void SimpleQuery::doJsonQuery(const vector<bool> &asText, DbResult &result)
 {
+  if (mColumnNames.size() > kMaxJsonColumns)
+  {
+    raiseError("SimpleQuery::doJsonQuery: too many columns in " + mTableName);
+  }
+  return doGenericQuery(getJsonQueryString(asText), mParams, result, mRoute);
+}
+
+//========================================================================+
+string SimpleQuery::getJsonQueryString(const vector<bool> &asText) const
+{
+  string object = "json_build_object(";
+  for (size_t col = 0; col < mColumnKeys.size(); ++col)
+  {
+    if (col)
+    {
+      object += ", ";
+    }
+    //! the key is a string literal
+    string key = mColumnKeys[col];
+    for (size_t pos = key.find('\''); pos != string::npos;
+         pos = key.find('\'', pos + 2))
+    {
+      key.insert(pos, 1, '\'');
+    }
+    object += "'" + key + "', items." + formatStr(mColumnKeys[col]);
+    if ((col < asText.size()) && asText[col])
+    {
+      object += "::text";
+    }
+  }
+  object += ")";
+
+  //! the inner query keeps the filter, the order and the page, the order
+  //! is repeated in the aggregate which does not inherit it. Orders on
+  //! other columns are carried by the row number
+  const bool rowNumber = !mOrderBy.empty();
+  string queryString = "SELECT COALESCE(json_agg(" + object;
+  if (rowNumber)
+  {
+    queryString += " ORDER BY items.\"rowNumber\"";
+  }
+  else if (mOrderById)
+  {
+    queryString += " ORDER BY items.id";
+  }
+  queryString += "), '[]'::json), COUNT(*)";
+  if (mTotalCount)
+  {
+    queryString += ", MAX(items.\"totalCount\")";
+  }
+  queryString += " FROM (" + getQueryString(rowNumber) + ") AS items";
+  return queryString;
+}
+
+//========================================================================+
+string SimpleQuery::getQueryString(bool rowNumber) const
+{
+  //! with the total count the keyset is applied around the query, on the
+  //! output columns
+  const bool wrapped = !mKeysetColumn.empty() && mTotalCount;
+
+  vector<string> whereClauses = mWhereClauses;
+  if (!mKeysetColumn.empty() && !wrapped)
+  {
+    whereClauses.push_back(formatColumn(mKeysetColumn) + " > " +
+                           mKeysetValue);
+  }
+
+  vector<string> innerOrder;
+  vector<string> outerOrder;
+  for (const auto &order : mOrderBy)
+  {
+    innerOrder.push_back(order.first);
+    outerOrder.push_back(order.second);
+  }
+  if (mOrderById)
+  {
+    innerOrder.push_back(formatColumn("id"));
+    outerOrder.push_back("id");
+  }
+
   string queryString = "";
   queryString += "SELECT " + stringJoin(mColumnNames, ", ");
+  if (mTotalCount)
+  {
+    queryString += ", COUNT(*) OVER() AS \"totalCount\"";
+  }
+  if (rowNumber && !innerOrder.empty())
+  {
+    queryString += ", ROW_NUMBER() OVER (ORDER BY " +
+                   stringJoin(innerOrder, ", ") + ") AS \"rowNumber\"";
+  }
   queryString += " FROM " + addSchema(mTableName);
-  if (!mWhereClauses.empty())
+  if (!mJoins.empty())
   {
-    queryString += " WHERE " + stringJoin(mWhereClauses, " AND ");
+    queryString += " " + stringJoin(mJoins, " ");
   }
-  if (mOrderById)
+  if (!whereClauses.empty())
+  {
+    queryString += " WHERE " + stringJoin(whereClauses, " AND ");
+  }
+  //! the window is evaluated before the keyset so that the count covers
+  //! all filtered rows
+  if (wrapped)
+  {
+    queryString = "SELECT * FROM (" + queryString + ") AS page WHERE " +
+                  formatStr(mKeysetColumn) + " > " + mKeysetValue;
+  }
+  if (!innerOrder.empty())
+  {
+    queryString += " ORDER BY " +
+                   stringJoin(wrapped ? outerOrder : innerOrder, ", ") + " ";
+  }
+  if (!mLimit.empty())
+  {
+    queryString += " LIMIT " + mLimit;
+  }
+  if (!mOffset.empty())
   {
-    queryString += " ORDER BY id ";
+    queryString += " OFFSET " + mOffset;
   }
-  return doGenericQuery(queryString, rows);
+  return queryString;
 }
 
 //========================================================================+
-void SimpleQuery::addWhereEquals(string columnName,
-                                 const nlohmann::basic_json<> &value)
+string SimpleQuery::formatColumn(const string &columnName) const
+{
+  const size_t dot = columnName.find('.');
+  if (dot != string::npos)
+  {
+    return formatStr(columnName.substr(0, dot)) + "." +
+           formatStr(columnName.substr(dot + 1));
+  }
+  if (mJoins.empty())
+  {
+    return formatStr(columnName);
+  }
+  return mTableName + "." + formatStr(columnName);
+}
+
+//========================================================================+
+void SimpleQuery::addJoin(string tableName, string alias, string leftColumn,
+                          string rightColumn, JoinType type)
 {
-  if (!value.is_null())
+  //! the main table is qualified even for the first join
+  const auto qualified = [this](const string &column) {
+    return (column.find('.') == string::npos)
+               ? mTableName + "." + formatStr(column)
+               : formatColumn(column);
+  };
+  string join = (type == JoinType::Left) ? "LEFT JOIN " : "JOIN ";
+  join += addSchema(formatStr(tableName)) + " AS " + formatStr(alias);
+  join += " ON " + qualified(leftColumn) + " = " + qualified(rightColumn);
+  mJoins.push_back(join);
+}
+
+//========================================================================+
+void SimpleQuery::addOrderBy(string columnName, bool descending)
+{
+  const string direction = descending ? " DESC" : " ASC";
+  //! around the query the column is referenced by its output name
+  mOrderBy.emplace_back(formatColumn(columnName) + direction,
+                        formatStr(columnName) + direction);
+}
+
+//========================================================================+
+string SimpleQuery::render(const SqlCondition &condition)
+{
+  using Op = SqlCondition::Op;
+  static const std::map<Op, string> operators = {
+      {Op::Eq, " = "}, {Op::Ne, " <> "}, {Op::Lt, " < "},
+      {Op::Le, " <= "}, {Op::Gt, " > "}, {Op::Ge, " >= "}};
+
+  switch (condition.mOp)
   {
-    if (value.is_number_integer())
+  case Op::Eq:
+  case Op::Ne:
+  case Op::Lt:
+  case Op::Le:
+  case Op::Gt:
+  case Op::Ge:
+    return formatColumn(condition.mColumn) + operators.at(condition.mOp) +
+           bind(condition.mValues.at(0));
+  case Op::Between:
+  {
+    const string low = bind(condition.mValues.at(0));
+    return formatColumn(condition.mColumn) + " BETWEEN " + low + " AND " +
+           bind(condition.mValues.at(1));
+  }
+  case Op::Any:
+  {
+    if (condition.mValues.empty())
     {
-      addWhereEquals(columnName, value.get<int>());
+      return "FALSE";
     }
-    else if (value.is_string())
+    //! one array literal, the server infers its type from the column
+    string array = "{";
+    for (size_t i = 0; i < condition.mValues.size(); ++i)
+    {
+      if (i)
+      {
+        array += ",";
+      }
+      const auto &value = condition.mValues[i];
+      if (std::holds_alternative<long long>(value))
+      {
+        array += std::to_string(std::get<long long>(value));
+        continue;
+      }
+      array += "\"";
+      for (const char c : std::get<string>(value))
+      {
+        if ((c == '"') || (c == '\\'))
+        {
+          array += '\\';
+        }
+        array += c;
+      }
+      array += "\"";
+    }
+    array += "}";
+    return formatColumn(condition.mColumn) + " = ANY(" +
+           bind(std::move(array)) + ")";
+  }
+  case Op::IsNull:
+    return formatColumn(condition.mColumn) + " IS NULL";
+  case Op::IsNotNull:
+    return formatColumn(condition.mColumn) + " IS NOT NULL";
+  case Op::And:
+  case Op::Or:
+  {
+    if (condition.mChildren.empty())
     {
-      addWhereEquals(columnName, value.get<std::string>());
+      return (condition.mOp == Op::And) ? "TRUE" : "FALSE";
     }
-    else if (value.is_number_float())
+    vector<string> children;
+    for (const auto &child : condition.mChildren)
     {
-      addWhereEquals(columnName, value.get<float>());
+      children.push_back(render(child));
     }
+    return "(" +
+           stringJoin(children, (condition.mOp == Op::And) ? " AND " : " OR ") +
+           ")";
+  }
+  case Op::Not:
+    return "NOT (" + render(condition.mChildren.at(0)) + ")";
+  }
+  return "FALSE";
+}
+
+//========================================================================+
+void SimpleQuery::addWhereEquals(string columnName,
+                                 const nlohmann::basic_json<> &value)
+{
+  std::string placeholder;
+  if (bind(value, placeholder))
+  {
+    mWhereClauses.push_back(formatColumn(columnName) + " = " + placeholder);
   }
 }
 
+//========================================================================+
+void SimpleQuery::addWhereInSelect(string columnName, string tableName,
+                                   string alias, string selectColumn,
+                                   const SqlCondition &condition)
+{
+  //! the columns of condition are qualified by alias, which hides the
+  //! joined table of the same name
+  const string select = "SELECT " + formatStr(alias) + "." +
+                        formatStr(selectColumn) + " FROM " +
+                        addSchema(formatStr(tableName)) + " AS " +
+                        formatStr(alias) + " WHERE " + render(condition);
+  mWhereClauses.push_back(formatColumn(columnName) + " = ANY(ARRAY(" + select +
+                          "))");
+}
+
 //========================================================================+
 void SimpleQuery::addWhereIn(string columnName, vector<int> values)
 {
   if (values.size() == 0)
     return;
-  string clause = columnName + " IN (";
+  //! the whole list is a single array parameter
+  string array = "{";
   for (unsigned int i = 0; i < values.size(); i++)
   {
-    clause += std::to_string(values.at(i));
+    array += std::to_string(values.at(i));
     if (i < values.size() - 1)
-      clause += ",";
+      array += ",";
   }
-  clause += ")";
-  mWhereClauses.push_back(clause);
+  array += "}";
+  mWhereClauses.push_back(formatColumn(columnName) + " = ANY(" +
+                          bind(std::move(array)) + "::integer[])");
+}
+
+//========================================================================+
+bool doGenericUpdate(const string &insertString)
+{
+  return doGenericUpdate(insertString, sql_params_t());
 }
 
 //========================================================================+
-bool doGenericUpdate(string insertString)
+bool doGenericUpdate(const string &insertString, const sql_params_t &params)
 {
   bool successful;
   string errorMessage;
 
-  successful = DatabaseIF::instance().executeUpdate(insertString, errorMessage);
+  PooledConnection connection = DatabaseIF::instance().checkout();
+  if (!connection)
+  {
+    raiseError("doGenericUpdate: no database connection available");
+  }
+  successful = DatabaseIF::instance().executeUpdate(connection, insertString,
+                                                    params, errorMessage);
 
   if (!successful)
   {
@@ -195,41 +953,96 @@ bool doGenericUpdate(string insertString)
 }
 
 //========================================================================+
-void commitUpdate() { DatabaseIF::instance().commitUpdate(true); }
+bool SimpleInsert::doInsert()
+{
+  return doGenericUpdate(getInsertString(), mParams);
+}
 
 //========================================================================+
-void rollbackUpdate() { DatabaseIF::instance().commitUpdate(false); }
+bool SimpleInsert::doInsert(DbResult &result)
+{
+  return doGenericUpdate(getInsertString(), mParams, result);
+}
 
 //========================================================================+
-bool SimpleInsert::doInsert()
+string SimpleInsert::getInsertString() const
 {
   string insertString = "";
   insertString += "INSERT INTO " + addSchema(mTableName);
   insertString += " (" + stringJoin(mColumnNames, ", ") + ")";
   insertString += " VALUES(" + stringJoin(mValues, ", ") + ")";
-
-  return doGenericUpdate(insertString);
+  if (!mReturning.empty())
+  {
+    insertString += " RETURNING " + stringJoin(mReturning, ", ");
+  }
+  return insertString;
 }
 
 //========================================================================+
-void SimpleInsert::addColumnAndValue(string columnName,
-                                     const nlohmann::basic_json<> &value)
+void BulkInsert::addRow(const vector<nlohmann::basic_json<>> &values)
 {
-  if (!value.is_null())
+  if (values.size() != mColumnNames.size())
+  {
+    raiseError("BulkInsert::addRow: row size unmatches column list size");
+  }
+
+  sql_copy_row_t row;
+  row.reserve(values.size());
+  for (const auto &value : values)
   {
-    if (value.is_number_integer())
+    if (value.is_null())
     {
-      addColumnAndValue(columnName, value.get<int>());
+      row.emplace_back(std::nullopt);
     }
     else if (value.is_string())
     {
-      addColumnAndValue(columnName, value.get<std::string>());
+      row.emplace_back(value.get<string>());
+    }
+    else if (value.is_boolean())
+    {
+      row.emplace_back(value.get<bool>() ? "t" : "f");
     }
-    else if (value.is_number_float())
+    else if (value.is_number())
     {
-      addColumnAndValue(columnName, value.get<float>());
+      row.emplace_back(value.dump());
+    }
+    else
+    {
+      raiseError("BulkInsert::addRow: unsupported value " + value.dump());
     }
   }
+  mRows.push_back(std::move(row));
+}
+
+//========================================================================+
+bool BulkInsert::doInsert()
+{
+  PooledConnection connection = DatabaseIF::instance().checkout();
+  if (!connection)
+  {
+    raiseError("BulkInsert: no database connection available");
+  }
+
+  string errorMessage;
+  if (!DatabaseIF::instance().executeCopy(connection, addSchema(mTableName),
+                                          stringJoin(mColumnNames, ", "),
+                                          mRows, errorMessage))
+  {
+    raiseError(errorMessage);
+  }
+  return true;
+}
+
+//========================================================================+
+void SimpleInsert::addColumnAndValue(string columnName,
+                                     const nlohmann::basic_json<> &value)
+{
+  std::string placeholder;
+  if (bind(value, placeholder))
+  {
+    mColumnNames.push_back(formatStr(columnName));
+    mValues.push_back(placeholder);
+  }
 }
 
 //========================================================================+
@@ -242,27 +1055,63 @@ bool SimpleUpdate::doUpdate()
   {
     queryString += " WHERE " + stringJoin(mWhereClauses, " AND ");
   }
-  return doGenericUpdate(queryString);
+  return doGenericUpdate(queryString, mParams);
+}
+
+//========================================================================+
+void SimpleUpdate::doUpdate(DbResult &result)
+{
+  if (mWhereClauses.empty() || mReturning.empty())
+  {
+    raiseError("SimpleUpdate: update of " + mTableName +
+               " returning a row without WHERE or RETURNING");
+  }
+  const string tableName = addSchema(mTableName);
+  const string where = stringJoin(mWhereClauses, " AND ");
+  string matchWhere = where;
+  if (!mRowVersion.empty())
+  {
+    matchWhere += string(" AND ") + rowVersionColumn + " = " + mRowVersion +
+                  "::xid";
+  }
+  const string returning = stringJoin(mReturning, ", ") + ", " +
+                           rowVersionColumn + "::text AS \"version\"";
+
+  string matched;
+  if (mColumnNamesAndValues.empty())
+  {
+    matched = "SELECT " + returning + " FROM " + tableName + " WHERE " +
+              matchWhere;
+  }
+  else
+  {
+    matched = "UPDATE " + tableName + " SET " +
+              stringJoin(mColumnNamesAndValues, ", ") + " WHERE " +
+              matchWhere + " RETURNING " + returning;
+  }
+  //! the row is looked up again in the snapshot of the statement to tell a
+  //! missing row from a changed one
+  string queryString = "WITH matched AS (" + matched + ")";
+  queryString += " SELECT matched.*, EXISTS (SELECT 1 FROM " + tableName +
+                 " WHERE " + where + ") AS \"found\"";
+  queryString += " FROM (VALUES (1)) AS one LEFT JOIN matched ON true";
+  doGenericUpdate(queryString, mParams, result);
+  if (result.size() != 1)
+  {
+    raiseError("SimpleUpdate: update of " + mTableName + " matched " +
+               std::to_string(result.size()) + " rows");
+  }
 }
 
 //========================================================================+
 void SimpleUpdate::addColumnAndValue(string columnName,
                                      const nlohmann::basic_json<> &value)
 {
-  if (!value.is_null())
+  std::string placeholder;
+  if (bind(value, placeholder))
   {
-    if (value.is_number_integer())
-    {
-      addColumnAndValue(columnName, value.get<int>());
-    }
-    else if (value.is_string())
-    {
-      addColumnAndValue(columnName, value.get<std::string>());
-    }
-    else if (value.is_number_float())
-    {
-      addColumnAndValue(columnName, value.get<float>());
-    }
+    mColumnNamesAndValues.push_back(formatStr(columnName) + " = " +
+                                    placeholder);
   }
 }
 
@@ -270,20 +1119,10 @@ void SimpleUpdate::addColumnAndValue(string columnName,
 void SimpleUpdate::addWhereEquals(string columnName,
                                   const nlohmann::basic_json<> &value)
 {
-  if (!value.is_null())
+  std::string placeholder;
+  if (bind(value, placeholder))
   {
-    if (value.is_number_integer())
-    {
-      addWhereEquals(columnName, value.get<int>());
-    }
-    else if (value.is_string())
-    {
-      addWhereEquals(columnName, value.get<std::string>());
-    }
-    else if (value.is_number_float())
-    {
-      addWhereEquals(columnName, value.get<float>());
-    }
+    mWhereClauses.push_back(formatStr(columnName) + " = " + placeholder);
   }
 }
 
@@ -291,89 +1130,195 @@ void SimpleUpdate::addWhereEquals(string columnName,
  * Versioning
  */
 
-//========================================================================+
-void VersionedQuery::doQuery(rows_t &rows)
+namespace
 {
-  // perhaps this should be folded into the main query?
-  int baseVersionId = getBaseVersion(mVersionId);
+  //! postgres array literal of ids
+  string intArray(const vector<int> &values)
+  {
+    string array = "{";
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+      if (i)
+      {
+        array += ",";
+      }
+      array += std::to_string(values[i]);
+    }
+    return array + "}";
+  }
 
-  // the goal of this is to generalize the ability to query a table for a
-  // particular version and to return the combination of the base and diff
-  // versions that correspond to the given version see docs/versioning.md for a
-  // more detailed explanation
-  string queryString = "";
-  // subquery on version first
-  queryString += "WITH T0 AS (SELECT *";
-  queryString += " FROM " + addSchema(mTableName);
-  queryString += " WHERE versionId IN (" + std::to_string(baseVersionId) + "," +
-                 std::to_string(mVersionId) + ")";
-  if (!mWhereClauses.empty())
+  //! rows of table resolved over a version chain, for each primary key
+  //! the row of the highest version id: a version always has a higher id
+  //! than its base
+  string resolvedVersionSelect(const string &tableName,
+                               const vector<string> &primaryKeys,
+                               const string &chain,
+                               const vector<string> &whereClauses)
   {
-    queryString += " AND " + stringJoin(mWhereClauses, " AND ");
+    const string pks = stringJoin(primaryKeys, ", ");
+    string queryString = "SELECT DISTINCT ON (" + pks + ") *";
+    queryString += " FROM " + addSchema(tableName);
+    queryString += " WHERE \"versionId\" = ANY(" + chain + "::integer[])";
+    for (const auto &whereClause : whereClauses)
+    {
+      queryString += " AND " + whereClause;
+    }
+    queryString += " ORDER BY " + pks + ", \"versionId\" DESC";
+    return queryString;
   }
-  queryString += ")";
-  // select rows with the diff version if it exists and the base version if it
-  // doesn't
-  queryString += " SELECT " + stringJoinPrefix(mColumnNames, "T1.", ", ");
-  queryString += " FROM T0 T1";
-  queryString += " LEFT OUTER JOIN T0 T2";
-  queryString += " ON T1.versionId < T2.versionId";
-  queryString += " AND " + getPkString();
-  queryString += " WHERE T2." + mPrimaryKeys.at(0) + " IS NULL";
+}  // namespace
 
-  return doGenericQuery(queryString, rows);
+//========================================================================+
+void VersionedQuery::doQuery(DbResult &result)
+{
+  if (mPrimaryKeys.empty())
+  {
+    raiseError("VersionedQuery: no primary key for " + mTableName);
+  }
+  const vector<int> chain =
+      Singleton<SvtDbVersionGraph>::instance().getChain(mVersionId);
+
+  //! one pass over the rows of the whole chain
+  string queryString =
+      "SELECT " + stringJoinPrefix(mColumnNames, "resolved.", ", ");
+  queryString += " FROM (" +
+                 resolvedVersionSelect(mTableName, mPrimaryKeys,
+                                       bind(intArray(chain)), mWhereClauses) +
+                 ") AS resolved";
+
+  return doGenericQuery(queryString, mParams, result, mRoute);
 }
 
 //========================================================================+
 bool VersionedInsert::doInsert()
 {
-  // perhaps this should be folded into the main query?
-  int baseVersionId = getBaseVersion(mVersionId);
-
-  // look for the exact row to insert but with the base version ID instead
-  mQuery.setTableName(mTableName);
-  mQuery.addColumn("COUNT(*)");
-  // the rest of the where clauses are added when calling addColumnAndValue
-  mQuery.addWhereEquals("versionId", baseVersionId);
+  if (mPrimaryKeys.empty())
+  {
+    raiseError("VersionedInsert: no primary key for " + mTableName);
+  }
+  vector<int> baseChain =
+      Singleton<SvtDbVersionGraph>::instance().getChain(mVersionId);
+  baseChain.erase(baseChain.begin());
 
-  rows_t rows;
-  mQuery.doQuery(rows);
-  int rowCount = rows.at(0).at(0).get<int>();
-  finishQuery(rows);
+  //! the row of the base version with the same primary key
+  vector<string> pkClauses;
+  for (const auto &pk : mPrimaryKeys)
+  {
+    pkClauses.push_back(pk + " = entry." + pk);
+  }
+  //! every column but the version must match to skip the row
+  vector<string> sameClauses;
+  for (const auto &column : mColumnNames)
+  {
+    if (column != formatStr("versionId"))
+    {
+      sameClauses.push_back("base." + column +
+                            " IS NOT DISTINCT FROM entry." + column);
+    }
+  }
 
-  bool insertSuccessful = true;
-  // if no such row exists, do the insert
-  if (rowCount == 0)
+  const string row = bind(mRow.dump());
+  const string chain = bind(intArray(baseChain));
+  string insertString = "INSERT INTO " + addSchema(mTableName);
+  insertString += " (" + stringJoin(mColumnNames, ", ") + ")";
+  insertString += " SELECT " + stringJoinPrefix(mColumnNames, "entry.", ", ");
+  insertString += " FROM json_populate_record(NULL::" +
+                  addSchema(mTableName) + ", " + row + "::json) AS entry";
+  insertString += " WHERE NOT EXISTS (SELECT 1 FROM (" +
+                  resolvedVersionSelect(mTableName, mPrimaryKeys, chain,
+                                        pkClauses) +
+                  ") AS base";
+  if (!sameClauses.empty())
   {
-    // call parent method
-    insertSuccessful = SimpleInsert::doInsert();
+    insertString += " WHERE " + stringJoin(sameClauses, " AND ");
   }
-  return insertSuccessful;
+  insertString += ")";
+
+  return doGenericUpdate(insertString, mParams);
 }
 
 //========================================================================+
-int getBaseVersion(int versionId)
+void VersionedBulkInsert::addRow(const nlohmann::basic_json<> &row)
 {
-  string queryString = "SELECT baseVersion";
-  queryString += " FROM " + SvtDbAgent::db_schema + ".\"Version\"";
-  queryString += " WHERE id=" + std::to_string(versionId);
+  if (!row.is_object())
+  {
+    raiseError("VersionedBulkInsert::addRow: row is not an object " +
+               row.dump());
+  }
+  for (const auto &item : row.items())
+  {
+    const string column = formatStr(item.key());
+    if (item.key() == "versionId" || item.key() == "id")
+    {
+      continue;
+    }
+    if (std::find(mColumnNames.begin(), mColumnNames.end(), column) ==
+        mColumnNames.end())
+    {
+      mColumnNames.push_back(column);
+    }
+  }
+  mRows.push_back(row);
+}
 
-  rows_t rows;
-  doGenericQuery(queryString, rows);
-  int baseVersion = -1;
+//========================================================================+
+size_t VersionedBulkInsert::doInsert()
+{
+  if (mPrimaryKeys.empty())
+  {
+    raiseError("VersionedBulkInsert: no primary key for " + mTableName);
+  }
+  if (mRows.empty())
+  {
+    return 0;
+  }
+  vector<int> baseChain =
+      Singleton<SvtDbVersionGraph>::instance().getChain(mVersionId);
+  baseChain.erase(baseChain.begin());
 
-  if (!rows.empty())
+  for (const auto &pk : mPrimaryKeys)
   {
-    baseVersion = rows.at(0).at(0).get<int>();
+    if (std::find(mColumnNames.begin(), mColumnNames.end(), pk) ==
+        mColumnNames.end())
+    {
+      raiseError("VersionedBulkInsert: rows without primary key " + pk);
+    }
   }
-  else
+
+  //! the primary key is one of the columns
+  vector<string> sameClauses;
+  for (const auto &column : mColumnNames)
   {
-    raiseError("Version ID " + std::to_string(versionId) +
-               " not found when retrieving base version");
+    sameClauses.push_back("base." + column +
+                          " IS NOT DISTINCT FROM entry." + column);
   }
 
-  finishQuery(rows);
-  return baseVersion;
+  const string rows = bind(mRows.dump());
+  const string chain = bind(intArray(baseChain));
+  const string versionId = bind(mVersionId);
+  //! the base version is resolved once for the whole diff
+  string insertString = "WITH base AS (" +
+                        resolvedVersionSelect(mTableName, mPrimaryKeys, chain,
+                                              vector<string>()) +
+                        ")";
+  insertString += " INSERT INTO " + addSchema(mTableName);
+  insertString += " (" + stringJoin(mColumnNames, ", ") + ", \"versionId\")";
+  insertString += " SELECT " + stringJoinPrefix(mColumnNames, "entry.", ", ") +
+                  ", " + versionId + "::integer";
+  insertString += " FROM json_populate_recordset(NULL::" +
+                  addSchema(mTableName) + ", " + rows + "::json) AS entry";
+  insertString += " WHERE NOT EXISTS (SELECT 1 FROM base WHERE " +
+                  stringJoin(sameClauses, " AND ") + ")";
+
+  DbResult result;
+  doGenericUpdate(insertString, mParams, result);
+  return result.affectedRows();
+}
+
+//========================================================================+
+int getBaseVersion(int versionId)
+{
+  return Singleton<SvtDbVersionGraph>::instance().getBaseVersion(versionId);
 }
 
 //========================================================================+
@@ -382,19 +1327,19 @@ int getMostRecentVersionId()
   string queryString =
       "SELECT MAX(ID) FROM " + SvtDbAgent::db_schema + ".\"Version\"";
 
-  rows_t rows;
-  doGenericQuery(queryString, rows);
+  DbResult result;
+  doGenericQuery(queryString, result);
   int maxVersionId = -1;
 
-  if (!rows.empty())
+  if (!result.empty() && !result.isNull(0, 0))
   {
-    maxVersionId = rows.at(0).at(0).get<int>();
+    maxVersionId = result.getInt(0, 0);
   }
   else
   {
     raiseError("Max version ID returned nothing");
   }
 
-  finishQuery(rows);
+  finishQuery(result);
   return maxVersionId;
 }
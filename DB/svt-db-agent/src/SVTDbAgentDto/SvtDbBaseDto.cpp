@@ -6,98 +6,383 @@
  */
 
 #include "SVTDbAgentDto/SvtDbBaseDto.h"
-#include "SVTDb/SvtDbInterface.h"
+#include "Database/dbresult.h"
 #include "SVTDb/sqlmapi.h"
+#include "SVTDbAgentDto/SvtDbMemoryStorage.h"
+#include "SVTDbAgentDto/SvtDbSingleFlight.h"
+#include "SVTDbAgentDto/SvtDbStorage.h"
 #include "SVTDbAgentDto/SvtDbWaferTypeDto.h"
 #include "SVTDbAgentService/SvtDbAgentMessage.h"
 #include "SVTUtilities/SvtLogger.h"
 #include "SVTUtilities/SvtUtilities.h"
 
 #include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <functional>
+#include <sstream>
 #include <stdexcept>
 #include <string>
 #include <utility>
 #include <vector>
 
 //========================================================================+
-bool SvtDbAgent::SvtDbBaseDto::getAllEntriesFromDB(
-    std::vector<SvtDbEntry> &entries, const SvtDbFilters &filters)
+SvtDbAgent::SvtDbBaseDto::SvtDbBaseDto()
+    : mServerJson(SvtDbAgent::db_server_json == "1")
 {
-  entries.clear();
-  SimpleQuery query;
+}
+
+//========================================================================+
+void SvtDbAgent::SvtDbBaseDto::setTableName(const std::string &tName)
+{
+  mTable.name = tName;
+
+  std::stringstream tables(SvtDbAgent::db_cache_tables);
+  std::string table;
+  while (std::getline(tables, table, ','))
+  {
+    mCached = mCached || (table == tName);
+  }
+}
 
+//========================================================================+
+SvtDbAgent::SvtDbStorage *
+SvtDbAgent::SvtDbBaseDto::getCache(const SvtDbFilters &filters)
+{
+  //! the reads of a transaction see its writes
+  if (!mCached || DbTransaction::current())
+  {
+    return nullptr;
+  }
+  //! the related tables are not cached
+  for (const auto &filter : filters.mFilters.values)
+  {
+    if (filter.first.find('.') != std::string::npos)
+    {
+      return nullptr;
+    }
+  }
+  for (const auto &order : filters.orderBy)
+  {
+    if (order.first.find('.') != std::string::npos)
+    {
+      return nullptr;
+    }
+  }
+
+  auto &cache = Singleton<SvtDbMemoryStorage>::instance();
+  if (!cache.isLoaded(getTableName()))
+  {
+    //! a replica may not have replayed the write that invalidated the
+    //! cache yet, and a write committed during the read drops the rows
+    const auto generation = cache.getGeneration(getTableName());
+    std::vector<SvtDbEntry> entries;
+    if (!getAllEntriesFromDB(entries, SvtDbFilters(), DbRoute::Primary))
+    {
+      return nullptr;
+    }
+    const size_t count = entries.size();
+    if (!cache.load(getTableName(), std::move(entries), generation))
+    {
+      return nullptr;
+    }
+    Singleton<SvtLogger>::instance().logInfo(
+        "Caching " + std::to_string(count) + " rows of " + getTableName());
+  }
+  return &cache;
+}
+
+//========================================================================+
+void SvtDbAgent::SvtDbBaseDto::invalidateCache()
+{
+  if (!mCached)
+  {
+    return;
+  }
+  //! dropped before the commit, a read could load the rows again before
+  //! the write is visible
+  auto invalidate = [tableName = getTableName()]() {
+    Singleton<SvtDbMemoryStorage>::instance().invalidate(tableName);
+  };
+  if (DbTransaction *transaction = DbTransaction::current())
+  {
+    transaction->onCommit(invalidate);
+    return;
+  }
+  invalidate();
+}
+
+//========================================================================+
+namespace
+{
+  //! names are quoted in the statement, only plain identifiers are allowed
+  bool isIdentifier(const std::string &name)
+  {
+    return !name.empty() &&
+           std::all_of(name.begin(), name.end(), [](const unsigned char c) {
+             return std::isalnum(c) || (c == '_');
+           });
+  }
+
+  //! runs when the scope is left, also by an exception
+  class AtExit
+  {
+   public:
+    explicit AtExit(std::function<void()> callback)
+        : mCallback(std::move(callback))
+    {
+    }
+    ~AtExit() { mCallback(); }
+
+    AtExit(const AtExit &) = delete;
+    AtExit &operator=(const AtExit &) = delete;
+
+   private:
+    std::function<void()> mCallback;
+  };
+}  // namespace
+
+//========================================================================+
+bool SvtDbAgent::SvtDbBaseDto::checkColumn(
+    const std::string &column, std::vector<std::string> &joins) const
+{
+  const size_t dot = column.find('.');
+  if (dot == std::string::npos)
+  {
+    return std::find(mTable.colNames.begin(), mTable.colNames.end(),
+                     column) != mTable.colNames.end();
+  }
+
+  const std::string name = column.substr(0, dot);
+  const auto relation = mTable.relations.find(name);
+  if ((relation == mTable.relations.end()) ||
+      !isIdentifier(column.substr(dot + 1)))
+  {
+    return false;
+  }
+  if (std::find(joins.begin(), joins.end(), name) != joins.end())
+  {
+    return true;
+  }
+  //! the relations fromColumn depends on are joined first
+  if (!checkColumn(relation->second.fromColumn, joins))
+  {
+    return false;
+  }
+  joins.push_back(name);
+  return true;
+}
+
+//========================================================================+
+bool SvtDbAgent::SvtDbBaseDto::buildQuery(SimpleQuery &query,
+                                          const SvtDbFilters &filters)
+{
   query.setTableName(getTableName());
+  //! GetAll reads, a read after a write of the agent is served by the
+  //! primary, see DatabaseInterface::setReadYourWrites
+  query.setRoute(DbRoute::Replica);
+
+  //! the joins go first so that the columns are qualified
+  std::vector<std::string> joins;
+  for (const auto &filter : filters.mFilters.values)
+  {
+    if (!checkColumn(filter.first, joins))
+    {
+      Singleton<SvtLogger>::instance().logError(
+          "Wrong filter: column with name " + filter.first +
+          " does not exists in table " + getTableName());
+      return false;
+    }
+  }
+  for (const auto &order : filters.orderBy)
+  {
+    if (!checkColumn(order.first, joins))
+    {
+      Singleton<SvtLogger>::instance().logError(
+          "Wrong order: column with name " + order.first +
+          " does not exists in table " + getTableName());
+      return false;
+    }
+  }
+  for (const auto &name : joins)
+  {
+    const auto &relation = mTable.relations.at(name);
+    //! a left join keeps the rows without relation for the orders
+    query.addJoin(relation.tableName, name, relation.fromColumn,
+                  name + "." + relation.toColumn, SimpleQuery::JoinType::Left);
+  }
 
   for (const auto &colName : getColNames())
   {
     query.addColumn(colName);
   }
+  query.addRowVersion();
 
   if (!filters.ids.empty())
   {
     query.addWhereIn("id", filters.ids);
   }
 
+  //! conditions on the relations joined on the partition key
+  std::map<std::string, std::vector<SqlCondition>> keyConditions;
   for (const auto &filter : filters.mFilters.values)
   {
-    if (std::find(getColNames().begin(), getColNames().end(), filter.first) !=
-        getColNames().end())
+    SqlCondition condition;
+    if (!SqlCondition::fromJson(filter.first, filter.second, condition))
     {
-      query.addWhereEquals(filter.first, filter.second);
+      Singleton<SvtLogger>::instance().logError(
+          "Wrong filter: unsupported value for " + filter.first);
+      return false;
     }
-    else
+    query.addWhere(condition);
+
+    const size_t dot = filter.first.find('.');
+    const std::string name = filter.first.substr(0, dot);
+    const auto relation = mTable.relations.find(name);
+    if (!mPartitionKey.empty() && (dot != std::string::npos) &&
+        (relation != mTable.relations.end()) &&
+        (relation->second.fromColumn == mPartitionKey))
+    {
+      keyConditions[name].push_back(std::move(condition));
+    }
+  }
+  for (auto &[name, conditions] : keyConditions)
+  {
+    const auto &relation = mTable.relations.at(name);
+    query.addWhereInSelect(mPartitionKey, relation.tableName, name,
+                           relation.toColumn,
+                           SqlCondition::allOf(std::move(conditions)));
+  }
+
+  for (const auto &order : filters.orderBy)
+  {
+    query.addOrderBy(order.first, order.second);
+  }
+
+  const bool hasId = std::find(getColNames().begin(), getColNames().end(),
+                               "id") != getColNames().end();
+  if (hasId)
+  {
+    query.setOrderById(true);
+  }
+
+  const auto &pager = filters.pager;
+  if (pager.enabled)
+  {
+    if (!hasId)
     {
       Singleton<SvtLogger>::instance().logError(
-          "Wrong filter: column with name " + filter.first +
-          " does not exists in table " + getTableName());
+          "Wrong pager: table " + getTableName() + " has no id column");
       return false;
     }
+    query.setTotalCount(true);
+    if (pager.afterId >= 0)
+    {
+      if (!filters.orderBy.empty())
+      {
+        Singleton<SvtLogger>::instance().logError(
+            "Wrong pager: afterId requires the order by id");
+        return false;
+      }
+      query.setKeysetAfter("id", pager.afterId);
+    }
+    if (pager.limit != std::numeric_limits<size_t>::max())
+    {
+      query.setLimit(pager.limit);
+    }
+    if (pager.offset)
+    {
+      query.setOffset(pager.offset);
+    }
   }
 
-  if (std::find(getColNames().begin(), getColNames().end(), "id") !=
-      getColNames().end())
+  return true;
+}
+
+//========================================================================+
+bool SvtDbAgent::SvtDbBaseDto::getAllEntriesFromDB(DbResult &result,
+                                                   const SvtDbFilters &filters,
+                                                   DbRoute route)
+{
+  result.clear();
+  SimpleQuery query;
+
+  if (!buildQuery(query, filters))
   {
-    query.setOrderById(true);
+    return false;
   }
+  query.setRoute(route);
 
   try
   {
-    rows_t rows;
-    query.doQuery(rows);
+    query.doQuery(result);
 
-    for (const auto &row : rows)
+    const size_t totalCol = filters.pager.enabled ? 1 : 0;
+    if (result.columns() != getReadColumns() + totalCol)
     {
-      if (row.size() != getColNames().size())
-      {
-        throw std::range_error("return row size unmatches query list size");
-      }
-      SvtDbEntry rowEntry;
-      int valId = 0;
-      for (const auto &colValue : row)
-      {
-        const std::string &colName = getColNames().at(valId);
-        rowEntry.values.insert({colName, colValue});
-        ++valId;
-      }
-      entries.push_back(rowEntry);
+      throw std::range_error("return row size unmatches query list size");
     }
 
     if (!filters.ids.empty())
     {
-      if (filters.ids.size() != entries.size())
+      const size_t totalCount = (totalCol && !result.empty())
+                                    ? result.getInt64(0, getReadColumns())
+                                    : result.size();
+      if (filters.ids.size() != totalCount)
       {
         throw std::runtime_error(
             "unmatching returned elements and requested filter size");
       }
     }
   }
+  catch (const DbUnavailableError &)
+  {
+    throw;
+  }
+  catch (const DbTimeoutError &)
+  {
+    throw;
+  }
   catch (const std::exception &e)
   {
     Singleton<SvtLogger>::instance().logError(e.what());
-    entries.clear();
+    result.clear();
+    return false;
+  }
+
+  return true;
+}
+
+//========================================================================+
+bool SvtDbAgent::SvtDbBaseDto::getAllEntriesFromDB(
+    std::vector<SvtDbEntry> &entries, const SvtDbFilters &filters,
+    DbRoute route)
+{
+  entries.clear();
+
+  if (SvtDbStorage *storage = SvtDbStorage::get())
+  {
+    size_t totalCount = 0;
+    return storage->select(getTableInfo(), filters, entries, totalCount);
+  }
+
+  DbResult result;
+  if (!getAllEntriesFromDB(result, filters, route))
+  {
     return false;
   }
 
+  entries.reserve(result.size());
+  for (size_t row = 0; row < result.size(); ++row)
+  {
+    SvtDbEntry rowEntry;
+    for (auto &[key, value] : rowToJson(result, row).items())
+    {
+      rowEntry.values.insert({key, std::move(value)});
+    }
+    entries.push_back(std::move(rowEntry));
+  }
+
   return true;
 }
 
@@ -119,6 +404,26 @@ bool SvtDbAgent::SvtDbBaseDto::getEntryWithId(SvtDbEntry &entry, int id)
 //========================================================================+
 bool SvtDbAgent::SvtDbBaseDto::createEntryInDB(const SvtDbEntry &entry)
 {
+  SvtDbEntry created;
+  return createEntryInDB(entry, created);
+}
+
+//========================================================================+
+bool SvtDbAgent::SvtDbBaseDto::createEntryInDB(const SvtDbEntry &entry,
+                                               SvtDbEntry &created)
+{
+  if (SvtDbStorage *storage = SvtDbStorage::get())
+  {
+    if (!storage->insert(getTableInfo(), entry, created))
+    {
+      return false;
+    }
+    created.values["version"] = SvtDbStorage::rowVersion(created);
+    return true;
+  }
+  //! a standalone statement is committed once it returned
+  const AtExit invalidation([this]() { invalidateCache(); });
+
   SimpleInsert insert;
 
   insert.setTableName(getTableName());
@@ -128,51 +433,204 @@ bool SvtDbAgent::SvtDbBaseDto::createEntryInDB(const SvtDbEntry &entry)
   {
     insert.addColumnAndValue(item.first, item.second);
   }
+  for (const auto &colName : getColNames())
+  {
+    insert.addReturning(colName);
+  }
+  insert.addReturning(rowVersionColumn);
 
-  if (!insert.doInsert())
+  const size_t nCols = getColNames().size();
+  DbResult result;
+  if (!insert.doInsert(result) || (result.size() != 1) ||
+      (result.columns() != nCols + 1))
   {
-    rollbackUpdate();
-    return -1;
+    return false;
   }
-  commitUpdate();
+
+  created.values.clear();
+  for (size_t col = 0; col < nCols; ++col)
+  {
+    created.values.insert({getColNames().at(col), result.toJson(0, col)});
+  }
+  created.values.insert({"version", result.getString(0, nCols)});
   return true;
 }
 
 //========================================================================+
-bool SvtDbAgent::SvtDbBaseDto::updateEntryInDB(const int id,
-                                               const SvtDbEntry &entry)
+bool SvtDbAgent::SvtDbBaseDto::createEntriesInDB(
+    const std::vector<SvtDbEntry> &entries)
 {
-  SimpleUpdate update;
+  if (entries.empty())
+  {
+    return true;
+  }
+  if (SvtDbStorage *storage = SvtDbStorage::get())
+  {
+    return storage->insertAll(getTableInfo(), entries);
+  }
+  //! a standalone statement is committed once it returned
+  const AtExit invalidation([this]() { invalidateCache(); });
 
-  update.setTableName(getTableName());
+  BulkInsert insert;
+  insert.setTableName(getTableName());
 
-  update.addWhereEquals("id", id);
+  const auto &columns = entries.front().values;
+  for (const auto &item : columns)
+  {
+    insert.addColumn(item.first);
+  }
 
-  //! checkinput values and Add columns & values
-  int totUpdateParameters = 0;
-  //! checkinput values and Add columns & values
+  insert.reserve(entries.size());
+  std::vector<nlohmann::basic_json<>> row;
+  row.reserve(columns.size());
+  for (const auto &entry : entries)
+  {
+    if (entry.values.size() != columns.size())
+    {
+      throw std::runtime_error("Unmatching columns in bulk insert into " +
+                               getTableName());
+    }
+    row.clear();
+    for (const auto &item : columns)
+    {
+      row.push_back(entry.values.at(item.first));
+    }
+    insert.addRow(row);
+  }
+
+  return insert.doInsert();
+}
+
+//========================================================================+
+SvtDbAgent::SvtDbUpdateStatus SvtDbAgent::SvtDbBaseDto::updateEntryInDB(
+    const int id, const SvtDbEntry &entry, const std::string &version,
+    SvtDbEntry &updated)
+{
+  updated.values.clear();
+  if (SvtDbStorage *storage = SvtDbStorage::get())
+  {
+    //! the request runs in a transaction of the storage, nothing is
+    //! written between the check of the version and the update
+    SvtDbFilters filters;
+    filters.ids.push_back(id);
+    std::vector<SvtDbEntry> rows;
+    size_t totalCount = 0;
+    if (!storage->exists(getTableInfo(), id) ||
+        !storage->select(getTableInfo(), filters, rows, totalCount))
+    {
+      return SvtDbUpdateStatus::NotFound;
+    }
+    if (!version.empty() && (rows.front().values["version"] != version))
+    {
+      return SvtDbUpdateStatus::Conflict;
+    }
+    if (!storage->update(getTableInfo(), id, entry) ||
+        !storage->select(getTableInfo(), filters, rows, totalCount))
+    {
+      throw std::runtime_error("Entry was not updated");
+    }
+    updated = std::move(rows.front());
+    return SvtDbUpdateStatus::Updated;
+  }
+  //! a standalone statement is committed once it returned
+  const AtExit invalidation([this]() { invalidateCache(); });
+
+  SimpleUpdate update;
+  update.setTableName(getTableName());
+  update.addWhereEquals("id", id);
+  if (!version.empty())
+  {
+    update.setRowVersion(version);
+  }
   for (const auto &item : entry.values)
   {
     if (!item.second.is_null())
     {
       update.addColumnAndValue(item.first, item.second);
-      ++totUpdateParameters;
     }
   }
+  for (const auto &colName : getColNames())
+  {
+    update.addReturning(colName);
+  }
 
-  if (!totUpdateParameters)
+  DbResult result;
+  update.doUpdate(result);
+  const size_t nCols = getColNames().size();
+  if (result.columns() != nCols + 2)
   {
-    return true;
+    throw std::range_error("return row size unmatches query list size");
+  }
+  if (result.isNull(0, nCols))
+  {
+    return result.getBool(0, nCols + 1) ? SvtDbUpdateStatus::Conflict
+                                        : SvtDbUpdateStatus::NotFound;
   }
+  for (size_t col = 0; col < nCols; ++col)
+  {
+    updated.values.insert({getColNames().at(col), result.toJson(0, col)});
+  }
+  updated.values.insert({"version", result.getString(0, nCols)});
+  return SvtDbUpdateStatus::Updated;
+}
 
-  if (!update.doUpdate())
+//========================================================================+
+void SvtDbAgent::SvtDbBaseDto::parsePager(const nlohmann::json &msgData,
+                                          SvtDbFilters &filters)
+{
+  auto &pager = filters.pager;
+  pager = SvtDbPager();
+  filters.orderBy.clear();
+
+  if (!msgData.contains("pager"))
   {
-    rollbackUpdate();
-    return false;
+    if (getDefaultPageSize())
+    {
+      pager.enabled = true;
+      pager.limit = getDefaultPageSize();
+    }
+    return;
   }
-  commitUpdate();
 
-  return true;
+  const auto &pagerData = msgData["pager"];
+  //! a negative count would wrap around to a huge size_t
+  auto count = [&pagerData](const char *key) {
+    const auto &value = pagerData[key];
+    if (!value.is_number_integer() || (value.get<long long>() < 0))
+    {
+      throw std::invalid_argument(std::string("Pager ") + key +
+                                  " must be a non negative integer");
+    }
+    return value.get<size_t>();
+  };
+  pager.enabled = true;
+  if (pagerData.contains("limit"))
+  {
+    pager.limit = count("limit");
+  }
+  if (pagerData.contains("offset"))
+  {
+    pager.offset = count("offset");
+  }
+  if (pagerData.contains("afterId"))
+  {
+    pager.afterId = pagerData["afterId"].get<long long>();
+  }
+
+  if (pagerData.contains("orderBy"))
+  {
+    const auto &orderData = pagerData["orderBy"];
+    if (orderData.is_string())
+    {
+      filters.orderBy.emplace_back(orderData.get<std::string>(), false);
+      return;
+    }
+    for (const auto &order : orderData)
+    {
+      filters.orderBy.emplace_back(order.at("column").get<std::string>(),
+                                   order.value("desc", false));
+    }
+  }
 }
 
 //========================================================================+
@@ -186,12 +644,15 @@ void SvtDbAgent::SvtDbBaseDto::parseFilter(const nlohmann::json &msgData,
     {
       filters.ids = filterData["ids"].get<std::vector<int>>();
     }
-    for (const auto &colName : getColNames())
+    for (const auto &item : filterData.items())
     {
-      if (filterData.contains(colName))
+      //! columns of related tables are checked in buildQuery
+      if ((item.key() != "ids") &&
+          ((item.key().find('.') != std::string::npos) ||
+           (std::find(getColNames().begin(), getColNames().end(),
+                      item.key()) != getColNames().end())))
       {
-        auto &value = filterData[colName];
-        filters.mFilters.values.insert({colName, value});
+        filters.mFilters.values.insert({item.key(), item.value()});
       }
     }
   }
@@ -221,25 +682,37 @@ void SvtDbAgent::SvtDbBaseDto::parseData(const nlohmann::json &entry_j,
   }
 }
 
+//========================================================================+
+nlohmann::ordered_json
+SvtDbAgent::SvtDbBaseDto::rowToJson(const DbResult &result, size_t row)
+{
+  nlohmann::ordered_json entry_j;
+  const size_t nCols = getColNames().size();
+  for (size_t col = 0; col < nCols; ++col)
+  {
+    entry_j[getColNames().at(col)] = result.toJson(row, col);
+  }
+  entry_j["version"] = result.getString(row, nCols);
+  return entry_j;
+}
+
 //========================================================================+
 void SvtDbAgent::SvtDbBaseDto::getAllEntriesReplyMsg(
-    const std::vector<SvtDbEntry> &entries, SvtDbAgentReplyMsg &msgReply,
-    int totalCount)
+    const DbResult &result, SvtDbAgentReplyMsg &msgReply, size_t first,
+    size_t count, int totalCount)
 {
   try
   {
     nlohmann::ordered_json data;
     nlohmann::ordered_json items = nlohmann::json::array();
-    for (const auto &entry : entries)
+    const size_t last =
+        (first < result.size()) ? first + std::min(count, result.size() - first)
+                                : first;
+    for (size_t row = first; row < last; ++row)
     {
-      nlohmann::ordered_json entry_j;
-      for (const auto &item : entry.values)
-      {
-        entry_j[item.first] = item.second;
-      }
-      items.push_back(entry_j);
+      items.push_back(rowToJson(result, row));
     }
-    data["items"] = items;
+    data["items"] = std::move(items);
     if (totalCount >= 0)
     {
       data["totalCount"] = totalCount;
@@ -251,11 +724,205 @@ void SvtDbAgent::SvtDbBaseDto::getAllEntriesReplyMsg(
   }
   catch (const std::exception &e)
   {
-    throw e;
+    throw;
     return;
   }
 }
 
+//========================================================================+
+size_t SvtDbAgent::SvtDbBaseDto::streamAllEntries(const SvtDbFilters &filters,
+                                                  std::string &items)
+{
+  SimpleQuery query;
+  if (!buildQuery(query, filters))
+  {
+    throw std::invalid_argument("Wrong filter for table " + getTableName());
+  }
+
+  const size_t nCols = getReadColumns();
+  const size_t totalCol = filters.pager.enabled ? 1 : 0;
+  size_t nRows = 0;
+  size_t totalCount = 0;
+
+  items = "[";
+  query.doStream(
+      std::max<size_t>(getStreamBatchSize(), 1),
+      [&](const DbResult &batch)
+      {
+        if (batch.columns() != nCols + totalCol)
+        {
+          throw std::range_error("return row size unmatches query list size");
+        }
+        if (totalCol && !nRows && !batch.empty())
+        {
+          totalCount = batch.getInt64(0, nCols);
+        }
+        for (size_t row = 0; row < batch.size(); ++row, ++nRows)
+        {
+          if (items.size() > 1)
+          {
+            items += ',';
+          }
+          items += rowToJson(batch, row).dump();
+        }
+        return true;
+      });
+  items += "]";
+
+  if (!totalCol)
+  {
+    totalCount = nRows;
+  }
+  else if (!nRows)
+  {
+    //! page past the end, the window returned no row to read the count from
+    totalCount = countAllEntries(filters);
+  }
+
+  if (!filters.ids.empty() && (filters.ids.size() != totalCount))
+  {
+    throw std::runtime_error(
+        "unmatching returned elements and requested filter size");
+  }
+
+  return totalCount;
+}
+
+//========================================================================+
+bool SvtDbAgent::SvtDbBaseDto::loadJsonColumns()
+{
+  std::lock_guard<std::mutex> lock(mJsonMutex);
+  if (mJsonColumnsLoaded)
+  {
+    return true;
+  }
+  if (getReadColumns() > SimpleQuery::kMaxJsonColumns)
+  {
+    return false;
+  }
+
+  //! the column types are read from an empty result, the columns that are
+  //! not a bool or a number are cast to text to be sent as toJson does
+  SimpleQuery query;
+  if (!buildQuery(query, SvtDbFilters()))
+  {
+    return false;
+  }
+  query.setLimit(0);
+  DbResult result;
+  query.doQuery(result);
+  if (result.columns() != getReadColumns())
+  {
+    return false;
+  }
+  mJsonAsText.resize(result.columns());
+  for (size_t col = 0; col < result.columns(); ++col)
+  {
+    mJsonAsText[col] = !result.hasNativeJson(col);
+  }
+  mJsonColumnsLoaded = true;
+  return true;
+}
+
+//========================================================================+
+bool SvtDbAgent::SvtDbBaseDto::jsonAllEntries(const SvtDbFilters &filters,
+                                              std::string &items,
+                                              size_t &totalCount)
+{
+  if (!loadJsonColumns())
+  {
+    return false;
+  }
+
+  SimpleQuery query;
+  if (!buildQuery(query, filters))
+  {
+    throw std::invalid_argument("Wrong filter for table " + getTableName());
+  }
+  DbResult result;
+  query.doJsonQuery(mJsonAsText, result);
+  if (result.size() != 1)
+  {
+    throw std::range_error("json query of " + getTableName() +
+                           " returned no row");
+  }
+
+  items = result.getString(0, 0);
+  const size_t nRows = result.getInt64(0, 1);
+  totalCount = nRows;
+  if (filters.pager.enabled)
+  {
+    //! page past the end, there is no row to read the count from
+    totalCount = result.isNull(0, 2) ? countAllEntries(filters)
+                                     : result.getInt64(0, 2);
+  }
+
+  if (!filters.ids.empty() && (filters.ids.size() != totalCount))
+  {
+    throw std::runtime_error(
+        "unmatching returned elements and requested filter size");
+  }
+  return true;
+}
+
+//========================================================================+
+size_t SvtDbAgent::SvtDbBaseDto::countAllEntries(const SvtDbFilters &filters)
+{
+  SvtDbFilters countFilters = filters;
+  countFilters.pager = SvtDbPager();
+
+  SimpleQuery query;
+  if (!buildQuery(query, countFilters))
+  {
+    throw std::invalid_argument("Wrong filter for table " + getTableName());
+  }
+  query.setOrderById(false);
+  query.setTotalCount(true);
+  query.setLimit(1);
+
+  DbResult result;
+  query.doQuery(result);
+  return result.empty() ? 0 : result.getInt64(0, getReadColumns());
+}
+
+//========================================================================+
+void SvtDbAgent::SvtDbBaseDto::getAllEntriesRawReplyMsg(
+    std::string &&items, SvtDbAgentReplyMsg &msgReply, int totalCount)
+{
+  std::string data;
+  data.reserve(items.size() + 48);
+  data.append("{\"items\":").append(items);
+  if (totalCount >= 0)
+  {
+    data.append(",\"totalCount\":").append(std::to_string(totalCount));
+  }
+  data.append("}");
+  std::string().swap(items);
+
+  msgReply.setRawData(std::move(data));
+  msgReply.setStatus(
+      SvtDbAgent::msgStatus[SvtDbAgent::SvtDbAgentMsgStatus::Success]);
+  msgReply.setError(0, "");
+}
+
+//========================================================================+
+std::string
+SvtDbAgent::SvtDbBaseDto::readKey(const SvtDbFilters &filters) const
+{
+  //! keys of json objects are sorted, the order of the ids does not
+  //! change the page
+  std::vector<int> ids = filters.ids;
+  std::sort(ids.begin(), ids.end());
+  nlohmann::json key;
+  key["table"] = getTableInfo().name;
+  key["ids"] = ids;
+  key["filters"] = filters.mFilters.values;
+  key["orderBy"] = filters.orderBy;
+  key["pager"] = {filters.pager.enabled, filters.pager.limit,
+                  filters.pager.offset, filters.pager.afterId};
+  return key.dump();
+}
+
 //========================================================================+
 void SvtDbAgent::SvtDbBaseDto::getAllEntries(const SvtDbAgentMessage &msg,
                                              SvtDbAgentReplyMsg &replyMsg)
@@ -263,11 +930,81 @@ void SvtDbAgent::SvtDbBaseDto::getAllEntries(const SvtDbAgentMessage &msg,
   const auto &msgData = msg.getPayload()["data"];
   SvtDbFilters filters;
   parseFilter(msgData, filters);
+  parsePager(msgData, filters);
+
+  //! the reads of a transaction see its writes, they are not shared
+  auto &flights = Singleton<SvtDbSingleFlight>::instance();
+  if (!flights.isEnabled() || DbTransaction::current())
+  {
+    readAllEntries(filters, replyMsg);
+    return;
+  }
+
+  //! a failed read throws, its waiters get the same exception
+  SvtDbSingleFlight::Reply data =
+      flights.run(readKey(filters), [this, &filters]() {
+        SvtDbAgentReplyMsg reply;
+        readAllEntries(filters, reply);
+        return reply.serializeData();
+      });
+  replyMsg.setRawData(std::string(*data));
+  replyMsg.setStatus(
+      SvtDbAgent::msgStatus[SvtDbAgent::SvtDbAgentMsgStatus::Success]);
+  replyMsg.setError(0, "");
+}
+
+//========================================================================+
+void SvtDbAgent::SvtDbBaseDto::readAllEntries(const SvtDbFilters &filters,
+                                              SvtDbAgentReplyMsg &replyMsg)
+{
+  const auto &pager = filters.pager;
+
+  //! rows held in memory first, then server side json, the rows are
+  //! decoded by the agent when the table cannot be queried as json
+  std::string items;
+  size_t total = 0;
+  SvtDbStorage *storage =
+      SvtDbStorage::get() ? SvtDbStorage::get() : getCache(filters);
+  const bool serverJson =
+      !storage && getServerJson() && jsonAllEntries(filters, items, total);
+  if (storage || serverJson || getStreamBatchSize())
+  {
+    if (storage)
+    {
+      total = storage->selectJson(getTableInfo(), filters, items);
+    }
+    else if (!serverJson)
+    {
+      total = streamAllEntries(filters, items);
+    }
+    if (pager.enabled && (pager.offset > total))
+    {
+      throw std::runtime_error("Pager offset out of range, filtered " +
+                               getTableName() +
+                               " size: " + std::to_string(total));
+    }
+    getAllEntriesRawReplyMsg(std::move(items), replyMsg,
+                             pager.enabled ? static_cast<int>(total) : -1);
+    return;
+  }
 
-  std::vector<SvtDbAgent::SvtDbEntry> entries;
-  if (getAllEntriesFromDB(entries, filters))
+  DbResult result;
+  if (getAllEntriesFromDB(result, filters))
   {
-    getAllEntriesReplyMsg(entries, replyMsg);
+    int totalCount = -1;
+    if (pager.enabled)
+    {
+      totalCount = result.empty() ? countAllEntries(filters)
+                                  : result.getInt64(0, getReadColumns());
+      if (pager.offset > static_cast<size_t>(totalCount))
+      {
+        throw std::runtime_error("Pager offset out of range, filtered " +
+                                 getTableName() +
+                                 " size: " + std::to_string(totalCount));
+      }
+    }
+    getAllEntriesReplyMsg(result, replyMsg, 0,
+                          std::numeric_limits<size_t>::max(), totalCount);
   }
 }
 
@@ -287,15 +1024,14 @@ void SvtDbAgent::SvtDbBaseDto::createEntry(const SvtDbAgentMessage &msg,
   parseData(entry_j, entry);
 
   //! create entry in DB
-  if (!createEntryInDB(entry))
+  SvtDbEntry created;
+  if (!createEntryInDB(entry, created))
   {
     throw std::runtime_error("Entry was not created in " + getTableName());
     return;
   }
 
-  const auto newEntryId = SvtDbInterface::getMaxId(getTableName());
-  getEntryWithId(entry, newEntryId);
-  createEntryReplyMsg(entry, replyMsg);
+  createEntryReplyMsg(created, replyMsg);
 }
 
 //========================================================================+
@@ -321,20 +1057,29 @@ void SvtDbAgent::SvtDbBaseDto::updateEntry(const SvtDbAgentMessage &msg,
     entry.values.insert({key, value});
   }
 
-  if (!SvtDbInterface::checkIdExist(getTableName(), Id))
+  //! the "version" of the entity read by the client, the update is
+  //! rejected if the row was written since
+  std::string version;
+  if (msgData.contains("version") && !msgData["version"].is_null())
   {
-    std::ostringstream ss("");
-    ss << "Wafer Probe Machine with id " << Id << " does not found.";
-    throw std::runtime_error(ss.str());
+    version = msgData["version"].is_string()
+                  ? msgData["version"].get<std::string>()
+                  : msgData["version"].dump();
   }
 
-  if (!updateEntryInDB(Id, entry))
+  SvtDbEntry updated;
+  switch (updateEntryInDB(Id.get<int>(), entry, version, updated))
   {
-    throw std::runtime_error("Entry was not updated");
+  case SvtDbUpdateStatus::NotFound:
+    throw SvtDbNotFoundError(getTableName() + " with id " + Id.dump() +
+                             " was not found");
+  case SvtDbUpdateStatus::Conflict:
+    throw SvtDbConflictError(getTableName() + " with id " + Id.dump() +
+                             " was changed since version " + version);
+  case SvtDbUpdateStatus::Updated:
+    break;
   }
-
-  getEntryWithId(entry, Id);
-  createEntryReplyMsg(entry, replyMsg);
+  createEntryReplyMsg(updated, replyMsg);
 }
 
 //========================================================================+
@@ -358,7 +1103,7 @@ void SvtDbAgent::SvtDbBaseDto::createEntryReplyMsg(
   }
   catch (const std::exception &e)
   {
-    throw e;
+    throw;
     return;
   }
 }
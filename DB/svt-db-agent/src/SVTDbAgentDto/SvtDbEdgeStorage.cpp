@@ -0,0 +1,1049 @@
+/*!
+ * @file SvtDbEdgeStorage.cpp
+ * @date Oct-2026
+ * @brief Store-and-forward storage of the remote sites
+ */
+
+#include "SVTDbAgentDto/SvtDbEdgeStorage.h"
+#include "Database/databaseinterface.h"
+#include "Database/dbdeadline.h"
+#include "Database/dbhealth.h"
+#include "Database/dbtransaction.h"
+#include "SVTDb/sqlmapi.h"
+#include "SVTDbAgentDto/SvtDbAsicDto.h"
+#include "SVTUtilities/SvtLogger.h"
+#include "SVTUtilities/SvtUtilities.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+//========================================================================+
+namespace
+{
+  SvtDbAgent::SvtDbTableInfo tableInfo(const std::string &tableName)
+  {
+    SvtDbAgent::SvtDbTableInfo info;
+    info.name = tableName;
+    return info;
+  }
+
+  nlohmann::json toJson(const SvtDbAgent::SvtDbEntry &entry)
+  {
+    nlohmann::json row = nlohmann::json::object();
+    for (const auto &value : entry.values)
+    {
+      row[value.first] = value.second;
+    }
+    return row;
+  }
+
+  SvtDbAgent::SvtDbEntry toEntry(const nlohmann::json &row)
+  {
+    SvtDbAgent::SvtDbEntry entry;
+    for (const auto &value : row.items())
+    {
+      entry.values.insert({value.key(), value.value()});
+    }
+    return entry;
+  }
+
+  //! all rows of a table of the DB
+  std::vector<SvtDbAgent::SvtDbEntry> readTable(const std::string &tableName)
+  {
+    DbResult result;
+    doGenericQuery("SELECT * FROM " + addSchema(formatStr(tableName)),
+                   sql_params_t(), result);
+    std::vector<SvtDbAgent::SvtDbEntry> rows(result.size());
+    for (size_t row = 0; row < result.size(); ++row)
+    {
+      for (size_t col = 0; col < result.columns(); ++col)
+      {
+        rows[row].values.insert(
+            {result.columnName(col), result.toJson(row, col)});
+      }
+    }
+    return rows;
+  }
+
+  //! the DB answers a trivial query
+  bool isReachable()
+  {
+    try
+    {
+      DbResult result;
+      doGenericQuery("SELECT 1", result);
+    }
+    catch (const std::exception &)
+    {
+      return false;
+    }
+    return true;
+  }
+
+  //! write the whole file, flushed to disk and renamed so that a crash
+  //! leaves either the old or the new content
+  void writeFile(const std::string &fileName, const std::string &content)
+  {
+    const std::string tmpName = fileName + ".tmp";
+    const int fd = ::open(tmpName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool ok = (fd >= 0);
+    for (size_t done = 0; ok && (done < content.size());)
+    {
+      const ssize_t n =
+          ::write(fd, content.data() + done, content.size() - done);
+      ok = (n > 0) || ((n < 0) && (errno == EINTR));
+      done += (n > 0) ? n : 0;
+    }
+    ok = ok && (::fsync(fd) == 0);
+    if (fd >= 0)
+    {
+      ::close(fd);
+    }
+    if (!ok || (::rename(tmpName.c_str(), fileName.c_str()) != 0))
+    {
+      throw std::runtime_error("Cannot write " + fileName + ": " +
+                               std::strerror(errno));
+    }
+  }
+
+  //! json of a file, null if it does not exist
+  nlohmann::json readFile(const std::string &fileName)
+  {
+    std::ifstream file(fileName);
+    if (!file)
+    {
+      return nullptr;
+    }
+    std::stringstream content;
+    content << file.rdbuf();
+    return nlohmann::json::parse(content.str());
+  }
+
+  //! quoted columns of the rows written, the provisional ids are not
+  std::vector<std::string> writtenColumns(const nlohmann::json &row)
+  {
+    std::vector<std::string> columns;
+    for (const auto &value : row.items())
+    {
+      if (value.key() != "id")
+      {
+        columns.push_back(formatStr(value.key()));
+      }
+    }
+    return columns;
+  }
+}  // namespace
+
+//========================================================================+
+//! a transaction of the replica, the writes are journaled when the
+//! outermost transaction commits
+class SvtDbAgent::SvtDbEdgeStorage::EdgeTransaction
+    : public SvtDbStorage::Transaction
+{
+ public:
+  explicit EdgeTransaction(SvtDbEdgeStorage &storage)
+      : mStorage(storage),
+        mLock(storage.mMutex),
+        mReplica(storage.mReplica.begin()),
+        mMark(storage.mWrites.size())
+  {
+    ++mStorage.mDepth;
+  }
+
+  ~EdgeTransaction() override
+  {
+    if (!mCommitted)
+    {
+      mStorage.mWrites.resize(mMark);
+    }
+    --mStorage.mDepth;
+  }
+
+  void commit() override
+  {
+    if ((mStorage.mDepth == 1) && !mStorage.mWrites.empty())
+    {
+      //! not committed if the journal cannot be written
+      mStorage.journal(std::move(mStorage.mWrites));
+      mStorage.mWrites.clear();
+    }
+    mReplica->commit();
+    mCommitted = true;
+  }
+
+ private:
+  SvtDbEdgeStorage &mStorage;
+  std::unique_lock<std::recursive_mutex> mLock;
+  std::unique_ptr<Transaction> mReplica;
+  size_t mMark;
+  bool mCommitted = false;
+};
+
+//========================================================================+
+SvtDbAgent::SvtDbEdgeStorage::~SvtDbEdgeStorage()
+{
+  stop();
+  if (mJournalFd >= 0)
+  {
+    ::close(mJournalFd);
+  }
+}
+
+//========================================================================+
+bool SvtDbAgent::SvtDbEdgeStorage::open(const std::string &schemaFile,
+                                        const std::string &journalFile,
+                                        std::string &message)
+{
+  if (!mReplica.loadSchema(schemaFile, message))
+  {
+    return false;
+  }
+  mReplica.setProvisionalIds(true);
+  mJournalFile = journalFile;
+
+  long long snapshotSeq = 0;
+  try
+  {
+    const auto snapshot = readFile(mJournalFile + ".snapshot");
+    if (!snapshot.is_null())
+    {
+      snapshotSeq = snapshot.at("seq").get<long long>();
+      for (const auto &table : snapshot.at("tables").items())
+      {
+        std::vector<SvtDbEntry> rows;
+        rows.reserve(table.value().size());
+        for (const auto &row : table.value())
+        {
+          rows.push_back(toEntry(row));
+        }
+        mReplica.load(table.key(), std::move(rows));
+      }
+    }
+    const auto position = readFile(mJournalFile + ".pos");
+    if (!position.is_null())
+    {
+      mForwardedSeq = position.at("seq").get<long long>();
+      mIds = position.at("ids");
+    }
+  }
+  catch (const std::exception &e)
+  {
+    message = "Cannot read the state of " + mJournalFile + ": " + e.what();
+    return false;
+  }
+  mSeq = std::max(snapshotSeq, mForwardedSeq);
+
+  std::ifstream file(mJournalFile);
+  std::string line;
+  std::streamoff valid = 0;
+  while (std::getline(file, line))
+  {
+    nlohmann::json transaction;
+    try
+    {
+      if (file.eof())
+      {
+        //! a line without end was not flushed, its reply was not sent
+        throw std::runtime_error("torn write");
+      }
+      transaction = nlohmann::json::parse(line);
+    }
+    catch (const std::exception &e)
+    {
+      if (file.peek() != std::ifstream::traits_type::eof())
+      {
+        message = "Corrupted journal " + mJournalFile + ": " + e.what();
+        return false;
+      }
+      Singleton<SvtLogger>::instance().logWarning(
+          "Dropping the incomplete last transaction of " + mJournalFile);
+      if (::truncate(mJournalFile.c_str(), valid) != 0)
+      {
+        message = "Cannot truncate " + mJournalFile;
+        return false;
+      }
+      break;
+    }
+    valid += line.size() + 1;
+
+    const long long seq = transaction.at("seq").get<long long>();
+    //! the snapshot already holds the transactions forwarded before it
+    if (seq > snapshotSeq)
+    {
+      apply(transaction);
+    }
+    if (seq > mForwardedSeq)
+    {
+      mPending.push_back(std::move(transaction));
+    }
+    mSeq = std::max(mSeq, seq);
+  }
+
+  mJournalFd =
+      ::open(mJournalFile.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+  if (mJournalFd < 0)
+  {
+    message = "Cannot open " + mJournalFile + ": " + std::strerror(errno);
+    return false;
+  }
+  Singleton<SvtLogger>::instance().logInfo(
+      "Journal " + mJournalFile + ": " + std::to_string(mPending.size()) +
+      " transactions to forward");
+  return true;
+}
+
+//========================================================================+
+void SvtDbAgent::SvtDbEdgeStorage::start(
+    const std::vector<std::string> &tables,
+    std::chrono::milliseconds forwardPeriod,
+    std::chrono::seconds refreshPeriod)
+{
+  mTables = tables;
+  mForwardPeriod = forwardPeriod;
+  mRefreshPeriod = refreshPeriod;
+  if (!refresh())
+  {
+    Singleton<SvtLogger>::instance().logWarning(
+        "DB unreachable, serving the replica of " + mJournalFile +
+        ".snapshot");
+  }
+
+  std::lock_guard<std::mutex> lock(mRunMutex);
+  mRunning = true;
+  mThread = std::thread(&SvtDbEdgeStorage::run, this);
+}
+
+//========================================================================+
+void SvtDbAgent::SvtDbEdgeStorage::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(mRunMutex);
+    mRunning = false;
+  }
+  mWake.notify_all();
+  if (mThread.joinable())
+  {
+    mThread.join();
+  }
+}
+
+//========================================================================+
+void SvtDbAgent::SvtDbEdgeStorage::run()
+{
+  auto lastRefresh = std::chrono::steady_clock::now();
+  std::unique_lock<std::mutex> lock(mRunMutex);
+  while (mRunning)
+  {
+    mWake.wait_for(lock, mForwardPeriod,
+                   [this] { return !mRunning || mWoken; });
+    mWoken = false;
+    if (!mRunning)
+    {
+      break;
+    }
+    lock.unlock();
+    //! the replica is loaded only when the DB is reachable
+    if (forward() &&
+        (std::chrono::steady_clock::now() - lastRefresh >= mRefreshPeriod) &&
+        refresh())
+    {
+      lastRefresh = std::chrono::steady_clock::now();
+    }
+    lock.lock();
+  }
+}
+
+//========================================================================+
+long long SvtDbAgent::SvtDbEdgeStorage::resolveId(const std::string &tableName,
+                                                  long long id,
+                                                  const nlohmann::json &ids,
+                                                  bool forwarding)
+{
+  //! a provisional id is kept while the replica holds its row
+  if ((id >= 0) || (!forwarding && mReplica.exists(tableInfo(tableName), id)))
+  {
+    return id;
+  }
+  const auto table = ids.find(tableName);
+  if (table != ids.end())
+  {
+    const auto mapped = table->find(std::to_string(id));
+    if (mapped != table->end())
+    {
+      return mapped->get<long long>();
+    }
+  }
+  return id;
+}
+
+//========================================================================+
+bool SvtDbAgent::SvtDbEdgeStorage::resolveRow(const std::string &tableName,
+                                              nlohmann::json &row,
+                                              const nlohmann::json &ids,
+                                              bool forwarding)
+{
+  for (const auto &reference : mReplica.getReferences(tableName))
+  {
+    auto value = row.find(reference.first);
+    if ((value == row.end()) || !value->is_number_integer())
+    {
+      continue;
+    }
+    *value = resolveId(reference.second, value->get<long long>(), ids,
+                       forwarding);
+    if (forwarding && (value->get<long long>() < 0))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+//========================================================================+
+void SvtDbAgent::SvtDbEdgeStorage::journal(
+    std::vector<nlohmann::json> &&writes)
+{
+  {
+    std::lock_guard<std::mutex> lock(mJournalMutex);
+    nlohmann::json transaction = {{"seq", mSeq + 1}, {"writes", writes}};
+    const std::string line = transaction.dump() + "\n";
+    if (mJournalFd < 0)
+    {
+      throw std::runtime_error("The journal " + mJournalFile +
+                               " does not accept writes");
+    }
+    //! a failed append is cut off, a partial line would corrupt the
+    //! journal and a complete one would be forwarded although not replied
+    const off_t end = ::lseek(mJournalFd, 0, SEEK_END);
+    bool ok = (end >= 0);
+    for (size_t done = 0; ok && (done < line.size());)
+    {
+      const ssize_t n =
+          ::write(mJournalFd, line.data() + done, line.size() - done);
+      ok = (n > 0) || ((n < 0) && (errno == EINTR));
+      done += (n > 0) ? n : 0;
+    }
+    ok = ok && (::fdatasync(mJournalFd) == 0);
+    if (!ok)
+    {
+      const std::string error = std::strerror(errno);
+      if ((end < 0) || (::ftruncate(mJournalFd, end) != 0) ||
+          (::fdatasync(mJournalFd) != 0))
+      {
+        Singleton<SvtLogger>::instance().logError(
+            "Cannot restore the journal " + mJournalFile +
+            ", no more writes are accepted");
+        ::close(mJournalFd);
+        mJournalFd = -1;
+      }
+      throw std::runtime_error("Cannot write the journal " + mJournalFile +
+                               ": " + error);
+    }
+    ++mSeq;
+    mPending.push_back(std::move(transaction));
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mRunMutex);
+    mWoken = true;
+  }
+  mWake.notify_all();
+}
+
+//========================================================================+
+void SvtDbAgent::SvtDbEdgeStorage::apply(const nlohmann::json &transaction)
+{
+  auto replica = mReplica.begin();
+  for (const auto &write : transaction.at("writes"))
+  {
+    const std::string tableName = write.at("table").get<std::string>();
+    const std::string op = write.at("op").get<std::string>();
+    bool ok = true;
+    if (op == "insert")
+    {
+      for (auto row : write.at("rows"))
+      {
+        resolveRow(tableName, row, mIds, false);
+        SvtDbEntry created;
+        ok = ok && mReplica.insert(tableInfo(tableName), toEntry(row), created);
+      }
+    }
+    else
+    {
+      auto values = write.at("values");
+      resolveRow(tableName, values, mIds, false);
+      const long long id =
+          resolveId(tableName, write.at("id").get<long long>(), mIds, false);
+      ok = mReplica.update(tableInfo(tableName), id, toEntry(values));
+    }
+    if (!ok)
+    {
+      //! the rows it refers to were changed by a conflict
+      Singleton<SvtLogger>::instance().logWarning(
+          "Transaction " + transaction.at("seq").dump() +
+          " of the journal does not apply to the replica");
+      return;
+    }
+  }
+  replica->commit();
+}
+
+//========================================================================+
+std::unique_ptr<SvtDbAgent::SvtDbStorage::Transaction>
+SvtDbAgent::SvtDbEdgeStorage::begin()
+{
+  return std::make_unique<EdgeTransaction>(*this);
+}
+
+//========================================================================+
+SvtDbAgent::SvtDbFilters SvtDbAgent::SvtDbEdgeStorage::resolveFilters(
+    const SvtDbTableInfo &table, const SvtDbFilters &filters)
+{
+  //! the provisional ids returned by the replies of the creates
+  std::lock_guard<std::recursive_mutex> lock(mMutex);
+  std::lock_guard<std::mutex> journalLock(mJournalMutex);
+  SvtDbFilters resolved = filters;
+  for (auto &id : resolved.ids)
+  {
+    id = resolveId(table.name, id, mIds, false);
+  }
+  nlohmann::json values = toJson(resolved.mFilters);
+  resolveRow(table.name, values, mIds, false);
+  resolved.mFilters = toEntry(values);
+  return resolved;
+}
+
+//========================================================================+
+bool SvtDbAgent::SvtDbEdgeStorage::select(const SvtDbTableInfo &table,
+                                          const SvtDbFilters &filters,
+                                          std::vector<SvtDbEntry> &entries,
+                                          size_t &totalCount)
+{
+  return mReplica.select(table, resolveFilters(table, filters), entries,
+                         totalCount);
+}
+
+//========================================================================+
+size_t SvtDbAgent::SvtDbEdgeStorage::selectJson(const SvtDbTableInfo &table,
+                                                const SvtDbFilters &filters,
+                                                std::string &items)
+{
+  return mReplica.selectJson(table, resolveFilters(table, filters), items);
+}
+
+
+//========================================================================+
+namespace
+{
+  //! commit of a single write, false if it cannot be journaled
+  bool commitWrite(SvtDbAgent::SvtDbStorage::Transaction &transaction)
+  {
+    try
+    {
+      transaction.commit();
+    }
+    catch (const std::runtime_error &e)
+    {
+      SvtDbAgent::Singleton<SvtLogger>::instance().logError(e.what());
+      return false;
+    }
+    return true;
+  }
+}  // namespace
+
+//========================================================================+
+bool SvtDbAgent::SvtDbEdgeStorage::insert(const SvtDbTableInfo &table,
+                                          const SvtDbEntry &entry,
+                                          SvtDbEntry &created)
+{
+  EdgeTransaction transaction(*this);
+  nlohmann::json row = toJson(entry);
+  {
+    std::lock_guard<std::mutex> lock(mJournalMutex);
+    resolveRow(table.name, row, mIds, false);
+  }
+  if (!mReplica.insert(table, toEntry(row), created))
+  {
+    return false;
+  }
+  mWrites.push_back({{"table", table.name},
+                     {"op", "insert"},
+                     {"rows", nlohmann::json::array({toJson(created)})}});
+  return commitWrite(transaction);
+}
+
+//========================================================================+
+bool SvtDbAgent::SvtDbEdgeStorage::insertAll(
+    const SvtDbTableInfo &table, const std::vector<SvtDbEntry> &entries)
+{
+  if (entries.empty())
+  {
+    return true;
+  }
+
+  EdgeTransaction transaction(*this);
+  //! the rows are inserted one by one to journal their provisional ids
+  nlohmann::json rows = nlohmann::json::array();
+  for (const auto &entry : entries)
+  {
+    nlohmann::json row = toJson(entry);
+    {
+      std::lock_guard<std::mutex> lock(mJournalMutex);
+      resolveRow(table.name, row, mIds, false);
+    }
+    SvtDbEntry created;
+    if (!mReplica.insert(table, toEntry(row), created))
+    {
+      return false;
+    }
+    rows.push_back(toJson(created));
+  }
+  mWrites.push_back(
+      {{"table", table.name}, {"op", "insert"}, {"rows", std::move(rows)}});
+  return commitWrite(transaction);
+}
+
+//========================================================================+
+bool SvtDbAgent::SvtDbEdgeStorage::update(const SvtDbTableInfo &table,
+                                          int id, const SvtDbEntry &entry)
+{
+  EdgeTransaction transaction(*this);
+  nlohmann::json values = nlohmann::json::object();
+  for (const auto &value : entry.values)
+  {
+    if (!value.second.is_null())
+    {
+      values[value.first] = value.second;
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(mJournalMutex);
+    id = resolveId(table.name, id, mIds, false);
+    resolveRow(table.name, values, mIds, false);
+  }
+
+  //! the values read before the update are checked against the DB when
+  //! forwarded, the values written as the replica converted them
+  SvtDbFilters filters;
+  filters.ids = {id};
+  std::vector<SvtDbEntry> before;
+  std::vector<SvtDbEntry> after;
+  size_t totalCount = 0;
+  if (!mReplica.select(table, filters, before, totalCount) ||
+      !mReplica.update(table, id, toEntry(values)) ||
+      !mReplica.select(table, filters, after, totalCount))
+  {
+    return false;
+  }
+  nlohmann::json base = nlohmann::json::object();
+  for (auto &value : values.items())
+  {
+    base[value.key()] = before.front().values[value.key()];
+    value.value() = after.front().values[value.key()];
+  }
+  mWrites.push_back({{"table", table.name},
+                     {"op", "update"},
+                     {"id", id},
+                     {"values", std::move(values)},
+                     {"base", std::move(base)}});
+  return commitWrite(transaction);
+}
+
+//========================================================================+
+bool SvtDbAgent::SvtDbEdgeStorage::exists(const SvtDbTableInfo &table,
+                                          int id)
+{
+  std::lock_guard<std::recursive_mutex> lock(mMutex);
+  std::lock_guard<std::mutex> journalLock(mJournalMutex);
+  return mReplica.exists(table, resolveId(table.name, id, mIds, false));
+}
+
+//========================================================================+
+bool SvtDbAgent::SvtDbEdgeStorage::getEnumTypes(
+    std::map<std::string, std::vector<std::string>> &enums)
+{
+  return mReplica.getEnumTypes(enums);
+}
+
+//========================================================================+
+bool SvtDbAgent::SvtDbEdgeStorage::forwardTransaction(
+    const nlohmann::json &transaction, std::string &conflict)
+{
+  nlohmann::json ids;
+  {
+    std::lock_guard<std::mutex> lock(mJournalMutex);
+    ids = mIds;
+  }
+
+  DbTransaction dbTransaction(Singleton<DatabaseInterface>::instance());
+  const std::string forwardedTable = addSchema(formatStr("EdgeForwarded"));
+  const long long seq = transaction.at("seq").get<long long>();
+  {
+    //! forwarded before a crash, only its ids are restored
+    DbResult forwarded;
+    doGenericQuery("SELECT \"ids\"::text FROM " + forwardedTable +
+                       " WHERE \"site\" = $1 AND \"seq\" = $2",
+                   sql_params_t{mSite, seq}, forwarded);
+    if (!forwarded.empty())
+    {
+      for (const auto &table :
+           nlohmann::json::parse(forwarded.getString(0, 0)).items())
+      {
+        ids[table.key()].update(table.value());
+      }
+      dbTransaction.commit();
+      Singleton<SvtLogger>::instance().logWarning(
+          "Transaction " + std::to_string(seq) + " was already forwarded");
+      std::lock_guard<std::mutex> lock(mJournalMutex);
+      mIds = std::move(ids);
+      return true;
+    }
+  }
+
+  nlohmann::json createdIds = nlohmann::json::object();
+  for (const auto &write : transaction.at("writes"))
+  {
+    const std::string tableName = write.at("table").get<std::string>();
+    const std::string table = addSchema(formatStr(tableName));
+    if (write.at("op") == "insert")
+    {
+      nlohmann::json rows = write.at("rows");
+      std::vector<long long> provisionalIds;
+      for (auto &row : rows)
+      {
+        if (!resolveRow(tableName, row, ids, true))
+        {
+          conflict = "insert into " + tableName + " refers to a row that " +
+                     "was not forwarded: " + row.dump();
+          return false;
+        }
+        provisionalIds.push_back(row.value("id", 0LL));
+        row.erase("id");
+      }
+      if (tableName == "Asic")
+      {
+        //! the site created the wafers without partitions, rows beyond the
+        //! existing ranges would fill the default partition
+        std::set<long long> waferIds;
+        for (const auto &row : rows)
+        {
+          if (row.contains("waferId") && row["waferId"].is_number_integer())
+          {
+            waferIds.insert(row["waferId"].get<long long>());
+          }
+        }
+        auto &partitions =
+            Singleton<SvtDbAsicDto>::instance().getPartitions();
+        for (const long long waferId : waferIds)
+        {
+          partitions.ensurePartition(waferId);
+        }
+      }
+      const auto columns = writtenColumns(rows.front());
+      if (!write.at("rows").front().contains("id"))
+      {
+        //! no id column, e.g. WaferLocation
+        DbResult result;
+        doGenericUpdate("INSERT INTO " + table + " (" +
+                            stringJoin(columns, ", ") + ") SELECT " +
+                            stringJoinPrefix(columns, "entry.", ", ") +
+                            " FROM json_populate_recordset(NULL::" + table +
+                            ", $1::json) AS entry",
+                        sql_params_t{rows.dump()}, result);
+        continue;
+      }
+      //! RETURNING does not keep the order of the rows, the ids are drawn
+      //! with the position of their row and matched by that position
+      DbResult result;
+      doGenericUpdate(
+          "WITH entry AS (SELECT entry.*, nextval("
+          "pg_get_serial_sequence($2, 'id')) AS \"newId\""
+          " FROM json_populate_recordset(NULL::" + table +
+              ", $1::json) WITH ORDINALITY AS entry), inserted AS (" +
+              "INSERT INTO " + table + " (\"id\", " +
+              stringJoin(columns, ", ") + ") SELECT entry.\"newId\", " +
+              stringJoinPrefix(columns, "entry.", ", ") +
+              " FROM entry RETURNING \"id\") SELECT entry.ordinality," +
+              " inserted.\"id\" FROM entry JOIN inserted ON" +
+              " inserted.\"id\" = entry.\"newId\"",
+          sql_params_t{rows.dump(), table}, result);
+      if (result.size() != rows.size())
+      {
+        throw std::runtime_error("Unmatching ids returned by " + tableName);
+      }
+      for (size_t row = 0; row < result.size(); ++row)
+      {
+        const long long provisionalId =
+            provisionalIds.at(result.getInt64(row, 0) - 1);
+        if (provisionalId < 0)
+        {
+          ids[tableName][std::to_string(provisionalId)] =
+              result.getInt64(row, 1);
+          createdIds[tableName][std::to_string(provisionalId)] =
+              result.getInt64(row, 1);
+        }
+      }
+      continue;
+    }
+
+    const long long id =
+        resolveId(tableName, write.at("id").get<long long>(), ids, true);
+    nlohmann::json values = write.at("values");
+    nlohmann::json base = write.at("base");
+    if ((id < 0) || !resolveRow(tableName, values, ids, true) ||
+        !resolveRow(tableName, base, ids, true))
+    {
+      conflict = "update of " + tableName + " refers to a row that was " +
+                 "not forwarded";
+      return false;
+    }
+    if (values.empty())
+    {
+      continue;
+    }
+    //! the row is updated only if the columns still hold the values read
+    //! before the update, compared as the types of the table
+    std::vector<std::string> sets;
+    std::vector<std::string> unchanged;
+    for (const auto &value : values.items())
+    {
+      const std::string column = formatStr(value.key());
+      sets.push_back(column + " = entry." + column);
+      unchanged.push_back("t." + column + " IS NOT DISTINCT FROM base." +
+                          column);
+    }
+    DbResult result;
+    doGenericUpdate("UPDATE " + table + " AS t SET " +
+                        stringJoin(sets, ", ") +
+                        " FROM json_populate_record(NULL::" + table +
+                        ", $2::json) AS entry, json_populate_record(NULL::" +
+                        table + ", $3::json) AS base WHERE t.\"id\" = $1" +
+                        " AND " + stringJoin(unchanged, " AND ") +
+                        " RETURNING t.\"id\"",
+                    sql_params_t{id, values.dump(), base.dump()}, result);
+    if (result.empty())
+    {
+      conflict = "row " + std::to_string(id) + " of " + tableName +
+                 " was changed or deleted in the DB";
+      return false;
+    }
+  }
+  DbResult result;
+  doGenericUpdate("INSERT INTO " + forwardedTable +
+                      " (\"site\", \"seq\", \"ids\")" +
+                      " VALUES ($1, $2, $3::json)",
+                  sql_params_t{mSite, seq, createdIds.dump()}, result);
+  dbTransaction.commit();
+
+  std::lock_guard<std::mutex> lock(mJournalMutex);
+  mIds = std::move(ids);
+  return true;
+}
+
+//========================================================================+
+void SvtDbAgent::SvtDbEdgeStorage::recordConflict(
+    const nlohmann::json &transaction, const std::string &reason)
+{
+  ++mConflicts;
+  Singleton<SvtLogger>::instance().logWarning(
+      "Conflict of transaction " + transaction.at("seq").dump() + ": " +
+      reason);
+  std::ofstream file(mJournalFile + ".conflicts", std::ios::app);
+  nlohmann::json conflict = transaction;
+  conflict["reason"] = reason;
+  file << conflict.dump() << std::endl;
+}
+
+//========================================================================+
+bool SvtDbAgent::SvtDbEdgeStorage::forward()
+{
+  std::lock_guard<std::mutex> forwardLock(mForwardMutex);
+  auto &db = Singleton<DatabaseInterface>::instance();
+  //! the site may have started without the DB
+  if (!db.isConnected() && !db.connect())
+  {
+    setLastError("database connection not available");
+    return false;
+  }
+  while (true)
+  {
+    nlohmann::json transaction;
+    {
+      std::lock_guard<std::mutex> lock(mJournalMutex);
+      if (mPending.empty())
+      {
+        return true;
+      }
+      transaction = mPending.front();
+    }
+
+    std::string conflict;
+    try
+    {
+      if (!forwardTransaction(transaction, conflict))
+      {
+        recordConflict(transaction, conflict);
+      }
+    }
+    catch (const DbUnavailableError &e)
+    {
+      setLastError(e.what());
+      return false;
+    }
+    catch (const DbTimeoutError &e)
+    {
+      setLastError(e.what());
+      return false;
+    }
+    catch (const DbRetryableError &e)
+    {
+      //! deadlock or serialization failure, forwarded again next period
+      setLastError(e.what());
+      return false;
+    }
+    catch (const pqxx::transaction_rollback &e)
+    {
+      //! raised by the commit
+      setLastError(e.what());
+      return false;
+    }
+    catch (const pqxx::in_doubt_error &e)
+    {
+      //! the EdgeForwarded row tells at the next period if it committed
+      setLastError(e.what());
+      return false;
+    }
+    catch (const std::exception &e)
+    {
+      //! a failure of a reachable DB rejects the transaction
+      if (!db.isConnected() || db.getHealthMonitor().isTripped() ||
+          !isReachable())
+      {
+        setLastError(e.what());
+        return false;
+      }
+      recordConflict(transaction, e.what());
+    }
+
+    //! a crash before the position is saved forwards it again, it is
+    //! then found in the EdgeForwarded table
+    std::lock_guard<std::mutex> lock(mJournalMutex);
+    mForwardedSeq = mPending.front().at("seq").get<long long>();
+    mPending.pop_front();
+    ++mForwarded;
+    savePosition();
+  }
+}
+
+//========================================================================+
+bool SvtDbAgent::SvtDbEdgeStorage::refresh()
+{
+  long long seq = 0;
+  {
+    std::lock_guard<std::mutex> lock(mJournalMutex);
+    seq = mForwardedSeq;
+  }
+
+  //! the DB is read without blocking the requests
+  std::map<std::string, std::vector<SvtDbEntry>> tables;
+  try
+  {
+    for (const auto &tableName : mTables)
+    {
+      tables[tableName] = readTable(tableName);
+    }
+  }
+  catch (const std::exception &e)
+  {
+    setLastError(e.what());
+    return false;
+  }
+
+  std::lock_guard<std::recursive_mutex> lock(mMutex);
+  std::lock_guard<std::mutex> journalLock(mJournalMutex);
+  if (seq != mForwardedSeq)
+  {
+    //! a transaction was forwarded meanwhile, read again at the next period
+    return false;
+  }
+  nlohmann::json snapshot = {{"seq", seq},
+                             {"tables", nlohmann::json::object()}};
+  for (auto &table : tables)
+  {
+    auto &rows = snapshot["tables"][table.first] = nlohmann::json::array();
+    for (const auto &row : table.second)
+    {
+      rows.push_back(toJson(row));
+    }
+    mReplica.load(table.first, std::move(table.second));
+  }
+  for (const auto &transaction : mPending)
+  {
+    apply(transaction);
+  }
+
+  try
+  {
+    writeFile(mJournalFile + ".snapshot", snapshot.dump());
+    //! the journal restores the replica from the snapshot. The ids stay
+    //! mapped, the replies of the site returned the provisional ones
+    if (mPending.empty() && (mJournalFd >= 0) &&
+        (::ftruncate(mJournalFd, 0) != 0))
+    {
+      throw std::runtime_error("Cannot truncate " + mJournalFile + ": " +
+                               std::strerror(errno));
+    }
+  }
+  catch (const std::runtime_error &e)
+  {
+    Singleton<SvtLogger>::instance().logError(e.what());
+  }
+  Singleton<SvtLogger>::instance().logInfo("Replica of " +
+                                           std::to_string(mTables.size()) +
+                                           " tables loaded from the DB");
+  return true;
+}
+
+//========================================================================+
+void SvtDbAgent::SvtDbEdgeStorage::savePosition()
+{
+  try
+  {
+    writeFile(mJournalFile + ".pos",
+              nlohmann::json({{"seq", mForwardedSeq}, {"ids", mIds}}).dump());
+  }
+  catch (const std::runtime_error &e)
+  {
+    Singleton<SvtLogger>::instance().logError(e.what());
+  }
+}
+
+//========================================================================+
+void SvtDbAgent::SvtDbEdgeStorage::setLastError(const std::string &error)
+{
+  std::lock_guard<std::mutex> lock(mJournalMutex);
+  mLastError = error;
+}
+
+//========================================================================+
+nlohmann::ordered_json SvtDbAgent::SvtDbEdgeStorage::getStats()
+{
+  std::lock_guard<std::mutex> lock(mJournalMutex);
+  nlohmann::ordered_json stats;
+  stats["name"] = getName();
+  stats["pending"] = mPending.size();
+  stats["journaledSeq"] = mSeq;
+  stats["journalWritable"] = (mJournalFd >= 0);
+  stats["forwardedSeq"] = mForwardedSeq;
+  stats["forwarded"] = mForwarded.load();
+  stats["conflicts"] = mConflicts.load();
+  stats["lastError"] = mLastError;
+  return stats;
+}
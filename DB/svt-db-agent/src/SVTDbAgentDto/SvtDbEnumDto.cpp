@@ -20,7 +20,7 @@ std::map<std::string, std::vector<std::string>>
 bool SvtDbEnumDto::getAllEnumTypesInDB(const std::string &schema,
                                        std::vector<std::string> &enum_types)
 {
-  rows_t rows;
+  DbResult result;
   std::string query =
       "SELECT DISTINCT n.nspname AS enum_schema, t.typname AS enum_name\n";
   query += "FROM pg_type t\n";
@@ -30,20 +30,20 @@ bool SvtDbEnumDto::getAllEnumTypesInDB(const std::string &schema,
   enum_types.clear();
   try
   {
-    doGenericQuery(query, rows);
-    for (auto &row : rows)
+    doGenericQuery(query, sql_params_t(), result, DbRoute::Replica);
+    for (size_t row = 0; row < result.size(); ++row)
     {
-      if (!schema.compare(row.at(0).get<std::string>()))
+      if (!schema.compare(result.getStringView(row, 0)))
       {
-        enum_types.push_back(row.at(1).get<std::string>());
+        enum_types.push_back(result.getString(row, 1));
       }
     }
-    finishQuery(rows);
+    finishQuery(result);
   }
   catch (const std::exception &e)
   {
     enum_types.clear();
-    throw e;
+    throw;
   }
   return true;
 }
@@ -52,16 +52,16 @@ bool SvtDbEnumDto::getAllEnumTypesInDB(const std::string &schema,
 bool SvtDbEnumDto::getAllEnumValuesInDB(std::string type_name,
                                         std::vector<std::string> &enum_values)
 {
-  rows_t rows;
+  DbResult result;
   std::string query = "SELECT enum_range(null::" + type_name + ");";
 
   enum_values.clear();
   try
   {
-    doGenericQuery(query, rows);
-    const auto str_res = rows[0][0].get<std::string>();
+    doGenericQuery(query, sql_params_t(), result, DbRoute::Replica);
+    const auto str_res = result.getString(0, 0);
     std::string_view res{str_res};
-    finishQuery(rows);
+    finishQuery(result);
 
     res.remove_prefix(res.find('{') + 1);
     res.remove_suffix(res.size() - res.find_last_of('}'));
@@ -80,7 +80,7 @@ bool SvtDbEnumDto::getAllEnumValuesInDB(std::string type_name,
   catch (const std::exception &e)
   {
     enum_values.clear();
-    throw e;
+    throw;
   }
   return true;
 }
@@ -91,13 +91,7 @@ bool SvtDbEnumDto::addEnumValueInDB(std::string type_name, std::string value)
   std::string cmd =
       "ALTER TYPE " + type_name + " ADD VALUE IF NOT EXISTS '" + value + "';";
 
-  if (!doGenericUpdate(cmd))
-  {
-    rollbackUpdate();
-    return false;
-  }
-  commitUpdate();
-  return true;
+  return doGenericUpdate(cmd);
 }
 
 //========================================================================+
@@ -185,7 +179,7 @@ void SvtDbEnumDto::getAllEnumValuesReplyMsg(
   }
   catch (const std::exception &e)
   {
-    throw e;
+    throw;
   }
   return;
 }
@@ -0,0 +1,944 @@
+/*!
+ * @file SvtDbMemoryStorage.cpp
+ * @date Oct-2026
+ * @brief In-memory storage of the DTO tables
+ */
+
+#include "SVTDbAgentDto/SvtDbMemoryStorage.h"
+#include "SVTDb/sqlmapi.h"
+#include "SVTUtilities/SvtLogger.h"
+#include "SVTUtilities/SvtUtilities.h"
+
+#include <algorithm>
+#include <cctype>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+//========================================================================+
+namespace
+{
+  //! names between double quotes, in order
+  std::vector<std::string> quotedNames(const std::string &line)
+  {
+    std::vector<std::string> names;
+    size_t start = line.find('"');
+    while (start != std::string::npos)
+    {
+      const size_t end = line.find('"', start + 1);
+      if (end == std::string::npos)
+      {
+        break;
+      }
+      names.push_back(line.substr(start + 1, end - start - 1));
+      start = line.find('"', end + 1);
+    }
+    return names;
+  }
+
+  //! as the text of a timestamp column
+  std::string currentTimestamp()
+  {
+    const auto now = std::chrono::system_clock::now();
+    const std::time_t time = std::chrono::system_clock::to_time_t(now);
+    const auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                        now.time_since_epoch())
+                        .count() %
+                    1000000;
+    std::tm tm{};
+    localtime_r(&time, &tm);
+    std::ostringstream ss;
+    ss << std::put_time(&tm, "%Y-%m-%d %H:%M:%S") << '.' << std::setfill('0')
+       << std::setw(6) << us;
+    return ss.str();
+  }
+
+  //! order of two values, NULL after every value as in ORDER BY ... ASC
+  int compareJson(const nlohmann::basic_json<> *a,
+                  const nlohmann::basic_json<> *b)
+  {
+    const bool aNull = (a == nullptr) || a->is_null();
+    const bool bNull = (b == nullptr) || b->is_null();
+    if (aNull || bNull)
+    {
+      return aNull - bNull;
+    }
+    if (a->is_number() && b->is_number())
+    {
+      const double x = a->get<double>();
+      const double y = b->get<double>();
+      return (x < y) ? -1 : ((y < x) ? 1 : 0);
+    }
+    return (*a < *b) ? -1 : ((*b < *a) ? 1 : 0);
+  }
+
+  std::optional<long long> getId(const SvtDbAgent::SvtDbEntry &row)
+  {
+    const auto id = row.values.find("id");
+    if ((id == row.values.end()) || !id->second.is_number_integer())
+    {
+      return std::nullopt;
+    }
+    return id->second.get<long long>();
+  }
+
+  //! the rows cached from the DB keep the version read with them
+  std::string versionOf(const SvtDbAgent::SvtDbEntry &row)
+  {
+    const auto version = row.values.find("version");
+    if ((version != row.values.end()) && version->second.is_string())
+    {
+      return version->second.get<std::string>();
+    }
+    return SvtDbAgent::SvtDbStorage::rowVersion(row);
+  }
+}  // namespace
+
+//========================================================================+
+class SvtDbAgent::SvtDbMemoryStorage::MemoryTransaction
+    : public SvtDbStorage::Transaction
+{
+ public:
+  explicit MemoryTransaction(SvtDbMemoryStorage &storage)
+      : mStorage(storage), mLock(storage.mMutex), mMark(storage.mUndo.size())
+  {
+    ++mStorage.mDepth;
+  }
+
+  ~MemoryTransaction() override
+  {
+    if (!mCommitted)
+    {
+      mStorage.rollback(mMark);
+    }
+    //! the writes of a committed outermost transaction are final
+    if (--mStorage.mDepth == 0)
+    {
+      mStorage.mUndo.clear();
+    }
+  }
+
+  void commit() override { mCommitted = true; }
+
+ private:
+  SvtDbMemoryStorage &mStorage;
+  std::unique_lock<std::recursive_mutex> mLock;
+  size_t mMark;
+  bool mCommitted = false;
+};
+
+//========================================================================+
+bool SvtDbAgent::SvtDbMemoryStorage::loadSchema(const std::string &fileName,
+                                                std::string &message)
+{
+  std::ifstream file(fileName);
+  if (!file)
+  {
+    message = "Cannot open schema file " + fileName;
+    return false;
+  }
+
+  std::lock_guard<std::recursive_mutex> lock(mMutex);
+  std::string enumName;
+  std::string tableName;
+  std::string line;
+  while (std::getline(file, line))
+  {
+    line.erase(0, line.find_first_not_of(" \t"));
+    if (line.rfind("CREATE TYPE", 0) == 0)
+    {
+      const auto names = quotedNames(line);
+      enumName = names.empty() ? "" : names.back();
+      mEnums[enumName].clear();
+    }
+    else if (line.rfind("CREATE TABLE", 0) == 0)
+    {
+      const auto names = quotedNames(line);
+      tableName = names.empty() ? "" : names.back();
+      mTables[tableName] = Table();
+    }
+    else if ((line.rfind("ALTER TABLE", 0) == 0) &&
+             (line.find("FOREIGN KEY") != std::string::npos))
+    {
+      //! "schema"."table" ("column") REFERENCES "schema"."table" ("id")
+      const auto names = quotedNames(line);
+      const auto table = (names.size() >= 5) ? mTables.find(names[1])
+                                             : mTables.end();
+      if (table == mTables.end())
+      {
+        continue;
+      }
+      for (auto &column : table->second.columns)
+      {
+        if (column.name == names[2])
+        {
+          column.references = names[4];
+        }
+      }
+    }
+    else if (line.rfind(")", 0) == 0)
+    {
+      enumName.clear();
+      tableName.clear();
+    }
+    else if (!enumName.empty() && (line.rfind("'", 0) == 0))
+    {
+      mEnums[enumName].push_back(line.substr(1, line.rfind('\'') - 1));
+    }
+    else if (!tableName.empty() && (line.rfind("\"", 0) == 0))
+    {
+      const auto names = quotedNames(line);
+      std::string definition = line.substr(names.front().size() + 2);
+      definition.erase(0, definition.find_first_not_of(' '));
+
+      Column column;
+      column.name = names.front();
+      column.type = definition.substr(0, definition.find_first_of(" ,"));
+      std::transform(column.type.begin(), column.type.end(),
+                     column.type.begin(),
+                     [](unsigned char c) { return std::tolower(c); });
+      if (column.type.rfind("main.", 0) == 0)
+      {
+        column.type = "enum";
+        column.enumType = names.back();
+      }
+      std::transform(definition.begin(), definition.end(), definition.begin(),
+                     [](unsigned char c) { return std::toupper(c); });
+      const bool primaryKey =
+          definition.find("PRIMARY KEY") != std::string::npos;
+      column.identity = definition.find("IDENTITY") != std::string::npos;
+      column.notNull =
+          primaryKey || (definition.find("NOT NULL") != std::string::npos);
+      column.unique =
+          primaryKey || (definition.find("UNIQUE") != std::string::npos);
+      column.defaultNow =
+          definition.find("CURRENT_TIMESTAMP") != std::string::npos;
+      mTables[tableName].columns.push_back(std::move(column));
+    }
+  }
+
+  if (mTables.empty())
+  {
+    message = "No table found in schema file " + fileName;
+    return false;
+  }
+  Singleton<SvtLogger>::instance().logInfo(
+      "Memory storage: " + std::to_string(mTables.size()) + " tables, " +
+      std::to_string(mEnums.size()) + " enum types from " + fileName);
+  return true;
+}
+
+//========================================================================+
+void SvtDbAgent::SvtDbMemoryStorage::load(const std::string &tableName,
+                                          std::vector<SvtDbEntry> &&rows)
+{
+  std::lock_guard<std::recursive_mutex> lock(mMutex);
+  Table &table = mTables[tableName];
+  table.rows = std::move(rows);
+  table.ids.clear();
+  table.uniques.clear();
+  for (size_t row = 0; row < table.rows.size(); ++row)
+  {
+    if (const auto id = getId(table.rows[row]))
+    {
+      table.ids[*id] = row;
+      table.nextId = std::max(table.nextId, *id + 1);
+      table.nextProvisionalId = std::min(table.nextProvisionalId, *id - 1);
+    }
+    setUniques(table, table.rows[row], true);
+  }
+  table.loaded = true;
+  table.loadTime = std::chrono::steady_clock::now();
+}
+
+//========================================================================+
+bool SvtDbAgent::SvtDbMemoryStorage::load(const std::string &tableName,
+                                          std::vector<SvtDbEntry> &&rows,
+                                          unsigned long long generation)
+{
+  std::lock_guard<std::recursive_mutex> lock(mMutex);
+  if (getGeneration(tableName) != generation)
+  {
+    return false;
+  }
+  load(tableName, std::move(rows));
+  return true;
+}
+
+//========================================================================+
+unsigned long long SvtDbAgent::SvtDbMemoryStorage::getGeneration(
+    const std::string &tableName)
+{
+  std::lock_guard<std::recursive_mutex> lock(mMutex);
+  const auto table = mTables.find(tableName);
+  return (table != mTables.end()) ? table->second.generation : 0;
+}
+
+//========================================================================+
+bool SvtDbAgent::SvtDbMemoryStorage::isLoaded(const std::string &tableName)
+{
+  std::lock_guard<std::recursive_mutex> lock(mMutex);
+  const auto table = mTables.find(tableName);
+  return (table != mTables.end()) && table->second.loaded &&
+         (!mTtl.count() ||
+          (std::chrono::steady_clock::now() - table->second.loadTime < mTtl));
+}
+
+//========================================================================+
+void SvtDbAgent::SvtDbMemoryStorage::invalidate(const std::string &tableName)
+{
+  std::lock_guard<std::recursive_mutex> lock(mMutex);
+  //! counted for a table not loaded yet too, its first load may be running
+  Table &table = mTables[tableName];
+  ++table.generation;
+  table.loaded = false;
+  std::vector<SvtDbEntry>().swap(table.rows);
+  table.ids.clear();
+  table.uniques.clear();
+}
+
+//========================================================================+
+std::unique_ptr<SvtDbAgent::SvtDbStorage::Transaction>
+SvtDbAgent::SvtDbMemoryStorage::begin()
+{
+  return std::make_unique<MemoryTransaction>(*this);
+}
+
+//========================================================================+
+SvtDbAgent::SvtDbMemoryStorage::Table &
+SvtDbAgent::SvtDbMemoryStorage::getTable(const std::string &tableName)
+{
+  const auto table = mTables.find(tableName);
+  if (table == mTables.end())
+  {
+    throw std::invalid_argument("Table " + tableName +
+                                " does not exist in the memory storage");
+  }
+  return table->second;
+}
+
+//========================================================================+
+const nlohmann::basic_json<> *SvtDbAgent::SvtDbMemoryStorage::lookup(
+    const SvtDbTableInfo &table, const SvtDbEntry &row,
+    const std::string &column)
+{
+  const size_t dot = column.find('.');
+  if (dot == std::string::npos)
+  {
+    const auto value = row.values.find(column);
+    return (value != row.values.end()) ? &value->second : nullptr;
+  }
+
+  const auto relation = table.relations.find(column.substr(0, dot));
+  if (relation == table.relations.end())
+  {
+    return nullptr;
+  }
+  const auto *key = lookup(table, row, relation->second.fromColumn);
+  const auto related = mTables.find(relation->second.tableName);
+  if ((key == nullptr) || key->is_null() || (related == mTables.end()))
+  {
+    return nullptr;
+  }
+
+  //! related row on toColumn = key, ids are indexed
+  const Table &relatedTable = related->second;
+  const SvtDbEntry *relatedRow = nullptr;
+  if ((relation->second.toColumn == "id") && key->is_number_integer())
+  {
+    const auto id = relatedTable.ids.find(key->get<long long>());
+    if (id != relatedTable.ids.end())
+    {
+      relatedRow = &relatedTable.rows[id->second];
+    }
+  }
+  else
+  {
+    for (const auto &candidate : relatedTable.rows)
+    {
+      const auto value = candidate.values.find(relation->second.toColumn);
+      if ((value != candidate.values.end()) && (value->second == *key))
+      {
+        relatedRow = &candidate;
+        break;
+      }
+    }
+  }
+  if (relatedRow == nullptr)
+  {
+    return nullptr;
+  }
+  const auto value = relatedRow->values.find(column.substr(dot + 1));
+  return (value != relatedRow->values.end()) ? &value->second : nullptr;
+}
+
+//========================================================================+
+std::vector<const SvtDbAgent::SvtDbEntry *>
+SvtDbAgent::SvtDbMemoryStorage::query(const SvtDbTableInfo &info,
+                                      const SvtDbFilters &filters,
+                                      size_t &totalCount)
+{
+  const Table &table = getTable(info.name);
+  const auto &colNames = info.colNames;
+  const auto isColumn = [&](const std::string &column)
+  {
+    const size_t dot = column.find('.');
+    return (dot == std::string::npos)
+               ? (std::find(colNames.begin(), colNames.end(), column) !=
+                  colNames.end())
+               : (info.relations.count(column.substr(0, dot)) != 0);
+  };
+
+  std::vector<SqlCondition> conditions;
+  for (const auto &filter : filters.mFilters.values)
+  {
+    SqlCondition condition;
+    if (!isColumn(filter.first) ||
+        !SqlCondition::fromJson(filter.first, filter.second, condition))
+    {
+      throw std::invalid_argument("Wrong filter " + filter.first +
+                                  " for table " + info.name);
+    }
+    conditions.push_back(std::move(condition));
+  }
+  for (const auto &order : filters.orderBy)
+  {
+    if (!isColumn(order.first))
+    {
+      throw std::invalid_argument("Wrong order " + order.first +
+                                  " for table " + info.name);
+    }
+  }
+  const bool hasId =
+      std::find(colNames.begin(), colNames.end(), "id") != colNames.end();
+  const auto &pager = filters.pager;
+  if (pager.enabled && !hasId)
+  {
+    throw std::invalid_argument("Wrong pager: table " + info.name +
+                                " has no id column");
+  }
+  if (pager.enabled && (pager.afterId >= 0) && !filters.orderBy.empty())
+  {
+    throw std::invalid_argument(
+        "Wrong pager: afterId requires the order by id");
+  }
+
+  std::vector<const SvtDbEntry *> rows;
+  if (!filters.ids.empty())
+  {
+    const std::set<long long> ids(filters.ids.begin(), filters.ids.end());
+    for (const auto id : ids)
+    {
+      const auto row = table.ids.find(id);
+      if (row != table.ids.end())
+      {
+        rows.push_back(&table.rows[row->second]);
+      }
+    }
+  }
+  else
+  {
+    rows.reserve(table.rows.size());
+    for (const auto &row : table.rows)
+    {
+      rows.push_back(&row);
+    }
+  }
+
+  if (!conditions.empty())
+  {
+    const auto condition = SqlCondition::allOf(std::move(conditions));
+    rows.erase(std::remove_if(rows.begin(), rows.end(),
+                              [&](const SvtDbEntry *row)
+                              {
+                                return !condition.matches(
+                                    [&](const std::string &column)
+                                    { return lookup(info, *row, column); });
+                              }),
+               rows.end());
+  }
+
+  std::stable_sort(rows.begin(), rows.end(),
+                   [&](const SvtDbEntry *a, const SvtDbEntry *b)
+                   {
+                     for (const auto &order : filters.orderBy)
+                     {
+                       const int result =
+                           compareJson(lookup(info, *a, order.first),
+                                       lookup(info, *b, order.first));
+                       if (result)
+                       {
+                         return order.second ? (result > 0) : (result < 0);
+                       }
+                     }
+                     return hasId && (getId(*a) < getId(*b));
+                   });
+
+  totalCount = rows.size();
+  if (!filters.ids.empty() && (filters.ids.size() != totalCount))
+  {
+    throw std::runtime_error(
+        "unmatching returned elements and requested filter size");
+  }
+
+  if (pager.enabled)
+  {
+    if (pager.afterId >= 0)
+    {
+      rows.erase(rows.begin(),
+                 std::find_if(rows.begin(), rows.end(),
+                              [&](const SvtDbEntry *row)
+                              { return getId(*row) > pager.afterId; }));
+    }
+    rows.erase(rows.begin(),
+               rows.begin() + std::min(pager.offset, rows.size()));
+    rows.resize(std::min(pager.limit, rows.size()));
+  }
+  return rows;
+}
+
+//========================================================================+
+bool SvtDbAgent::SvtDbMemoryStorage::select(const SvtDbTableInfo &table,
+                                            const SvtDbFilters &filters,
+                                            std::vector<SvtDbEntry> &entries,
+                                            size_t &totalCount)
+{
+  std::lock_guard<std::recursive_mutex> lock(mMutex);
+  entries.clear();
+  try
+  {
+    const auto rows = query(table, filters, totalCount);
+    entries.reserve(rows.size());
+    for (const auto *row : rows)
+    {
+      SvtDbEntry entry;
+      for (const auto &colName : table.colNames)
+      {
+        const auto *value = lookup(table, *row, colName);
+        entry.values.insert({colName, value ? *value : nullptr});
+      }
+      entry.values.insert({"version", versionOf(*row)});
+      entries.push_back(std::move(entry));
+    }
+  }
+  catch (const std::exception &e)
+  {
+    Singleton<SvtLogger>::instance().logError(e.what());
+    entries.clear();
+    return false;
+  }
+  return true;
+}
+
+//========================================================================+
+size_t SvtDbAgent::SvtDbMemoryStorage::selectJson(const SvtDbTableInfo &table,
+                                                  const SvtDbFilters &filters,
+                                                  std::string &items)
+{
+  std::lock_guard<std::recursive_mutex> lock(mMutex);
+  size_t totalCount = 0;
+  const auto rows = query(table, filters, totalCount);
+
+  items = "[";
+  for (const auto *row : rows)
+  {
+    nlohmann::ordered_json entry_j;
+    for (const auto &colName : table.colNames)
+    {
+      const auto *value = lookup(table, *row, colName);
+      entry_j[colName] = value ? *value : nullptr;
+    }
+    entry_j["version"] = versionOf(*row);
+    if (items.size() > 1)
+    {
+      items += ',';
+    }
+    items += entry_j.dump();
+  }
+  items += "]";
+  return totalCount;
+}
+
+//========================================================================+
+bool SvtDbAgent::SvtDbMemoryStorage::checkValue(const Column &column,
+                                                nlohmann::basic_json<> &value,
+                                                std::string &message)
+{
+  if (value.is_null())
+  {
+    if (column.notNull)
+    {
+      message = "null value in column " + column.name +
+                " violates not-null constraint";
+      return false;
+    }
+    return true;
+  }
+
+  if (!column.enumType.empty())
+  {
+    const auto &values = mEnums[column.enumType];
+    if (!value.is_string() ||
+        (std::find(values.begin(), values.end(), value.get<std::string>()) ==
+         values.end()))
+    {
+      message = "invalid input value for enum " + column.enumType + ": " +
+                value.dump();
+      return false;
+    }
+  }
+  else if ((column.type == "integer") || (column.type == "bigint"))
+  {
+    //! text is cast by the server as well
+    if (value.is_string())
+    {
+      const std::string text = value.get<std::string>();
+      size_t end = 0;
+      try
+      {
+        const long long number = std::stoll(text, &end);
+        if (end == text.size())
+        {
+          value = number;
+        }
+      }
+      catch (const std::exception &)
+      {
+      }
+    }
+    if (!value.is_number_integer())
+    {
+      message = "invalid input syntax for type integer: " + value.dump();
+      return false;
+    }
+  }
+  else if ((column.type == "boolean") && !value.is_boolean())
+  {
+    message = "invalid input syntax for type boolean: " + value.dump();
+    return false;
+  }
+
+  if (!column.references.empty())
+  {
+    const auto related = mTables.find(column.references);
+    if (!value.is_number_integer() || (related == mTables.end()) ||
+        !related->second.ids.count(value.get<long long>()))
+    {
+      message = "value of " + column.name + " violates foreign key constraint"
+                " on " + column.references;
+      return false;
+    }
+  }
+  return true;
+}
+
+//========================================================================+
+bool SvtDbAgent::SvtDbMemoryStorage::checkRow(Table &table, SvtDbEntry &row,
+                                              std::string &message)
+{
+  //! rows of tables without schema are not checked
+  if (table.columns.empty())
+  {
+    return true;
+  }
+
+  for (const auto &item : row.values)
+  {
+    if (std::none_of(table.columns.begin(), table.columns.end(),
+                     [&](const Column &column)
+                     { return column.name == item.first; }))
+    {
+      message = "column " + item.first + " does not exist";
+      return false;
+    }
+  }
+
+  for (const auto &column : table.columns)
+  {
+    auto &value = row.values[column.name];
+    if (value.is_null() && column.identity)
+    {
+      value = mProvisionalIds ? table.nextProvisionalId : table.nextId;
+    }
+    else if (value.is_null() && column.defaultNow)
+    {
+      value = currentTimestamp();
+    }
+    if (!checkValue(column, value, message))
+    {
+      return false;
+    }
+    if (column.identity)
+    {
+      const long long id = value.get<long long>();
+      table.nextId = std::max(table.nextId, id + 1);
+      table.nextProvisionalId = std::min(table.nextProvisionalId, id - 1);
+    }
+    if (column.unique && !value.is_null() &&
+        table.uniques[column.name].count(value.dump()))
+    {
+      message = "duplicate key value violates unique constraint on " +
+                column.name + ": " + value.dump();
+      return false;
+    }
+  }
+  return true;
+}
+
+//========================================================================+
+void SvtDbAgent::SvtDbMemoryStorage::setUniques(Table &table,
+                                                const SvtDbEntry &row,
+                                                bool add)
+{
+  for (const auto &column : table.columns)
+  {
+    const auto value = row.values.find(column.name);
+    if (!column.unique || (value == row.values.end()) ||
+        value->second.is_null())
+    {
+      continue;
+    }
+    if (add)
+    {
+      table.uniques[column.name].insert(value->second.dump());
+    }
+    else
+    {
+      table.uniques[column.name].erase(value->second.dump());
+    }
+  }
+}
+
+//========================================================================+
+void SvtDbAgent::SvtDbMemoryStorage::append(const std::string &tableName,
+                                            Table &table, SvtDbEntry &&row)
+{
+  if (const auto id = getId(row))
+  {
+    table.ids[*id] = table.rows.size();
+  }
+  setUniques(table, row, true);
+  table.rows.push_back(std::move(row));
+  if (mDepth)
+  {
+    mUndo.push_back({tableName, table.rows.size() - 1, std::nullopt});
+  }
+}
+
+//========================================================================+
+void SvtDbAgent::SvtDbMemoryStorage::removeLast(Table &table)
+{
+  //! identities are not reused, as a sequence
+  const SvtDbEntry &row = table.rows.back();
+  if (const auto id = getId(row))
+  {
+    table.ids.erase(*id);
+  }
+  setUniques(table, row, false);
+  table.rows.pop_back();
+}
+
+//========================================================================+
+void SvtDbAgent::SvtDbMemoryStorage::rollback(size_t mark)
+{
+  while (mUndo.size() > mark)
+  {
+    Undo &undo = mUndo.back();
+    Table &table = mTables[undo.tableName];
+    if (!undo.previous)
+    {
+      removeLast(table);
+    }
+    else
+    {
+      setUniques(table, table.rows[undo.row], false);
+      table.rows[undo.row] = std::move(*undo.previous);
+      setUniques(table, table.rows[undo.row], true);
+    }
+    mUndo.pop_back();
+  }
+}
+
+//========================================================================+
+bool SvtDbAgent::SvtDbMemoryStorage::insert(const SvtDbTableInfo &info,
+                                            const SvtDbEntry &entry,
+                                            SvtDbEntry &created)
+{
+  std::lock_guard<std::recursive_mutex> lock(mMutex);
+  std::string message;
+  try
+  {
+    Table &table = getTable(info.name);
+    SvtDbEntry row = entry;
+    if (!checkRow(table, row, message))
+    {
+      Singleton<SvtLogger>::instance().logError("Insert into " + info.name +
+                                                ": " + message);
+      return false;
+    }
+    created.values.clear();
+    for (const auto &colName : info.colNames)
+    {
+      const auto value = row.values.find(colName);
+      created.values.insert(
+          {colName, (value != row.values.end()) ? value->second : nullptr});
+    }
+    append(info.name, table, std::move(row));
+  }
+  catch (const std::invalid_argument &e)
+  {
+    Singleton<SvtLogger>::instance().logError(e.what());
+    return false;
+  }
+  return true;
+}
+
+//========================================================================+
+bool SvtDbAgent::SvtDbMemoryStorage::insertAll(
+    const SvtDbTableInfo &info, const std::vector<SvtDbEntry> &entries)
+{
+  if (entries.empty())
+  {
+    return true;
+  }
+
+  std::lock_guard<std::recursive_mutex> lock(mMutex);
+  Table &table = getTable(info.name);
+  const size_t first = table.rows.size();
+  const size_t mark = mUndo.size();
+  std::string message;
+  for (const auto &entry : entries)
+  {
+    if (entry.values.size() != entries.front().values.size())
+    {
+      message = "Unmatching columns in bulk insert into " + info.name;
+    }
+    SvtDbEntry row = entry;
+    if (!message.empty() || !checkRow(table, row, message))
+    {
+      //! all rows or none, as a COPY
+      while (table.rows.size() > first)
+      {
+        removeLast(table);
+      }
+      mUndo.erase(mUndo.begin() + std::min(mark, mUndo.size()), mUndo.end());
+      Singleton<SvtLogger>::instance().logError("Insert into " + info.name +
+                                                ": " + message);
+      return false;
+    }
+    append(info.name, table, std::move(row));
+  }
+  return true;
+}
+
+//========================================================================+
+bool SvtDbAgent::SvtDbMemoryStorage::update(const SvtDbTableInfo &info,
+                                            int id, const SvtDbEntry &entry)
+{
+  std::lock_guard<std::recursive_mutex> lock(mMutex);
+  std::string message;
+  try
+  {
+    Table &table = getTable(info.name);
+    const auto index = table.ids.find(id);
+    if (index == table.ids.end())
+    {
+      throw std::invalid_argument("No row with id " + std::to_string(id) +
+                                  " in " + info.name);
+    }
+
+    const SvtDbEntry &previous = table.rows[index->second];
+    SvtDbEntry row = previous;
+    for (const auto &item : entry.values)
+    {
+      if (item.second.is_null())
+      {
+        continue;
+      }
+      auto value = item.second;
+      auto &current = row.values[item.first];
+      const auto column =
+          std::find_if(table.columns.begin(), table.columns.end(),
+                       [&](const Column &c) { return c.name == item.first; });
+      if (item.first == "id")
+      {
+        message = "id cannot be updated";
+      }
+      else if (table.columns.empty())
+      {
+        //! rows of tables without schema are not checked
+      }
+      else if (column == table.columns.end())
+      {
+        message = "column " + item.first + " does not exist";
+      }
+      else if (checkValue(*column, value, message) && column->unique &&
+               (value != current) &&
+               table.uniques[item.first].count(value.dump()))
+      {
+        message = "duplicate key value violates unique constraint on " +
+                  item.first + ": " + value.dump();
+      }
+      if (message.empty())
+      {
+        current = std::move(value);
+        continue;
+      }
+      throw std::invalid_argument("Update of " + info.name + ": " + message);
+    }
+
+    if (mDepth)
+    {
+      mUndo.push_back({info.name, index->second, previous});
+    }
+    setUniques(table, previous, false);
+    table.rows[index->second] = std::move(row);
+    setUniques(table, table.rows[index->second], true);
+  }
+  catch (const std::invalid_argument &e)
+  {
+    Singleton<SvtLogger>::instance().logError(e.what());
+    return false;
+  }
+  return true;
+}
+
+//========================================================================+
+bool SvtDbAgent::SvtDbMemoryStorage::exists(const SvtDbTableInfo &info,
+                                            int id)
+{
+  std::lock_guard<std::recursive_mutex> lock(mMutex);
+  const auto table = mTables.find(info.name);
+  return (table != mTables.end()) && table->second.ids.count(id);
+}
+
+//========================================================================+
+std::map<std::string, std::string>
+SvtDbAgent::SvtDbMemoryStorage::getReferences(const std::string &tableName)
+{
+  std::lock_guard<std::recursive_mutex> lock(mMutex);
+  std::map<std::string, std::string> references;
+  const auto table = mTables.find(tableName);
+  if (table != mTables.end())
+  {
+    for (const auto &column : table->second.columns)
+    {
+      if (!column.references.empty())
+      {
+        references[column.name] = column.references;
+      }
+    }
+  }
+  return references;
+}
+
+//========================================================================+
+bool SvtDbAgent::SvtDbMemoryStorage::getEnumTypes(
+    std::map<std::string, std::vector<std::string>> &enums)
+{
+  std::lock_guard<std::recursive_mutex> lock(mMutex);
+  enums = mEnums;
+  return true;
+}
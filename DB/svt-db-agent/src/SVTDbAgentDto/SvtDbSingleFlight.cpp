@@ -0,0 +1,98 @@
+/*!
+ * @file SvtDbSingleFlight.cpp
+ * @date Oct-2026
+ * @brief Coalescing of identical concurrent reads
+ */
+
+#include "SVTDbAgentDto/SvtDbSingleFlight.h"
+#include "Database/dbdeadline.h"
+#include "SVTUtilities/SvtUtilities.h"
+
+#include <exception>
+#include <utility>
+
+//========================================================================+
+SvtDbAgent::SvtDbSingleFlight::SvtDbSingleFlight()
+    : mEnabled(SvtDbAgent::db_coalesce_reads == "1")
+{
+}
+
+//========================================================================+
+SvtDbAgent::SvtDbSingleFlight::Reply SvtDbAgent::SvtDbSingleFlight::run(
+    const std::string &key, const std::function<std::string()> &read)
+{
+  if (!mEnabled)
+  {
+    ++mExecuted;
+    return std::make_shared<const std::string>(read());
+  }
+
+  const std::string flightKey =
+      std::to_string(mGeneration.load()) + ':' + key;
+  std::promise<Reply> promise;
+  std::shared_future<Reply> flight;
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = mFlights.find(flightKey);
+    if (it != mFlights.end())
+    {
+      flight = it->second;
+    }
+    else
+    {
+      mFlights.emplace(flightKey, promise.get_future().share());
+    }
+  }
+
+  if (flight.valid())
+  {
+    ++mCoalesced;
+    if (DbDeadline::isSet() &&
+        (flight.wait_until(DbDeadline::get()) != std::future_status::ready))
+    {
+      throw DbTimeoutError("deadline reached waiting for the same read");
+    }
+    return flight.get();
+  }
+
+  //! the callers arriving once it is removed start a new read
+  auto finish = [this, &flightKey]() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mFlights.erase(flightKey);
+  };
+  ++mExecuted;
+  try
+  {
+    Reply reply = std::make_shared<const std::string>(read());
+    finish();
+    promise.set_value(reply);
+    return reply;
+  }
+  catch (...)
+  {
+    finish();
+    promise.set_exception(std::current_exception());
+    throw;
+  }
+}
+
+//========================================================================+
+nlohmann::ordered_json SvtDbAgent::SvtDbSingleFlight::getStats()
+{
+  nlohmann::ordered_json stats;
+  stats["enabled"] = isEnabled();
+  stats["executed"] = mExecuted.load();
+  stats["coalesced"] = mCoalesced.load();
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    stats["inFlight"] = mFlights.size();
+  }
+  return stats;
+}
+
+//========================================================================+
+void SvtDbAgent::SvtDbSingleFlight::resetStats()
+{
+  mExecuted = 0;
+  mCoalesced = 0;
+}
@@ -0,0 +1,78 @@
+/*!
+ * @file SvtDbStorage.cpp
+ * @date Oct-2026
+ * @brief Storage backend of the DTOs
+ */
+
+#include "SVTDbAgentDto/SvtDbStorage.h"
+#include "Database/databaseinterface.h"
+#include "Database/dbtransaction.h"
+#include "SVTDbAgentDto/SvtDbSingleFlight.h"
+#include "SVTUtilities/SvtUtilities.h"
+
+#include <functional>
+#include <sstream>
+
+namespace
+{
+  std::unique_ptr<SvtDbAgent::SvtDbStorage> storage;
+}  // namespace
+
+//========================================================================+
+SvtDbAgent::SvtDbStorage *SvtDbAgent::SvtDbStorage::get()
+{
+  return storage.get();
+}
+
+//========================================================================+
+std::string SvtDbAgent::SvtDbStorage::rowVersion(const SvtDbEntry &row)
+{
+  nlohmann::json values = nlohmann::json::object();
+  for (const auto &item : row.values)
+  {
+    if (item.first != "version")
+    {
+      values[item.first] = item.second;
+    }
+  }
+  std::ostringstream version;
+  version << std::hex << std::hash<std::string>()(values.dump());
+  return version.str();
+}
+
+//========================================================================+
+void SvtDbAgent::SvtDbStorage::install(std::unique_ptr<SvtDbStorage> other)
+{
+  storage = std::move(other);
+}
+
+//========================================================================+
+SvtDbAgent::SvtDbStorageTransaction::SvtDbStorageTransaction()
+{
+  if (SvtDbStorage *other = SvtDbStorage::get())
+  {
+    mTransaction = other->begin();
+  }
+  else
+  {
+    mDbTransaction = std::make_unique<DbTransaction>(
+        Singleton<DatabaseInterface>::instance());
+  }
+}
+
+//========================================================================+
+SvtDbAgent::SvtDbStorageTransaction::~SvtDbStorageTransaction() = default;
+
+//========================================================================+
+void SvtDbAgent::SvtDbStorageTransaction::commit()
+{
+  if (mTransaction)
+  {
+    mTransaction->commit();
+  }
+  else
+  {
+    mDbTransaction->commit();
+  }
+  Singleton<SvtDbSingleFlight>::instance().noteWrite();
+}
@@ -20,4 +20,7 @@ SvtDbAgent::SvtDbWPProjectDto::SvtDbWPProjectDto()
   addColName("alignmentDie");
   addColName("homeDie");
   addColName("local2GlobalMap");
+
+  addRelation("wpMachine", "WaferProbeMachine", "wpMachineId");
+  addRelation("waferType", "WaferType", "waferTypeId");
 }
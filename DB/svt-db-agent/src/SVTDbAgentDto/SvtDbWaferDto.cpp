@@ -6,9 +6,10 @@
  */
 
 #include "SVTDbAgentDto/SvtDbWaferDto.h"
-#include "SVTDb/SvtDbInterface.h"
+#include "Database/databaseinterface.h"
 #include "SVTDbAgentDto/SvtDbAsicDto.h"
 #include "SVTDbAgentDto/SvtDbBaseDto.h"
+#include "SVTDbAgentDto/SvtDbStorage.h"
 #include "SVTDbAgentDto/SvtDbWaferTypeDto.h"
 #include "SVTDbAgentService/SvtDbAgentMessage.h"
 #include "SVTUtilities/SvtLogger.h"
@@ -28,6 +29,10 @@ SvtDbAgent::SvtDbWaferDto::SvtDbWaferDto()
   addColName("thinningDate");
   addColName("dicingDate");
   addColName("productionDate");
+
+  addRelation("waferType", "WaferType", "waferTypeId");
+
+  setStreamBatchSize(kStreamBatchSize);
 }
 
 //========================================================================+
@@ -40,6 +45,8 @@ SvtDbAgent::SvtDbWaferLocationDto::SvtDbWaferLocationDto()
   addColName("creationTime");
   addColName("username");
   addColName("note");
+
+  addRelation("wafer", "Wafer", "waferId");
 }
 
 //========================================================================+
@@ -58,16 +65,19 @@ void SvtDbAgent::SvtDbWaferDto::createEntry(
 
   parseData(entry_j, waferEntry);
 
+  //! wafer, location and asics are committed together
+  SvtDbStorageTransaction transaction;
+
   //! create entry in DB
   Singleton<SvtLogger>::instance().logInfo("Creating Wafer in DB");
-  if (!createEntryInDB(waferEntry))
+  SvtDbEntry created;
+  if (!createEntryInDB(waferEntry, created))
   {
     throw std::runtime_error("Entry was not created in " + getTableName());
     return;
   }
-
-  const auto newEntryId = SvtDbInterface::getMaxId(getTableName());
-  getEntryWithId(waferEntry, newEntryId);
+  waferEntry = std::move(created);
+  const auto newEntryId = waferEntry.values.at("id").get<int>();
 
   Singleton<SvtLogger>::instance().logInfo("Creating Waferlocation in DB");
   //! Create waferLocations
@@ -83,7 +93,14 @@ void SvtDbAgent::SvtDbWaferDto::createEntry(
   }
 
   Singleton<SvtLogger>::instance().logInfo("Creating all Asics in DB");
+  //! tables of another storage are not partitioned
+  if (!SvtDbStorage::get())
+  {
+    Singleton<SvtDbAsicDto>::instance().getPartitions().ensurePartition(
+        newEntryId);
+  }
   createAllAsics(waferEntry);
+  transaction.commit();
   Singleton<SvtLogger>::instance().logInfo("Creating reply SvtDbAgentMessage");
   createEntryReplyMsg(waferEntry, replyMsg);
 }
@@ -91,7 +108,6 @@ void SvtDbAgent::SvtDbWaferDto::createEntry(
 //========================================================================+
 void SvtDbAgent::SvtDbWaferDto::createAllAsics(const SvtDbEntry &wafer)
 {
-  int waferId = wafer.values.at("id").get<int>();
   int waferTypeId = wafer.values.at("waferTypeId").get<int>();
 
   SvtDbWaferTypeDto &waferType = Singleton<SvtDbWaferTypeDto>::instance();
@@ -101,9 +117,48 @@ void SvtDbAgent::SvtDbWaferDto::createAllAsics(const SvtDbEntry &wafer)
   std::string waferMap = waferTypeEntry.values["waferMap"].get<std::string>();
   nlohmann::json waferMap_j = nlohmann::json::parse(waferMap);
 
+  std::vector<SvtDbEntry> asics;
+  expandAsics(wafer, waferMap_j, asics);
+
+  //! stream all asics of the wafer in one COPY
+  Singleton<SvtLogger>::instance().logInfo(
+      "Inserting " + std::to_string(asics.size()) + " asics");
+  Singleton<SvtDbAsicDto>::instance().createEntriesInDB(asics);
+
+  return;
+}
+
+//========================================================================+
+namespace
+{
+  //! member of a json object, null if missing, the optional sections of the
+  //! wafer map read as empty
+  const nlohmann::json &member(const nlohmann::json &object_j,
+                               const std::string &key)
+  {
+    static const nlohmann::json null_j;
+    if (!object_j.is_object())
+    {
+      return null_j;
+    }
+    auto it = object_j.find(key);
+    return (it != object_j.end()) ? *it : null_j;
+  }
+}  // namespace
+
+//========================================================================+
+void SvtDbAgent::SvtDbWaferDto::expandAsics(const SvtDbEntry &wafer,
+                                            const nlohmann::json &waferMap_j,
+                                            std::vector<SvtDbEntry> &asics)
+{
+  int waferId = wafer.values.at("id").get<int>();
+  SvtDbWaferTypeDto &waferType = Singleton<SvtDbWaferTypeDto>::instance();
+
   std::map<int, std::string> g_map_ordered;
 
-  for (auto &[mapG_row_name, mapG_cols] : waferMap_j["MapGroups"].items())
+  const nlohmann::json &mapGroups_j = member(waferMap_j, "MapGroups");
+  const nlohmann::json &groups_j = member(waferMap_j, "Groups");
+  for (auto &[mapG_row_name, mapG_cols] : mapGroups_j.items())
   {
     int asic_row = std::stoi(std::string(mapG_row_name).erase(0, 12));
     g_map_ordered[asic_row] = mapG_row_name;
@@ -115,24 +170,28 @@ void SvtDbAgent::SvtDbWaferDto::createAllAsics(const SvtDbEntry &wafer)
     size_t mapG_col_index = 0;
     int asic_row = g_row_item.first;
     int asic_col = 0;
-    for (auto &mapG_col :
-         waferMap_j["MapGroups"][g_row_item.second]["MapGroupsColumns"])
+    for (auto &mapG_col : member(member(mapGroups_j, g_row_item.second),
+                                 "MapGroupsColumns"))
     {
-      std::string g_name = mapG_col["GroupName"];
-      auto g_size = waferMap_j["Groups"][g_name].size();
+      std::string g_name = member(mapG_col, "GroupName");
+      const nlohmann::json &group_j = member(groups_j, g_name);
+      auto g_size = group_j.size();
 
       std::vector<int> existingAsics;
       std::vector<int> mecDamagedAsics;
       std::vector<int> coveredAsics;
       std::vector<int> mecIntegerAsics;
-      if (!waferType.parse_range(g_size, mapG_col["ExistingAsics"],
+      if (!waferType.parse_range(g_size, member(mapG_col, "ExistingAsics"),
                                  existingAsics) ||
-          !waferType.parse_range(g_size, mapG_col["MechanicallyDamagedASICs"],
-                                 mecDamagedAsics) ||
-          !waferType.parse_range(g_size, mapG_col["ASICsCoveredByGreenLayer"],
-                                 coveredAsics) ||
-          !waferType.parse_range(g_size, mapG_col["MechanicallyIntegerASICs"],
-                                 mecIntegerAsics))
+          !waferType.parse_range(
+              g_size, member(mapG_col, "MechanicallyDamagedASICs"),
+              mecDamagedAsics) ||
+          !waferType.parse_range(
+              g_size, member(mapG_col, "ASICsCoveredByGreenLayer"),
+              coveredAsics) ||
+          !waferType.parse_range(
+              g_size, member(mapG_col, "MechanicallyIntegerASICs"),
+              mecIntegerAsics))
       {
         std::ostringstream ss;
         ss << "Error creating Asic. MapGroups: " << g_row_item.second
@@ -179,8 +238,13 @@ void SvtDbAgent::SvtDbWaferDto::createAllAsics(const SvtDbEntry &wafer)
         }
 
         std::string asic_familytype;
-        SvtDbAgent::get_v(waferMap_j["Groups"][g_name][asic_index],
-                          "FamilyType", asic_familytype);
+        const bool inGroup = group_j.is_array() && (asic_index >= 0) &&
+                             (static_cast<size_t>(asic_index) < g_size);
+        if (inGroup && group_j[asic_index].contains("FamilyType"))
+        {
+          SvtDbAgent::get_v(group_j[asic_index], "FamilyType",
+                            asic_familytype);
+        }
 
         if (asic_familytype.empty())
         {
@@ -198,12 +262,10 @@ void SvtDbAgent::SvtDbWaferDto::createAllAsics(const SvtDbEntry &wafer)
         asic.values.insert({"familyType", asic_familytype});
         asic.values.insert({"quality", asic_quality});
 
-        Singleton<SvtDbAsicDto>::instance().createEntryInDB(asic);
+        asics.push_back(std::move(asic));
         ++asic_col;
       }
       ++mapG_col_index;
     }
   }
-
-  return;
 }
@@ -117,7 +117,8 @@ bool SvtDbAgentProducer::push(const std::string_view &topic,
   /*
    * Produce message
    */
-  const size_t payload_size = message.getPayload().dump().size();
+  const std::string payload = message.serializePayload();
+  const size_t payload_size = payload.size();
   while (true)
   {
     RdKafka::ErrorCode resp = m_producer->produce(
@@ -126,7 +127,7 @@ bool SvtDbAgentProducer::push(const std::string_view &topic,
         std::string(topic), m_partition,
         RdKafka::Producer::RK_MSG_COPY /*Copy payload*/,
         /* Value */
-        const_cast<char *>(message.getPayload().dump().c_str()), payload_size,
+        const_cast<char *>(payload.c_str()), payload_size,
         /* Key */
         NULL, 0,
         /* Timestamp (defaults to now) */
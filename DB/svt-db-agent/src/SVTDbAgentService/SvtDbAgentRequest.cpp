@@ -19,3 +19,25 @@ SvtDbAgent::RequestType SvtDbAgent::getRequestType(std::string_view type_req)
   }
   return RequestType::NotFound;
 }
+
+//========================================================================+
+bool SvtDbAgent::isWriteRequest(RequestType type_req)
+{
+  switch (type_req)
+  {
+  case CreateWaferType:
+  case CreateWafer:
+  case UpdateWafer:
+  case UpdateWaferLocation:
+  case CreateAsic:
+  case CreateWaferProbeMachine:
+  case UpdateWaferProbeMachine:
+  case UpdateWpMachineLoadedWafer:
+  case UpdateWpMachineInstalledProbeCard:
+  case CreateWaferProbeProject:
+  case CreateProbeCard:
+    return true;
+  default:
+    return false;
+  }
+}
@@ -6,9 +6,13 @@
  */
 
 #include "SVTDbAgentService/SvtDbAgentService.h"
+#include "Database/databaseinterface.h"
+#include "SVTDb/sqlmapi.h"
 #include "SVTDbAgentDto/SvtDbAsicDto.h"
 #include "SVTDbAgentDto/SvtDbEnumDto.h"
 #include "SVTDbAgentDto/SvtDbProbeCardDto.h"
+#include "SVTDbAgentDto/SvtDbSingleFlight.h"
+#include "SVTDbAgentDto/SvtDbStorage.h"
 #include "SVTDbAgentDto/SvtDbWPMachineDto.h"
 #include "SVTDbAgentDto/SvtDbWPProjectDto.h"
 #include "SVTDbAgentDto/SvtDbWaferDto.h"
@@ -21,21 +25,64 @@
 #include "SVTUtilities/SvtUtilities.h"
 #include "librdkafka/rdkafkacpp.h"
 
+#include <charconv>
 #include <cstring>
 #include <exception>
 #include <memory>
+#include <optional>
 #include <ostream>
 #include <sstream>
 #include <string>
 #include <vector>
 
+namespace {
+//! whole string as milliseconds, nullopt on trailing characters or a
+//! value out of range
+std::optional<std::chrono::milliseconds> parseMs(std::string_view text)
+{
+  long long value = 0;
+  const auto [ptr, ec] =
+      std::from_chars(text.data(), text.data() + text.size(), value);
+  if ((ec != std::errc()) || (ptr != text.data() + text.size()))
+  {
+    return std::nullopt;
+  }
+  return std::chrono::milliseconds(value);
+}
+} // namespace
+
 //========================================================================+
-SvtDbAgentService::~SvtDbAgentService() { RdKafka::wait_destroyed(5000); }
+SvtDbAgentService::~SvtDbAgentService()
+{
+  stopWorkers();
+  RdKafka::wait_destroyed(5000);
+}
 
 //========================================================================+
 bool SvtDbAgentService::initEnumTypeList(const std::string &schema)
 {
   logger.logInfo("Initialize enum type list");
+  if (SvtDbAgent::SvtDbStorage *storage = SvtDbAgent::SvtDbStorage::get())
+  {
+    std::map<std::string, std::vector<std::string>> enums;
+    if (!storage->getEnumTypes(enums))
+    {
+      return false;
+    }
+    for (auto &[enum_type, enum_values] : enums)
+    {
+      for (auto &value : enum_values)
+      {
+        SvtDbEnumDto::addValue(enum_type, value);
+      }
+    }
+    if (log_messages)
+    {
+      SvtDbEnumDto::print();
+    }
+    return true;
+  }
+
   std::vector<std::string> enum_types;
   if (!SvtDbEnumDto::getAllEnumTypesInDB(schema, enum_types))
   {
@@ -65,9 +112,138 @@ bool SvtDbAgentService::initEnumTypeList(const std::string &schema)
   return true;
 }
 
+//========================================================================+
+void SvtDbAgentService::getDbStats(const SvtDbAgent::SvtDbAgentMessage &msg,
+                                   SvtDbAgent::SvtDbAgentReplyMsg &replyMsg)
+{
+  DatabaseInterface &dbInterface =
+      SvtDbAgent::Singleton<DatabaseInterface>::instance();
+
+  const ConnectionPoolStats pool = dbInterface.getPoolStats();
+  nlohmann::ordered_json pool_j;
+  pool_j["size"] = pool.size;
+  pool_j["inUse"] = pool.inUse;
+  pool_j["peakInUse"] = pool.peakInUse;
+  pool_j["checkouts"] = pool.checkouts;
+  pool_j["waits"] = pool.waits;
+  pool_j["timeouts"] = pool.timeouts;
+  pool_j["maxWait_us"] = pool.maxWait_us;
+  pool_j["utilization"] = pool.utilization;
+
+  nlohmann::ordered_json data;
+  data["pool"] = std::move(pool_j);
+  data["queries"] = dbInterface.getQueryStats().toJson();
+  //! since the start, whatever the measurement window
+  nlohmann::ordered_json totals_j;
+  totals_j["queries"] = queryCount.load();
+  totals_j["trials"] = queryTrialCount.load();
+  totals_j["queryTime_ms"] = queryTime.load();
+  data["totals"] = std::move(totals_j);
+  if (dbInterface.getFaultInjector().isEnabled())
+  {
+    data["faults"] = dbInterface.getFaultInjector().toJson();
+  }
+  if (SvtDbAgent::SvtDbStorage *storage = SvtDbAgent::SvtDbStorage::get())
+  {
+    auto stats = storage->getStats();
+    if (!stats.is_null())
+    {
+      data["storage"] = std::move(stats);
+    }
+  }
+  auto &flights =
+      SvtDbAgent::Singleton<SvtDbAgent::SvtDbSingleFlight>::instance();
+  data["coalescing"] = flights.getStats();
+
+  //! start a new measurement window if requested
+  const auto &msgData = msg.getPayload()["data"];
+  if (msgData.is_object() && msgData.value("reset", false))
+  {
+    dbInterface.getQueryStats().reset();
+    flights.resetStats();
+  }
+
+  replyMsg.setData(data);
+  replyMsg.setStatus(
+      SvtDbAgent::msgStatus[SvtDbAgent::SvtDbAgentMsgStatus::Success]);
+  replyMsg.setError(0, "");
+}
+
+//========================================================================+
+bool SvtDbAgentService::setRequestTimeouts(const std::string &timeouts)
+{
+  std::stringstream ss(timeouts);
+  std::string item;
+  while (std::getline(ss, item, ','))
+  {
+    if (item.empty())
+    {
+      continue;
+    }
+    const size_t sep = item.find('=');
+    if (sep == std::string::npos)
+    {
+      logger.logError("Wrong request timeout: " + item);
+      return false;
+    }
+    const auto reqType = SvtDbAgent::getRequestType(
+        std::string_view(item).substr(0, sep));
+    if (reqType == SvtDbAgent::RequestType::NotFound)
+    {
+      logger.logError("Wrong request timeout, unknown type: " + item);
+      return false;
+    }
+    const auto timeout = parseMs(std::string_view(item).substr(sep + 1));
+    if (!timeout || (timeout->count() < 0))
+    {
+      logger.logError("Wrong request timeout: " + item);
+      return false;
+    }
+    m_requestTimeouts[reqType] = *timeout;
+  }
+  return true;
+}
+
+//========================================================================+
+std::chrono::milliseconds SvtDbAgentService::getRequestTimeout(
+    const SvtDbAgent::SvtDbAgentMessage &msg,
+    SvtDbAgent::RequestType reqType) const
+{
+  const auto configured = m_requestTimeouts.find(reqType);
+  const std::chrono::milliseconds timeout =
+      (configured != m_requestTimeouts.end()) ? configured->second
+                                              : m_requestTimeout;
+
+  const auto &headers = msg.getHeaders();
+  if (headers.contains("svt_timeoutMs"))
+  {
+    const auto &header = headers["svt_timeoutMs"];
+    const auto requested = header.is_string()
+                               ? parseMs(header.get<std::string>())
+                               : std::nullopt;
+    //! a client may only shorten the deadline of the agent, 0 and
+    //! negative values would disable it
+    if (!requested || (requested->count() <= 0))
+    {
+      logger.logWarning("Ignoring svt_timeoutMs header " + header.dump());
+    }
+    else if ((timeout.count() > 0) && (*requested > timeout))
+    {
+      return timeout;
+    }
+    else
+    {
+      return *requested;
+    }
+  }
+  return timeout;
+}
+
 //========================================================================+
 bool SvtDbAgentService::configureService(bool stop_eof)
 {
+  //! the consumer starts pulling as soon as it is created
+  startWorkers();
   m_Consumer = std::shared_ptr<SvtDbAgentConsumer>(
       new SvtDbAgentConsumer(m_brokerName, stop_eof));
   m_Producer =
@@ -76,6 +252,87 @@ bool SvtDbAgentService::configureService(bool stop_eof)
   return true;
 }
 
+//========================================================================+
+void SvtDbAgentService::startWorkers()
+{
+  std::lock_guard<std::mutex> lock(m_requestMutex);
+  m_stopWorkers = false;
+  while (m_workers.size() < m_workerCount)
+  {
+    m_workers.emplace_back(&SvtDbAgentService::runWorker, this);
+  }
+  logger.logInfo("Handling requests with " + std::to_string(m_workers.size()) +
+                     " workers",
+                 SvtLogger::Mode::STANDARD);
+}
+
+//========================================================================+
+void SvtDbAgentService::stopWorkers()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_requestMutex);
+    m_stopWorkers = true;
+  }
+  m_requestQueued.notify_all();
+  for (auto &worker : m_workers)
+  {
+    if (worker.joinable())
+    {
+      worker.join();
+    }
+  }
+  m_workers.clear();
+}
+
+//========================================================================+
+void SvtDbAgentService::runWorker()
+{
+  while (true)
+  {
+    PendingRequest request;
+    {
+      std::unique_lock<std::mutex> lock(m_requestMutex);
+      m_requestQueued.wait(
+          lock, [this] { return m_stopWorkers || !m_requests.empty(); });
+      //! the queued requests are answered before stopping
+      if (m_requests.empty())
+      {
+        return;
+      }
+      request = std::move(m_requests.front());
+      m_requests.pop_front();
+    }
+    m_requestTaken.notify_one();
+    try
+    {
+      parseMsg(request.msg, request.status);
+    }
+    catch (const std::exception &e)
+    {
+      logger.logError(std::string("Error: handling request. ") + e.what());
+    }
+  }
+}
+
+//========================================================================+
+void SvtDbAgentService::dispatch(SvtDbAgent::SvtDbAgentReplyMsg &&msg,
+                                 SvtDbAgent::SvtDbAgentMsgStatus status)
+{
+  if (m_workers.empty())
+  {
+    parseMsg(msg, status);
+    return;
+  }
+  {
+    //! the consumer stops reading while every worker has a request waiting
+    std::unique_lock<std::mutex> lock(m_requestMutex);
+    m_requestTaken.wait(
+        lock, [this] { return m_requests.size() < m_workers.size(); });
+    m_requests.push_back({std::move(msg), status});
+  }
+  m_requestQueued.notify_one();
+}
+
 //========================================================================+
 void SvtDbAgentService::stopConsumer(const bool suspended)
 {
@@ -171,7 +428,9 @@ void SvtDbAgentService::processMsgCb(RdKafka::Message *message, void *opaque)
     *(static_cast<bool *>(opaque)) = false;
     status = SvtDbAgent::SvtDbAgentMsgStatus::UnexpectedError;
   }
-  parseMsg(svtMsg, status);
+  //! the message of the callback is only valid until it returns, the
+  //! request was copied out of it
+  dispatch(std::move(svtMsg), status);
 }
 
 //========================================================================+
@@ -190,6 +449,10 @@ void SvtDbAgentService::parseMsg(
   }
   replyMsg.AddHeader("kafka_nest-is-disposed", "00");
 
+  //! reported with the slow statements of this request
+  SlowQueryLog::setCorrelationId(
+      msg.getHeaders().value("kafka_correlationId", std::string()));
+
   if (status != SvtDbAgent::SvtDbAgentMsgStatus::Success)
   {
     replyMsg.setType("");
@@ -215,8 +478,17 @@ void SvtDbAgentService::parseMsg(
       replyMsg.setType(type + std::string("Reply"));
       SvtDbAgent::RequestType reqType =
           SvtDbAgent::getRequestType(std::string_view(type.c_str()));
+      //! every statement of the request is bounded by the deadline
+      const DbDeadline::Scope deadline(getRequestTimeout(msg, reqType));
       try
       {
+        //! write requests commit once, or roll back on exception
+        std::optional<SvtDbAgent::SvtDbStorageTransaction> transaction;
+        if (SvtDbAgent::isWriteRequest(reqType))
+        {
+          transaction.emplace();
+        }
+
         switch (reqType)
         {
           //! enumValues
@@ -290,6 +562,9 @@ void SvtDbAgentService::parseMsg(
           SvtDbAgent::Singleton<SvtDbAgent::SvtDbWPProjectDto>::instance()
               .createEntry(msg, replyMsg);
           break;
+        case SvtDbAgent::RequestType::GetDbStats:
+          getDbStats(msg, replyMsg);
+          break;
         //! Not Found
         case SvtDbAgent::RequestType::NotFound:
         default:
@@ -301,6 +576,51 @@ void SvtDbAgentService::parseMsg(
                                  [SvtDbAgent::SvtDbAgentMsgStatus::BadRequest]);
           replyMsg.setError(-1, ss.str());
         }
+
+        if (transaction)
+        {
+          transaction->commit();
+        }
+      }
+      catch (const DbUnavailableError &e)
+      {
+        logger.logError("Error: requesting " +
+                        std::string(SvtDbAgent::m_requestType[reqType]) +
+                        std::string(". ") + std::string(e.what()));
+        replyMsg.setData(nlohmann::ordered_json());
+        replyMsg.setStatus(SvtDbAgent::msgStatus
+                               [SvtDbAgent::SvtDbAgentMsgStatus::ServiceUnavailable]);
+        replyMsg.setError(-1, e.what());
+      }
+      catch (const DbTimeoutError &e)
+      {
+        logger.logError("Error: requesting " +
+                        std::string(SvtDbAgent::m_requestType[reqType]) +
+                        std::string(" timed out. ") + std::string(e.what()));
+        replyMsg.setData(nlohmann::ordered_json());
+        replyMsg.setStatus(
+            SvtDbAgent::msgStatus[SvtDbAgent::SvtDbAgentMsgStatus::Timeout]);
+        replyMsg.setError(-1, e.what());
+      }
+      catch (const SvtDbAgent::SvtDbNotFoundError &e)
+      {
+        logger.logError("Error: requesting " +
+                        std::string(SvtDbAgent::m_requestType[reqType]) +
+                        std::string(". ") + std::string(e.what()));
+        replyMsg.setData(nlohmann::ordered_json());
+        replyMsg.setStatus(SvtDbAgent::msgStatus
+                               [SvtDbAgent::SvtDbAgentMsgStatus::EntityNotFound]);
+        replyMsg.setError(-1, e.what());
+      }
+      catch (const SvtDbAgent::SvtDbConflictError &e)
+      {
+        logger.logWarning("Conflict: requesting " +
+                          std::string(SvtDbAgent::m_requestType[reqType]) +
+                          std::string(". ") + std::string(e.what()));
+        replyMsg.setData(nlohmann::ordered_json());
+        replyMsg.setStatus(
+            SvtDbAgent::msgStatus[SvtDbAgent::SvtDbAgentMsgStatus::Conflict]);
+        replyMsg.setError(-1, e.what());
       }
       catch (const std::exception &e)
       {
@@ -323,8 +643,9 @@ void SvtDbAgentService::parseMsg(
                    msg.getPayload().dump());
     logger.logInfo("Reply messages: \n" + std::string("Header = ") +
                    replyMsg.getHeaders().dump() + std::string("\nPayload = ") +
-                   replyMsg.getPayload().dump());
+                   replyMsg.serializePayload());
   }
 
   m_Producer->push(topicNames[SvtDbAgentTopicEnum::RequestReply], replyMsg);
+  SlowQueryLog::setCorrelationId("");
 }
@@ -6,3 +6,25 @@
  */
 
 #include "SVTUtilities/SvtUtilities.h"
+#include "SVTUtilities/SvtLogger.h"
+
+#include <exception>
+
+//========================================================================+
+long long SvtDbAgent::getNumericSetting(const char *name,
+                                        const std::string &value,
+                                        long long defaultValue,
+                                        long long max) {
+  try {
+    size_t end = 0;
+    const long long number = std::stoll(value, &end);
+    if ((end == value.size()) && (number >= 0) && (number <= max)) {
+      return number;
+    }
+  } catch (const std::exception &) {
+  }
+  Singleton<SvtLogger>::instance().logError(
+      std::string("Invalid ") + name + "=\"" + value + "\", using " +
+      std::to_string(defaultValue));
+  return defaultValue;
+}
@@ -1,45 +1,267 @@
-/*!
- * @file svt_db_agent.cpp
- * @author Y. Corrales <ycorrale@cern.ch>
- * @date Mar-2025
- * @brief svt_db_agent executable
- */
-
-#include "SVTUtilities/SvtLogger.h"
-#include "SVTUtilities/SvtUtilities.h"
-
-#include "version.h"
-
-#include <nlohmann/json.hpp>
-
-#include <cstdlib>
-#include <iostream>
-
-std::string version = std::string(VERSION);
-
-SvtLogger &logger = SvtDbAgent::Singleton<SvtLogger>::instance();
-
-//========================================================================+
-int main()
-{
-  logger.logInfo("********************** Svt Db Interface Test, version:" +
-                     version,
-                 SvtLogger::Mode::STANDARD);
-
-  try
-  {
-    logger.logInfo("Before", SvtLogger::Mode::STANDARD);
-    nlohmann::basic_json<> value = std::string("Hello");
-    logger.logInfo(value.dump(), SvtLogger::Mode::STANDARD);
-    logger.logInfo("End", SvtLogger::Mode::STANDARD);
-  }
-  catch (const std::exception &e)
-  {
-    std::cout << std::endl
-              << "### Caught exception in the main thread ###" << std::endl
-              << std::endl;
-    std::cout << e.what() << std::endl;
-    return EXIT_FAILURE;
-  }
-  return EXIT_SUCCESS;
-}
+/*!
+ * @file db_IF_test.cpp
+ * @author Y. Corrales <ycorrale@cern.ch>
+ * @date Mar-2025
+ * @brief svt db interface checks
+ *
+ * Known-value checks of the DB layer that need no DB: the decoders of the
+ * postgres binary format, the request filters and the statement text
+ * normalization of the statement cache. Exits with EXIT_FAILURE if one of
+ * them fails.
+ */
+
+#include "Database/dbresult.h"
+#include "Database/statementcache.h"
+#include "SVTDb/sqlmapi.h"
+#include "SVTUtilities/SvtLogger.h"
+#include "SVTUtilities/SvtUtilities.h"
+
+#include "version.h"
+
+#include <nlohmann/json.hpp>
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <type_traits>
+
+std::string version = std::string(VERSION);
+
+SvtLogger &logger = SvtDbAgent::Singleton<SvtLogger>::instance();
+
+static int failures = 0;
+
+//========================================================================+
+static void check(bool ok, const std::string &name)
+{
+  if (!ok)
+  {
+    ++failures;
+    logger.logError("FAILED: " + name);
+  }
+}
+
+//========================================================================+
+static void checkEqual(const std::string &value, const std::string &expected,
+                       const std::string &name)
+{
+  check(value == expected,
+        name + ": '" + value + "', expected '" + expected + "'");
+}
+
+//========================================================================+
+//! value in network byte order, as sent in a binary result
+template <typename T> static std::string bigEndian(T value)
+{
+  std::string bytes(sizeof(T), '\0');
+  auto bits = static_cast<std::make_unsigned_t<T>>(value);
+  for (size_t i = sizeof(T); i > 0; --i)
+  {
+    bytes[i - 1] = static_cast<char>(bits & 0xff);
+    bits >>= 8;
+  }
+  return bytes;
+}
+
+//========================================================================+
+static std::string formatDate(const DbDate &date)
+{
+  return std::to_string(date.year) + "-" + std::to_string(date.month) + "-" +
+         std::to_string(date.day);
+}
+
+//========================================================================+
+static void testBinaryDecoders()
+{
+  using namespace DbBinary;
+
+  //! days since the unix epoch
+  checkEqual(formatDate(civilFromDays(0)), "1970-1-1", "civilFromDays(0)");
+  checkEqual(formatDate(civilFromDays(-1)), "1969-12-31", "civilFromDays(-1)");
+  checkEqual(formatDate(civilFromDays(10957)), "2000-1-1",
+             "civilFromDays(10957)");
+  checkEqual(formatDate(civilFromDays(11016)), "2000-2-29",
+             "civilFromDays(11016)");
+  checkEqual(formatDate(civilFromDays(-719468)), "0-3-1",
+             "civilFromDays(-719468)");
+
+  //! dates count days from 2000-01-01
+  checkEqual(toText(kDate, bigEndian<int32_t>(0)), "2000-01-01", "date 0");
+  checkEqual(toText(kDate, bigEndian<int32_t>(-1)), "1999-12-31", "date -1");
+  checkEqual(toText(kDate, bigEndian<int32_t>(-10957)), "1970-01-01",
+             "date -10957");
+  checkEqual(toText(kDate, bigEndian(std::numeric_limits<int32_t>::max())),
+             "infinity", "date infinity");
+  checkEqual(toText(kDate, bigEndian(std::numeric_limits<int32_t>::min())),
+             "-infinity", "date -infinity");
+
+  //! timestamps count microseconds from 2000-01-01 00:00:00
+  checkEqual(toText(kTimestamp, bigEndian<int64_t>(0)), "2000-01-01 00:00:00",
+             "timestamp 0");
+  checkEqual(toText(kTimestamp, bigEndian<int64_t>(1500000)),
+             "2000-01-01 00:00:01.5", "timestamp 1.5 s");
+  checkEqual(toText(kTimestamp, bigEndian<int64_t>(-1)),
+             "1999-12-31 23:59:59.999999", "timestamp -1 us");
+  checkEqual(toText(kTimestamp, bigEndian<int64_t>(-10957LL * 86400000000LL)),
+             "1970-01-01 00:00:00", "timestamp unix epoch");
+  checkEqual(toText(kTimestamp,
+                    bigEndian<int64_t>(-10957LL * 86400000000LL - 1000000LL)),
+             "1969-12-31 23:59:59", "timestamp before the unix epoch");
+  checkEqual(toText(kTimestamptz, bigEndian<int64_t>(3600000000LL)),
+             "2000-01-01 01:00:00+00", "timestamptz 1 h");
+  checkEqual(
+      toText(kTimestamp, bigEndian(std::numeric_limits<int64_t>::max())),
+      "infinity", "timestamp infinity");
+  checkEqual(
+      toText(kTimestamp, bigEndian(std::numeric_limits<int64_t>::min())),
+      "-infinity", "timestamp -infinity");
+
+  //! float4 is written with the shortest text reading back to the value
+  checkEqual(toText(kFloat4, bigEndian<uint32_t>(0x3dcccccd)), "0.1",
+             "float4 0.1");
+  checkEqual(toText(kFloat4, bigEndian<uint32_t>(0xc0200000)), "-2.5",
+             "float4 -2.5");
+  checkEqual(toText(kFloat4, bigEndian<uint32_t>(0x7f800000)), "Infinity",
+             "float4 Infinity");
+  checkEqual(toText(kFloat4, bigEndian<uint32_t>(0x7fc00000)), "NaN",
+             "float4 NaN");
+  checkEqual(toText(kFloat8, bigEndian<uint64_t>(0x3fb999999999999aULL)),
+             "0.1", "float8 0.1");
+
+  checkEqual(toText(kInt2, bigEndian<int16_t>(-2)), "-2", "int2 -2");
+  checkEqual(toText(kInt4, bigEndian<int32_t>(123456)), "123456",
+             "int4 123456");
+  checkEqual(toText(kInt8, bigEndian<int64_t>(-5000000000LL)), "-5000000000",
+             "int8 -5000000000");
+  checkEqual(toText(kBool, std::string(1, '\1')), "t", "bool true");
+  checkEqual(toText(kBool, std::string(1, '\0')), "f", "bool false");
+  //! text-like columns are the same bytes as in a text result
+  checkEqual(toText(25, "text"), "text", "text");
+
+  bool thrown = false;
+  try
+  {
+    toText(kInt4, bigEndian<int16_t>(1));
+  }
+  catch (const std::invalid_argument &)
+  {
+    thrown = true;
+  }
+  check(thrown, "int4 of 2 bytes throws");
+}
+
+//========================================================================+
+//! does the row, a json object, match the filter of column
+static bool matches(const std::string &column, const nlohmann::json &filter,
+                    const nlohmann::json &row)
+{
+  SqlCondition condition;
+  if (!SqlCondition::fromJson(column, filter, condition))
+  {
+    throw std::invalid_argument("malformed filter " + filter.dump());
+  }
+  return condition.matches(
+      [&row](const std::string &name) -> const nlohmann::json *
+      {
+        const auto value = row.find(name);
+        return (value != row.end()) ? &*value : nullptr;
+      });
+}
+
+//========================================================================+
+static void testFilters()
+{
+  const nlohmann::json five = {{"a", 5}};
+  const nlohmann::json null = {{"a", nullptr}};
+  const nlohmann::json text = {{"a", "x"}};
+
+  check(matches("a", 5, five), "a = 5 on 5");
+  check(!matches("a", 6, five), "a = 6 on 5");
+  check(!matches("a", 5, null), "a = 5 on NULL");
+  check(!matches("a", 5, nlohmann::json::object()), "a = 5 on missing");
+  check(matches("a", nullptr, null), "a IS NULL on NULL");
+  check(!matches("a", nullptr, five), "a IS NULL on 5");
+  check(matches("a", {{"null", false}}, five), "a IS NOT NULL on 5");
+
+  check(matches("a", {1, 5}, five), "a = ANY(1, 5) on 5");
+  check(!matches("a", {1, 2}, five), "a = ANY(1, 2) on 5");
+  check(matches("a", {"w", "x"}, text), "a = ANY('w', 'x') on 'x'");
+  check(matches("a", {{"in", nlohmann::json::array({5})}}, five),
+        "a IN (5) on 5");
+
+  check(matches("a", {{"ge", 5}, {"lt", 6}}, five), "5 <= a < 6 on 5");
+  check(!matches("a", {{"ge", 1}, {"lt", 5}}, five), "1 <= a < 5 on 5");
+  check(matches("a", {{"between", {1, 5}}}, five), "a BETWEEN 1 AND 5 on 5");
+  check(!matches("a", {{"between", {6, 9}}}, five), "a BETWEEN 6 AND 9 on 5");
+  check(matches("a", {{"gt", "w"}}, text), "a > 'w' on 'x'");
+
+  //! comparisons with NULL are unknown, a row is selected only if true
+  check(!matches("a", {{"ne", 1}}, null), "a <> 1 on NULL");
+  check(!matches("a", {{"between", {1, 9}}}, null), "a BETWEEN on NULL");
+  //! values of different types cannot be compared
+  check(!matches("a", "5", five), "a = '5' on 5");
+
+  SqlCondition condition;
+  check(!SqlCondition::fromJson("a", {1, "x"}, condition),
+        "mixed array is malformed");
+  check(!SqlCondition::fromJson("a", nlohmann::json::object(), condition),
+        "empty object is malformed");
+  check(!SqlCondition::fromJson("a", {{"like", "x"}}, condition),
+        "unknown operator is malformed");
+  check(!SqlCondition::fromJson("a", {{"between", nlohmann::json::array({1})}}, condition),
+        "between of one value is malformed");
+  check(!SqlCondition::fromJson("a", {{"ge", nlohmann::json::array({1})}}, condition),
+        "array operand is malformed");
+}
+
+//========================================================================+
+static void testNormalize()
+{
+  checkEqual(StatementCache::normalize("  SELECT  *\n\tFROM t ;; "),
+             "SELECT * FROM t", "whitespace and trailing ;");
+  checkEqual(StatementCache::normalize("SELECT 'a  b', \"c  d\" FROM t"),
+             "SELECT 'a  b', \"c  d\" FROM t", "quoted whitespace kept");
+  checkEqual(StatementCache::normalize("SELECT 1 -- one\n  FROM t"),
+             "SELECT 1 FROM t", "line comment dropped");
+  checkEqual(
+      StatementCache::normalize("SELECT /* a /* nested */ b */ 1 FROM t"),
+      "SELECT 1 FROM t", "nested block comment dropped");
+  checkEqual(StatementCache::normalize("SELECT '-- not a comment'  FROM t"),
+             "SELECT '-- not a comment' FROM t", "comment in a literal");
+  checkEqual(StatementCache::normalize("SELECT $x$ a  -- b $x$  FROM t"),
+             "SELECT $x$ a  -- b $x$ FROM t", "dollar quoted string kept");
+  checkEqual(StatementCache::normalize("SELECT $1,\n  $2  FROM t"),
+             "SELECT $1, $2 FROM t", "parameters");
+}
+
+//========================================================================+
+int main()
+{
+  logger.logInfo("********************** Svt Db Interface Test, version:" +
+                     version,
+                 SvtLogger::Mode::STANDARD);
+
+  try
+  {
+    testBinaryDecoders();
+    testFilters();
+    testNormalize();
+  }
+  catch (const std::exception &e)
+  {
+    std::cout << std::endl
+              << "### Caught exception in the main thread ###" << std::endl
+              << std::endl;
+    std::cout << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (failures)
+  {
+    logger.logError(std::to_string(failures) + " checks failed");
+    return EXIT_FAILURE;
+  }
+  logger.logInfo("All checks passed", SvtLogger::Mode::STANDARD);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,515 @@
+/*!
+ * @file db_bench.cpp
+ * @date Oct-2026
+ * @brief Benchmarks of the svt db agent DB paths
+ *
+ * Usage: db_bench [waferMap.json] [iterations]
+ *
+ * The asic expansion of the wafer map is always timed, and so are
+ * CreateWafer and GetAllAsics requests run from the parsed message to the
+ * serialized reply on the memory storage built from
+ * SVT_DB_AGENT_STORAGE_SCHEMA, without a DB, also from several threads at
+ * once to measure the coalescing of identical reads. When
+ * SVT_DB_BENCH_CONN holds a libpq connection string CreateWafer is also
+ * timed through the agent DB layer, the wafer, its location and its asics in
+ * one BulkInsert, each wafer rolled back. The Asic and Wafer tables are then
+ * scanned through a cursor, once with text and once with binary results,
+ * decoding every cell as the GetAll replies do.
+ *
+ * With SVT_DB_BENCH_LOAD_THREADS > 0 a load driver then runs
+ * SVT_DB_BENCH_LOAD_REQUESTS requests per thread through the agent DB layer,
+ * with the deadline SVT_DB_BENCH_LOAD_DEADLINE_MS and the faults of
+ * SVT_DB_AGENT_FAULTS, and reports the latency percentiles, the outcomes,
+ * the retries and the queueing on the connection pool. The password of the
+ * pool connections is taken from SVT_DB_BENCH_PASSWORD or from ~/.pgpass.
+ */
+
+#include "Database/databaseinterface.h"
+#include "Database/dbresult.h"
+#include "Database/dbtransaction.h"
+#include "SVTDb/sqlmapi.h"
+#include "SVTDbAgentDto/SvtDbAsicDto.h"
+#include "SVTDbAgentDto/SvtDbBaseDto.h"
+#include "SVTDbAgentDto/SvtDbMemoryStorage.h"
+#include "SVTDbAgentDto/SvtDbSingleFlight.h"
+#include "SVTDbAgentDto/SvtDbWaferDto.h"
+#include "SVTDbAgentDto/SvtDbWaferTypeDto.h"
+#include "SVTDbAgentService/SvtDbAgentMessage.h"
+#include "SVTUtilities/SvtLogger.h"
+#include "SVTUtilities/SvtUtilities.h"
+
+#include <nlohmann/json.hpp>
+#include <pqxx/pqxx>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using SvtDbAgent::Singleton;
+using SvtDbAgent::SvtDbEntry;
+using bench_clock = std::chrono::steady_clock;
+
+SvtLogger &logger = Singleton<SvtLogger>::instance();
+
+//========================================================================+
+static double elapsed_ms(bench_clock::time_point t1)
+{
+  return std::chrono::duration<double, std::milli>(bench_clock::now() - t1)
+      .count();
+}
+
+//========================================================================+
+static void report(const std::string &name, double total_ms, int iterations,
+                   size_t rows)
+{
+  std::cout << name << ": " << total_ms / iterations << " ms/wafer, " << rows
+            << " asics" << std::endl;
+}
+
+//========================================================================+
+static DatabaseInterface &openAgentDb(pqxx::connection &conn)
+{
+  DatabaseInterface &db = Singleton<DatabaseInterface>::instance();
+  static bool opened = false;
+  if (opened)
+  {
+    return db;
+  }
+  const char *password = getenv("SVT_DB_BENCH_PASSWORD");
+  db.Init(conn.username(), (password != nullptr) ? password : "",
+          conn.dbname(), (conn.hostname() != nullptr) ? conn.hostname() : "",
+          conn.port(),
+          SvtDbAgent::getNumericSetting("SVT_DB_AGENT_POOL_SIZE",
+                                        SvtDbAgent::db_pool_size, 4));
+  db.getHealthMonitor().setFailureThreshold(
+      SvtDbAgent::getNumericSetting("SVT_DB_AGENT_BREAKER_FAILURES",
+                                    SvtDbAgent::db_breaker_failures, 3));
+  if (!db.connect())
+  {
+    throw std::runtime_error("Cannot open the connection pool");
+  }
+  opened = true;
+  return db;
+}
+
+//========================================================================+
+static SvtDbAgent::SvtDbAgentMessage request(const std::string &type,
+                                             nlohmann::json data)
+{
+  SvtDbAgent::SvtDbAgentMessage msg;
+  msg.setPayload({{"type", type}, {"data", std::move(data)}});
+  return msg;
+}
+
+//========================================================================+
+static void benchCreateWafer(pqxx::connection &conn,
+                             const nlohmann::json &waferMap_j, size_t asics,
+                             int iterations)
+{
+  DatabaseInterface &db = openAgentDb(conn);
+
+  //! the CreateWafer path of the agent: the wafer and its location, the
+  //! Asic partition of the wafer and the asics in one BulkInsert. Every
+  //! iteration is rolled back, the DB is left as it was
+  db.getQueryStats().reset();
+  double total_ms = 0;
+  for (int i = 0; i < iterations; ++i)
+  {
+    DbTransaction transaction(db);
+    SvtDbEntry waferType;
+    waferType.values = {{"name", "BENCH_" + std::to_string(i)},
+                        {"engineeringRun", "ER1"},
+                        {"foundry", "TowerSemiconductor"},
+                        {"technology", "TPSCo65"},
+                        {"waferMap", waferMap_j.dump()}};
+    SvtDbEntry created;
+    if (!Singleton<SvtDbAgent::SvtDbWaferTypeDto>::instance().createEntryInDB(
+            waferType, created))
+    {
+      throw std::runtime_error("Cannot create the wafer type");
+    }
+    const auto msg = request(
+        "CreateWafer",
+        {{"create",
+          {{"batchNumber", i},
+           {"waferTypeId", created.values.at("id").get<int>()},
+           {"serialNumber", "BENCH_" + std::to_string(i)},
+           {"generalLocation", "CERN_186_R_E10"},
+           {"thinningDate", nullptr},
+           {"dicingDate", nullptr},
+           {"productionDate", nullptr}}}});
+
+    const auto t1 = bench_clock::now();
+    SvtDbAgent::SvtDbAgentReplyMsg replyMsg;
+    Singleton<SvtDbAgent::SvtDbWaferDto>::instance().createEntry(msg,
+                                                                  replyMsg);
+    total_ms += elapsed_ms(t1);
+    transaction.rollback();
+  }
+  report("CreateWafer in DB", total_ms, iterations, asics);
+
+  //! share of the asic BulkInsert, the statements on the Asic table
+  const auto tables = db.getQueryStats().toJson()["tables"];
+  if (tables.contains("Asic"))
+  {
+    const auto &asic = tables["Asic"];
+    std::cout << "  Asic statements: "
+              << asic["mean_us"].get<uint64_t>() *
+                     asic["count"].get<uint64_t>() / 1000. / iterations
+              << " ms/wafer" << std::endl;
+  }
+}
+
+//========================================================================+
+static void benchScan(pqxx::connection &conn, const std::string &table,
+                      int iterations)
+{
+  for (const bool binary : {false, true})
+  {
+    double total_ms = 0;
+    double decode_ms = 0;
+    size_t rows = 0;
+    size_t bytes = 0;
+    for (int i = 0; i < iterations; ++i)
+    {
+      rows = 0;
+      bytes = 0;
+      const auto t1 = bench_clock::now();
+      pqxx::work scan(conn);
+      scan.exec(std::string("DECLARE bench_scan ") +
+                (binary ? "BINARY " : "") +
+                "NO SCROLL CURSOR FOR SELECT * FROM " + table);
+      while (true)
+      {
+        DbResult batch(scan.exec("FETCH FORWARD 1000 FROM bench_scan"), binary);
+        if (batch.empty())
+        {
+          break;
+        }
+        const auto t2 = bench_clock::now();
+        nlohmann::ordered_json row_j;
+        for (size_t row = 0; row < batch.size(); ++row)
+        {
+          for (size_t col = 0; col < batch.columns(); ++col)
+          {
+            row_j[batch.columnName(col)] = batch.toJson(row, col);
+          }
+        }
+        decode_ms += elapsed_ms(t2);
+        rows += batch.size();
+        bytes += batch.bytes();
+      }
+      scan.abort();
+      total_ms += elapsed_ms(t1);
+    }
+    std::cout << "Scan " << table << (binary ? " binary" : " text") << ": "
+              << total_ms / iterations << " ms/scan, decode "
+              << decode_ms / iterations << " ms/scan, " << rows << " rows, "
+              << bytes << " bytes" << std::endl;
+  }
+}
+
+//========================================================================+
+static long envLong(const char *name, long defaultValue)
+{
+  const char *value = getenv(name);
+  return (value != nullptr) ? std::atol(value) : defaultValue;
+}
+
+//========================================================================+
+static void benchLoad(pqxx::connection &conn)
+{
+  const long threads = envLong("SVT_DB_BENCH_LOAD_THREADS", 0);
+  if (threads <= 0)
+  {
+    return;
+  }
+  const long requests =
+      std::max(envLong("SVT_DB_BENCH_LOAD_REQUESTS", 200), 1L);
+  const std::chrono::milliseconds deadline(
+      envLong("SVT_DB_BENCH_LOAD_DEADLINE_MS", 0));
+
+  DatabaseInterface &db = openAgentDb(conn);
+  std::string message;
+  if (!db.setFaults(SvtDbAgent::db_faults, message))
+  {
+    throw std::runtime_error(message);
+  }
+
+  std::mutex mutex;
+  std::vector<double> latencies;
+  std::map<std::string, size_t> outcomes;
+  const int trials = queryTrialCount;
+  const int queries = queryCount;
+
+  const auto t1 = bench_clock::now();
+  std::vector<std::thread> workers;
+  for (long thread = 0; thread < threads; ++thread)
+  {
+    workers.emplace_back([&]() {
+      std::vector<double> own;
+      std::map<std::string, size_t> ownOutcomes;
+      for (long i = 0; i < requests; ++i)
+      {
+        const DbDeadline::Scope scope(deadline);
+        const auto t2 = bench_clock::now();
+        std::string outcome = "ok";
+        try
+        {
+          DbResult result;
+          doGenericQuery("SELECT g FROM generate_series(1, $1::integer) AS g",
+                         {100LL}, result);
+        }
+        catch (const DbTimeoutError &)
+        {
+          outcome = "timeout";
+        }
+        catch (const DbUnavailableError &)
+        {
+          outcome = "unavailable";
+        }
+        catch (const std::exception &)
+        {
+          outcome = "error";
+        }
+        own.push_back(elapsed_ms(t2));
+        ++ownOutcomes[outcome];
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      latencies.insert(latencies.end(), own.begin(), own.end());
+      for (const auto &[outcome, count] : ownOutcomes)
+      {
+        outcomes[outcome] += count;
+      }
+    });
+  }
+  for (auto &worker : workers)
+  {
+    worker.join();
+  }
+  const double total_ms = elapsed_ms(t1);
+
+  std::sort(latencies.begin(), latencies.end());
+  const auto percentile = [&latencies](double p) {
+    return latencies[std::min(latencies.size() - 1,
+                              static_cast<size_t>(p * latencies.size()))];
+  };
+  std::cout << "Load " << threads << " threads x " << requests
+            << " requests: " << latencies.size() * 1000. / total_ms
+            << " req/s, p50 " << percentile(0.5) << " ms, p95 "
+            << percentile(0.95) << " ms, p99 " << percentile(0.99)
+            << " ms, max " << latencies.back() << " ms" << std::endl;
+  for (const auto &[outcome, count] : outcomes)
+  {
+    std::cout << "  " << outcome << ": " << count << std::endl;
+  }
+  const ConnectionPoolStats pool = db.getPoolStats();
+  const int retries = (queryTrialCount - trials) - (queryCount - queries);
+  std::cout << "  retries: " << retries << ", pool waits: " << pool.waits << ", pool timeouts: "
+            << pool.timeouts << ", max wait: " << pool.maxWait_us / 1000.
+            << " ms" << std::endl;
+  if (db.getFaultInjector().isEnabled())
+  {
+    std::cout << "  faults: " << db.getFaultInjector().toJson().dump()
+              << std::endl;
+  }
+}
+
+//========================================================================+
+static void benchPipeline(const nlohmann::json &waferMap_j, int iterations)
+{
+  auto storage = std::make_unique<SvtDbAgent::SvtDbMemoryStorage>();
+  std::string message;
+  if (!storage->loadSchema(SvtDbAgent::db_storage_schema, message))
+  {
+    std::cout << "Pipeline skipped: " << message << std::endl;
+    return;
+  }
+  SvtDbAgent::SvtDbMemoryStorage &memory = *storage;
+  SvtDbAgent::SvtDbStorage::install(std::move(storage));
+
+  SvtDbEntry waferType;
+  waferType.values = {{"name", "BENCH"},
+                      {"engineeringRun", "ER1"},
+                      {"foundry", "TowerSemiconductor"},
+                      {"technology", "TPSCo65"},
+                      {"waferMap", waferMap_j.dump()}};
+  SvtDbEntry created;
+  if (!Singleton<SvtDbAgent::SvtDbWaferTypeDto>::instance().createEntryInDB(
+          waferType, created))
+  {
+    throw std::runtime_error("Cannot create the wafer type");
+  }
+  const int waferTypeId = created.values.at("id").get<int>();
+
+  //! as the agent, a write request is one transaction
+  double total_ms = 0;
+  size_t bytes = 0;
+  for (int i = 0; i < iterations; ++i)
+  {
+    const auto t1 = bench_clock::now();
+    const auto msg = request(
+        "CreateWafer",
+        {{"create",
+          {{"batchNumber", i},
+           {"waferTypeId", waferTypeId},
+           {"serialNumber", "BENCH_" + std::to_string(i)},
+           {"generalLocation", "CERN_186_R_E10"},
+           {"thinningDate", nullptr},
+           {"dicingDate", nullptr},
+           {"productionDate", nullptr}}}});
+    SvtDbAgent::SvtDbAgentReplyMsg replyMsg;
+    SvtDbAgent::SvtDbStorageTransaction transaction;
+    Singleton<SvtDbAgent::SvtDbWaferDto>::instance().createEntry(msg,
+                                                                  replyMsg);
+    transaction.commit();
+    replyMsg.parsePayload();
+    bytes += replyMsg.serializePayload().size();
+    total_ms += elapsed_ms(t1);
+  }
+  SvtDbAgent::SvtDbFilters count;
+  count.pager.enabled = true;
+  count.pager.limit = 0;
+  std::vector<SvtDbEntry> entries;
+  size_t asics = 0;
+  memory.select(Singleton<SvtDbAgent::SvtDbAsicDto>::instance().getTableInfo(),
+                count, entries, asics);
+  report("Pipeline CreateWafer", total_ms, iterations, asics / iterations);
+  std::cout << "  " << bytes / iterations << " bytes/reply" << std::endl;
+
+  //! the asics of a wafer by its id and by its serial number
+  for (const bool relation : {false, true})
+  {
+    total_ms = 0;
+    bytes = 0;
+    for (int i = 0; i < iterations; ++i)
+    {
+      const auto t1 = bench_clock::now();
+      const auto msg = request(
+          "GetAllAsics",
+          {{"filter", relation ? nlohmann::json{{"wafer.serialNumber",
+                                                 "BENCH_" +
+                                                     std::to_string(i)}}
+                               : nlohmann::json{{"waferId", i + 1}}}});
+      SvtDbAgent::SvtDbAgentReplyMsg replyMsg;
+      Singleton<SvtDbAgent::SvtDbAsicDto>::instance().getAllEntries(msg,
+                                                                    replyMsg);
+      replyMsg.parsePayload();
+      bytes += replyMsg.serializePayload().size();
+      total_ms += elapsed_ms(t1);
+    }
+    report(relation ? "Pipeline GetAllAsics by wafer.serialNumber"
+                    : "Pipeline GetAllAsics by waferId",
+           total_ms, iterations, asics / iterations);
+    std::cout << "  " << bytes / iterations << " bytes/reply" << std::endl;
+  }
+
+  //! the same GetAllAsics from several threads at once, the reads running
+  //! at the same time are executed once
+  auto &flights = Singleton<SvtDbAgent::SvtDbSingleFlight>::instance();
+  flights.resetStats();
+  const int threads = 8;
+  const auto t1 = bench_clock::now();
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t)
+  {
+    workers.emplace_back([iterations]() {
+      for (int i = 0; i < iterations; ++i)
+      {
+        const auto msg = request("GetAllAsics", {{"filter", {{"waferId", 1}}}});
+        SvtDbAgent::SvtDbAgentReplyMsg replyMsg;
+        Singleton<SvtDbAgent::SvtDbAsicDto>::instance().getAllEntries(
+            msg, replyMsg);
+        replyMsg.parsePayload();
+        replyMsg.serializePayload();
+      }
+    });
+  }
+  for (auto &worker : workers)
+  {
+    worker.join();
+  }
+  report("Pipeline GetAllAsics x" + std::to_string(threads) + " threads",
+         elapsed_ms(t1), iterations * threads, asics / iterations);
+  std::cout << "  " << flights.getStats().dump() << std::endl;
+
+  SvtDbAgent::SvtDbStorage::install(nullptr);
+}
+
+//========================================================================+
+int main(int argc, char *argv[])
+{
+  const std::string mapFile =
+      (argc > 1) ? argv[1]
+                 : "../../Configurations/WaferTypeMappings/ER1WaferMap_v0.json";
+  const int iterations = (argc > 2) ? std::max(std::atoi(argv[2]), 1) : 10;
+
+  try
+  {
+    std::ifstream input(mapFile);
+    if (!input)
+    {
+      throw std::runtime_error("Cannot open " + mapFile);
+    }
+    const nlohmann::json waferMap_j = nlohmann::json::parse(input);
+
+    SvtDbEntry wafer;
+    wafer.values.insert({"id", 1});
+    wafer.values.insert({"serialNumber", "BENCH"});
+
+    //! wafer map expansion
+    std::vector<SvtDbEntry> asics;
+    double total_ms = 0;
+    for (int i = 0; i < iterations; ++i)
+    {
+      asics.clear();
+      const auto t1 = bench_clock::now();
+      Singleton<SvtDbAgent::SvtDbWaferDto>::instance().expandAsics(
+          wafer, waferMap_j, asics);
+      total_ms += elapsed_ms(t1);
+    }
+    report("Wafer map expansion", total_ms, iterations, asics.size());
+
+    benchPipeline(waferMap_j, iterations);
+
+    const char *connString = getenv("SVT_DB_BENCH_CONN");
+    if (connString == nullptr)
+    {
+      std::cout << "SVT_DB_BENCH_CONN not set, skipping DB benchmarks"
+                << std::endl;
+      return EXIT_SUCCESS;
+    }
+    pqxx::connection conn(connString);
+    benchCreateWafer(conn, waferMap_j, asics.size(), iterations);
+    for (const std::string table : {"\"main\".\"Asic\"",
+                                    "\"main\".\"Wafer\""})
+    {
+      try
+      {
+        benchScan(conn, table, iterations);
+      }
+      catch (const pqxx::sql_error &e)
+      {
+        std::cout << "Scan " << table << " skipped: " << e.what() << std::endl;
+      }
+    }
+    benchLoad(conn);
+  }
+  catch (const std::exception &e)
+  {
+    std::cout << std::endl
+              << "### Caught exception in the main thread ###" << std::endl
+              << std::endl;
+    std::cout << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
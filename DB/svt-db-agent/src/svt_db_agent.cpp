@@ -6,18 +6,27 @@
  */
 
 #include "Database/databaseinterface.h"
+#include "SVTDbAgentDto/SvtDbEdgeStorage.h"
+#include "SVTDbAgentDto/SvtDbMemoryStorage.h"
 #include "SVTDbAgentService/SvtDbAgentService.h"
 #include "SVTUtilities/SvtLogger.h"
 #include "SVTUtilities/SvtUtilities.h"
 
 #include "version.h"
 
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <exception>
 #include <iostream>
+#include <memory>
+#include <sstream>
 #include <string>
 #include <thread>
+#include <vector>
 
 using SvtDbAgent::Singleton;
 using DatabaseIF = Singleton<DatabaseInterface>;
@@ -31,10 +40,63 @@ bool connectToDB(std::string &user, std::string &pass, std::string &conn,
                  std::string &host, std::string &port)
 {
   DatabaseInterface &dbInterface = DatabaseIF::instance();
-  if (!dbInterface.Init(user, pass, conn, host, port))
+  if (!dbInterface.Init(user, pass, conn, host, port,
+                        SvtDbAgent::getNumericSetting(
+                            "SVT_DB_AGENT_POOL_SIZE", SvtDbAgent::db_pool_size,
+                            4)))
   {
     return false;
   }
+  dbInterface.setStatementCacheSize(SvtDbAgent::getNumericSetting(
+      "SVT_DB_AGENT_STMT_CACHE_SIZE", SvtDbAgent::db_stmt_cache_size, 128));
+  dbInterface.getHealthMonitor().setKeepalive(
+      std::chrono::seconds(SvtDbAgent::getNumericSetting(
+          "SVT_DB_AGENT_KEEPALIVE", SvtDbAgent::db_keepalive, 30)));
+  dbInterface.getHealthMonitor().setFailureThreshold(
+      SvtDbAgent::getNumericSetting("SVT_DB_AGENT_BREAKER_FAILURES",
+                                    SvtDbAgent::db_breaker_failures, 3));
+  dbInterface.setBinaryResults(SvtDbAgent::db_binary_results == "1");
+  //! read replicas host:port[,host:port...]
+  std::stringstream replicas(SvtDbAgent::db_read_replicas);
+  std::string replica;
+  while (std::getline(replicas, replica, ','))
+  {
+    const size_t colon = replica.rfind(':');
+    if (replica.empty() || (colon == std::string::npos))
+    {
+      continue;
+    }
+    dbInterface.addReadReplica(replica.substr(0, colon),
+                               replica.substr(colon + 1));
+    logger.logInfo("Read replica " + replica);
+  }
+  dbInterface.setReadYourWrites(
+      std::chrono::milliseconds(SvtDbAgent::getNumericSetting(
+          "SVT_DB_AGENT_READ_YOUR_WRITES_MS",
+          SvtDbAgent::db_read_your_writes_ms, 1000)));
+  dbInterface.setSlowQueryThreshold(
+      std::chrono::milliseconds(SvtDbAgent::getNumericSetting(
+          "SVT_DB_AGENT_SLOW_QUERY_MS", SvtDbAgent::db_slow_query_ms, 500)));
+  dbInterface.setSlowQueryLogFile(SvtDbAgent::db_slow_query_log_file);
+  dbInterface.setSlowQueryExplain(
+      SvtDbAgent::db_slow_query_explain == "1",
+      std::chrono::seconds(SvtDbAgent::getNumericSetting(
+          "SVT_DB_AGENT_SLOW_QUERY_EXPLAIN_INTERVAL",
+          SvtDbAgent::db_slow_query_explain_interval, 60)));
+  Singleton<SvtDbAgent::SvtDbMemoryStorage>::instance().setTtl(
+      std::chrono::seconds(SvtDbAgent::getNumericSetting(
+          "SVT_DB_AGENT_CACHE_TTL", SvtDbAgent::db_cache_ttl, 60)));
+  std::string message;
+  if (!dbInterface.setFaults(SvtDbAgent::db_faults, message))
+  {
+    logger.logError(message);
+    return false;
+  }
+  if (dbInterface.getFaultInjector().isEnabled())
+  {
+    logger.logWarning("Fault injection enabled: " + SvtDbAgent::db_faults,
+                      SvtLogger::Mode::STANDARD);
+  }
 
   if (dbInterface.connect())
   {
@@ -60,12 +122,75 @@ int main()
   // take the DB connection out once integrated with FRED
   // but just in case, perhaps checking for connection first will prevent
   // problems
-  std::string psqlhost = "dbod-svt-sw-pgdb.cern.ch";
-  std::string psqlport = "6600";
+  std::string psqlhost = SvtDbAgent::db_host;
+  std::string psqlport = SvtDbAgent::db_port;
   std::string psqluser = "admin";
   std::string psqlpass = "svt-mosaix";
   std::string psqldb = SvtDbAgent::db_name;
-  if (!dbInterface.isConnected())
+  if (SvtDbAgent::db_storage == "memory")
+  {
+    //! the DTO tables are held by the agent, nothing is persisted
+    auto storage = std::make_unique<SvtDbAgent::SvtDbMemoryStorage>();
+    std::string message;
+    if (!storage->loadSchema(SvtDbAgent::db_storage_schema, message))
+    {
+      logger.logError(message);
+      return EXIT_FAILURE;
+    }
+    logger.logWarning("Using the memory storage, the DB is not used",
+                      SvtLogger::Mode::STANDARD);
+    SvtDbAgent::SvtDbStorage::install(std::move(storage));
+  }
+  else if (SvtDbAgent::db_storage == "edge")
+  {
+    //! the requests are served from the replica, the DB may be unreachable
+    if (!connectToDB(psqluser, psqlpass, psqldb, psqlhost, psqlport))
+    {
+      logger.logWarning("Cannot connect to DB, the writes are journaled",
+                        SvtLogger::Mode::STANDARD);
+    }
+    auto storage = std::make_unique<SvtDbAgent::SvtDbEdgeStorage>();
+    std::string site = SvtDbAgent::db_edge_site;
+    if (site.empty())
+    {
+      char host[256] = {};
+      ::gethostname(host, sizeof(host) - 1);
+      site = host;
+    }
+    storage->setSite(site);
+    std::string message;
+    if (!storage->open(SvtDbAgent::db_storage_schema,
+                       SvtDbAgent::db_edge_journal, message))
+    {
+      logger.logError(message);
+      return EXIT_FAILURE;
+    }
+    std::vector<std::string> tables;
+    std::stringstream tableList(SvtDbAgent::db_edge_tables);
+    std::string table;
+    while (std::getline(tableList, table, ','))
+    {
+      if (!table.empty())
+      {
+        tables.push_back(table);
+      }
+    }
+    storage->start(
+        tables,
+        std::chrono::milliseconds(SvtDbAgent::getNumericSetting(
+            "SVT_DB_AGENT_EDGE_FORWARD_MS", SvtDbAgent::db_edge_forward_ms,
+            1000)),
+        std::chrono::seconds(SvtDbAgent::getNumericSetting(
+            "SVT_DB_AGENT_EDGE_REFRESH_S", SvtDbAgent::db_edge_refresh_s,
+            300)));
+    SvtDbAgent::SvtDbStorage::install(std::move(storage));
+  }
+  else if (SvtDbAgent::db_storage != "postgres")
+  {
+    logger.logError("Unknown storage " + SvtDbAgent::db_storage);
+    return EXIT_FAILURE;
+  }
+  else if (!dbInterface.isConnected())
   {
     if (!connectToDB(psqluser, psqlpass, psqldb, psqlhost, psqlport))
     {
@@ -86,13 +211,34 @@ int main()
       logger.logError("ERROR: We could not initialize enum from DB.");
       return EXIT_FAILURE;
     }
+    _dbAgent.setRequestTimeout(
+        std::chrono::milliseconds(SvtDbAgent::getNumericSetting(
+            "SVT_DB_AGENT_REQUEST_TIMEOUT_MS",
+            SvtDbAgent::db_request_timeout_ms, 0)));
+    if (!_dbAgent.setRequestTimeouts(SvtDbAgent::db_request_timeouts))
+    {
+      return EXIT_FAILURE;
+    }
+    //! one worker per connection, a request holds one while it runs
+    _dbAgent.setWorkerCount(DatabaseIF::instance().getPoolSize());
     if (!_dbAgent.configureService(false))
     {
       return EXIT_FAILURE;
     }
+    //! period for logging the connection pool and latency statistics
+    const long long statsPeriod_s = std::max(
+        SvtDbAgent::getNumericSetting("SVT_DB_AGENT_STATS_PERIOD",
+                                      SvtDbAgent::db_stats_period, 300),
+        1LL);
+    int ticks = 0;
     while (_dbAgent.getIsConsRunnning())
     {
       std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+      if (++ticks % statsPeriod_s == 0)
+      {
+        dbInterface.logPoolStats();
+        dbInterface.logQueryStats();
+      }
       // int time = gTimer.getTicksInSeconds();
       // heartbeatService->updateService(time);
     }